@@ -0,0 +1,79 @@
+//
+//  arena.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "arena.hpp"
+#include <cstdlib>
+#include <algorithm>
+
+
+using namespace CDDB;
+
+
+bool Arena::s_enabled = true;
+
+Arena::~Arena()
+{
+    for (auto& block : m_blocks) std::free(block.data);
+}
+
+Arena* Arena::local()
+{
+    if (!s_enabled) return nullptr;
+    static thread_local Arena arena;
+    return &arena;
+}
+
+void* Arena::allocate(std::size_t size, std::size_t alignment)
+{
+    ++m_allocations;
+
+    while (m_block < m_blocks.size()) {
+        block_t& block = m_blocks[m_block];
+        std::size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= block.size) {
+            m_offset = offset + size;
+            return block.data + offset;
+        }
+        // continue in the next block, or replace it if it is too small for this allocation
+        ++m_block;
+        m_offset = 0;
+        if (m_block < m_blocks.size() && m_blocks[m_block].size < size) {
+            std::free(m_blocks[m_block].data);
+            m_blocks.erase(m_blocks.begin() + m_block);
+        }
+    }
+
+    // malloc() aligns for every fundamental type
+    std::size_t blocksize = std::max(m_blocksize, size);
+    char* data = static_cast<char*>(std::malloc(blocksize));
+    if (!data) throw std::bad_alloc();
+    ++m_heap_blocks;
+    m_blocks.push_back(block_t{data, blocksize});
+    m_block = m_blocks.size() - 1;
+    m_offset = size;
+    return data;
+}
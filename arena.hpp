@@ -0,0 +1,144 @@
+//
+//  arena.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef arena_hpp_ZMXNBCVLAKSJDHFGQPWOEIRUTYZMXNBCVLAKS
+#define arena_hpp_ZMXNBCVLAKSJDHFGQPWOEIRUTYZMXNBCVLAKS
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <new>
+
+
+namespace CDDB {
+
+/// A monotonic arena for the short lived strings of record parsing and hashing.
+/// Allocation moves a pointer forward, deallocation does nothing, and a Scope
+/// releases everything allocated within it at once. The blocks are kept for the
+/// next record. Each thread has its own arena, see local().
+
+class Arena {
+public:
+    Arena(std::size_t blocksize = 64 * 1024) : m_blocksize(blocksize) {}
+    ~Arena();
+
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    /// a position in the arena, everything allocated after it can be released
+    struct mark_t {
+        std::size_t block = 0;
+        std::size_t offset = 0;
+    };
+
+    mark_t mark() const { return mark_t{m_block, m_offset}; }
+    void release(const mark_t& mark) { m_block = mark.block; m_offset = mark.offset; }
+    void reset() { release(mark_t()); }
+
+    /// count of allocations served, and of blocks taken from the heap for them
+    uint64_t allocations() const { return m_allocations; }
+    uint64_t blocks() const { return m_heap_blocks; }
+
+    /// the arena of the calling thread, nullptr if arenas are disabled
+    static Arena* local();
+    /// set before any threads are started (default is enabled)
+    static void set_enabled(bool enabled) { s_enabled = enabled; }
+    static bool enabled() { return s_enabled; }
+
+    /// releases what was allocated in the local arena during its lifetime
+    class Scope {
+    public:
+        Scope() : m_arena(local()) { if (m_arena) m_mark = m_arena->mark(); }
+        ~Scope() { if (m_arena) m_arena->release(m_mark); }
+    private:
+        Arena* m_arena;
+        mark_t m_mark;
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+private:
+    struct block_t {
+        char* data;
+        std::size_t size;
+    };
+
+    std::size_t m_blocksize;
+    std::vector<block_t> m_blocks;
+    std::size_t m_block = 0;
+    std::size_t m_offset = 0;
+    uint64_t m_allocations = 0;
+    uint64_t m_heap_blocks = 0;
+
+    static bool s_enabled;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+};
+
+/// An allocator for the standard containers that takes its memory from an
+/// arena, or from the heap if the arena is nullptr. Default constructed it
+/// uses the arena of the calling thread.
+
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() : m_arena(Arena::local()) {}
+    ArenaAllocator(Arena* arena) : m_arena(arena) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) {}
+
+    T* allocate(std::size_t n)
+    {
+        if (m_arena) return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        if (!m_arena) ::operator delete(p);
+    }
+
+    Arena* arena() const { return m_arena; }
+
+private:
+    Arena* m_arena;
+};
+
+template <class T, class U>
+inline bool operator==(const ArenaAllocator<T>& left, const ArenaAllocator<U>& right) { return left.arena() == right.arena(); }
+template <class T, class U>
+inline bool operator!=(const ArenaAllocator<T>& left, const ArenaAllocator<U>& right) { return left.arena() != right.arena(); }
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> arena_string;
+typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, ArenaAllocator<wchar_t>> arena_wstring;
+
+}
+
+#endif /* arena_hpp */
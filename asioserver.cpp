@@ -48,6 +48,10 @@ void ASIOServer::session(std::unique_ptr<asio::ip::tcp::iostream> stream)
 
         param_t parameters = get_parameters();
 
+        asio::error_code ec;
+        auto endpoint = stream->rdbuf()->remote_endpoint(ec);
+        if (!ec) parameters->peer = endpoint.address().to_string();
+
         stream->expires_from_now(std::chrono::seconds(m_timeout));
         *stream << init(parameters);
 
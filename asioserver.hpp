@@ -52,6 +52,8 @@ protected:
     struct Parameters {
         virtual ~Parameters() {}
         bool terminate = false;
+        // the address of the client
+        std::string peer;
     };
     typedef std::shared_ptr<Parameters> param_t;
     
@@ -0,0 +1,264 @@
+//
+//  asynclog.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <cstring>
+#include <ctime>
+#include <chrono>
+#include "asynclog.hpp"
+#include "metrics.hpp"
+#include "format.hpp"
+
+
+using namespace CDDB;
+
+
+/// returns the ring of a thread to its log when the thread ends
+struct AsyncLog::RingHolder {
+    AsyncLog* log = nullptr;
+    Ring* ring = nullptr;
+
+    ~RingHolder() { release(); }
+
+    void release()
+    {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(log->m_mutex);
+        log->m_unused.push_back(ring);
+        ring = nullptr;
+    }
+};
+
+namespace {
+
+uint64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string timestamp(uint64_t microseconds)
+{
+    char date[32];
+    std::time_t seconds = static_cast<std::time_t>(microseconds / 1000000);
+    struct tm tm;
+    ::localtime_r(&seconds, &tm);
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+    return fmt::format("{0}.{1:06}", date, microseconds % 1000000);
+}
+
+/// the text without line ends, which would break the line of the record
+std::string one_line(const char* text, std::size_t size)
+{
+    std::string line;
+    line.reserve(size);
+    for (std::size_t ct = 0; ct < size; ++ct) {
+        if (text[ct] == '\n') {
+            if (ct + 1 < size) line += " | ";
+        }
+        else if (text[ct] != '\r') line += text[ct];
+    }
+    return line;
+}
+
+}
+
+
+AsyncLog::AsyncLog(std::FILE* protocol, std::FILE* access, std::FILE* slow)
+: m_protocol(protocol)
+, m_access(access)
+, m_slow(slow)
+, m_writer(&AsyncLog::write, this)
+{
+}
+
+AsyncLog::~AsyncLog()
+{
+    m_quit = true;
+    m_writer.join();
+}
+
+AsyncLog::Ring& AsyncLog::ring()
+{
+    static thread_local RingHolder holder;
+
+    if (holder.log != this) {
+        holder.release();
+        holder.log = this;
+    }
+
+    if (!holder.ring) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_unused.empty()) {
+            holder.ring = m_unused.back();
+            m_unused.pop_back();
+        } else {
+            m_rings.push_back(std::make_unique<Ring>());
+            holder.ring = m_rings.back().get();
+        }
+    }
+
+    return *holder.ring;
+}
+
+AsyncLog::Record* AsyncLog::begin_record(Ring& ring)
+{
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head - ring.tail.load(std::memory_order_acquire) >= RingSize) {
+        // only this thread writes the drop count of its ring
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        Metrics::add(Metrics::LogRecordsDropped);
+        return nullptr;
+    }
+    Record* record = &ring.records[head % RingSize];
+    record->time = now();
+    return record;
+}
+
+void AsyncLog::push(Type type, uint64_t connection, const std::string& text)
+{
+    Ring& ring = this->ring();
+    Record* record = begin_record(ring);
+    if (!record) return;
+
+    record->type = type;
+    record->connection = connection;
+    record->size = static_cast<uint16_t>(std::min<std::size_t>(text.size(), TextSize));
+    record->cut = text.size() > TextSize;
+    std::memcpy(record->text, text.data(), record->size);
+
+    ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void AsyncLog::access(const std::string& client, uint64_t connection, const std::string& command, int code, uint64_t latency)
+{
+    Ring& ring = this->ring();
+    Record* record = begin_record(ring);
+    if (!record) return;
+
+    record->type = Access;
+    record->connection = connection;
+    record->code = static_cast<uint16_t>(code);
+    record->latency = latency;
+    std::size_t size = std::min<std::size_t>(client.size(), ClientSize - 1);
+    std::memcpy(record->client, client.data(), size);
+    record->client[size] = 0;
+    record->size = static_cast<uint16_t>(std::min<std::size_t>(command.size(), TextSize));
+    record->cut = command.size() > TextSize;
+    std::memcpy(record->text, command.data(), record->size);
+
+    ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void AsyncLog::slow(std::string line)
+{
+    uint64_t time = now();
+    std::lock_guard<std::mutex> lock(m_slow_mutex);
+    m_slow_lines.emplace_back(time, std::move(line));
+}
+
+uint64_t AsyncLog::dropped() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t dropped = 0;
+    for (const auto& ring : m_rings) dropped += ring->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
+
+std::size_t AsyncLog::drain()
+{
+    std::string protocol;
+    std::string access;
+    std::size_t count = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (const auto& ring : m_rings) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+
+            for (; tail != head; ++tail, ++count) {
+                const Record& record = ring->records[tail % RingSize];
+                std::string text = one_line(record.text, record.size);
+                if (record.cut) text += " ...";
+
+                switch (record.type) {
+                    case Request:
+                        protocol += fmt::format("{0} #{1} > {2}\n", timestamp(record.time), record.connection, text);
+                        break;
+                    case Reply:
+                        protocol += fmt::format("{0} #{1} < {2}\n", timestamp(record.time), record.connection, text);
+                        break;
+                    case Access:
+                        access += fmt::format("{0} {1} #{2} \"{3}\" {4} {5}.{6:03}ms\n", timestamp(record.time), record.client,
+                                              record.connection, text, record.code, record.latency / 1000, record.latency % 1000);
+                        break;
+                }
+            }
+
+            ring->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    uint64_t drops = dropped();
+    if (drops != m_reported_drops) {
+        std::string line = fmt::format("{0} log full, {1} records dropped\n", timestamp(now()), drops - m_reported_drops);
+        (m_protocol ? protocol : access) += line;
+        m_reported_drops = drops;
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> lines;
+    {
+        std::lock_guard<std::mutex> lock(m_slow_mutex);
+        lines.swap(m_slow_lines);
+    }
+    if (m_slow && !lines.empty()) {
+        std::string slow;
+        for (const auto& line : lines) slow += fmt::format("{0} {1}\n", timestamp(line.first), line.second);
+        std::fwrite(slow.data(), 1, slow.size(), m_slow);
+        std::fflush(m_slow);
+    }
+    count += lines.size();
+
+    if (m_protocol && !protocol.empty()) {
+        std::fwrite(protocol.data(), 1, protocol.size(), m_protocol);
+        std::fflush(m_protocol);
+    }
+    if (m_access && !access.empty()) {
+        std::fwrite(access.data(), 1, access.size(), m_access);
+        std::fflush(m_access);
+    }
+
+    return count;
+}
+
+void AsyncLog::write()
+{
+    while (!m_quit) {
+        // poll, the session threads shall not pay for a wake up
+        if (!drain()) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    drain();
+}
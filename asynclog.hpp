@@ -0,0 +1,129 @@
+//
+//  asynclog.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef asynclog_hpp_WERTZUIOPLKJHGFDSAYXCVBNMQWERTZUIOP
+#define asynclog_hpp_WERTZUIOPLKJHGFDSAYXCVBNMQWERTZUIOP
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+
+namespace CDDB {
+
+/// A log that does not make the session threads wait. They copy fixed size
+/// records into a ring buffer of their own (one producer, one consumer, no
+/// lock), and a background thread formats the records and writes them in
+/// batches. A record that finds its ring full is dropped and counted. Texts
+/// longer than a record are cut.
+///
+/// The protocol log has the request lines and the replies of a connection,
+/// the access log a line per command with client, command, reply code and
+/// latency. The slow log takes lines of any length that the caller formats.
+/// They are rare, so they are queued under a lock and never dropped.
+
+class AsyncLog {
+public:
+    enum : uint32_t { RingSize = 1024, TextSize = 192, ClientSize = 46 };
+
+    /// protocol, access or slow may be nullptr to not write that log, the files stay open
+    AsyncLog(std::FILE* protocol, std::FILE* access, std::FILE* slow = nullptr);
+    ~AsyncLog();
+
+    bool protocol() const { return m_protocol; }
+    bool access() const { return m_access; }
+    bool slow() const { return m_slow; }
+
+    void request(uint64_t connection, const std::string& line) { push(Request, connection, line); }
+    void reply(uint64_t connection, const std::string& text) { push(Reply, connection, text); }
+    void access(const std::string& client, uint64_t connection, const std::string& command, int code, uint64_t latency);
+    /// line is written after a timestamp
+    void slow(std::string line);
+
+    /// records dropped because a ring was full
+    uint64_t dropped() const;
+
+private:
+    enum Type : uint8_t { Request, Reply, Access };
+
+    struct Record {
+        // microseconds since 1970
+        uint64_t time;
+        uint64_t connection;
+        // microseconds, of an access record
+        uint64_t latency;
+        uint16_t code;
+        uint16_t size;
+        Type type;
+        bool cut;
+        char client[ClientSize];
+        char text[TextSize];
+    };
+
+    struct Ring {
+        Record records[RingSize];
+        // written by the producer
+        std::atomic<uint64_t> head { 0 };
+        std::atomic<uint64_t> dropped { 0 };
+        // written by the consumer
+        std::atomic<uint64_t> tail { 0 };
+    };
+
+    struct RingHolder;
+
+    std::FILE* m_protocol;
+    std::FILE* m_access;
+    std::FILE* m_slow;
+    mutable std::mutex m_mutex;
+    std::mutex m_slow_mutex;
+    // time and line of the slow requests
+    std::vector<std::pair<uint64_t, std::string>> m_slow_lines;
+    std::vector<std::unique_ptr<Ring>> m_rings;
+    std::vector<Ring*> m_unused;
+    std::atomic<bool> m_quit { false };
+    uint64_t m_reported_drops = 0;
+    std::thread m_writer;
+
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    Ring& ring();
+    Record* begin_record(Ring& ring);
+    void push(Type type, uint64_t connection, const std::string& text);
+    void write();
+    /// formats and writes all records in the rings, returns their count
+    std::size_t drain();
+};
+
+}
+
+#endif /* asynclog_hpp */
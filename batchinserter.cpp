@@ -0,0 +1,121 @@
+//
+//  batchinserter.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "batchinserter.hpp"
+#include "helper.hpp"
+#include "format.hpp"
+#include <algorithm>
+#include <chrono>
+
+
+using namespace CDDB;
+
+
+static std::size_t count_columns(const std::string& columns)
+{
+    return std::count(columns.begin(), columns.end(), ',') + 1;
+}
+
+/// the width is limited by the number of parameters a statement may have
+static std::size_t limit_width(SQLite::Database& sql, std::size_t columns, std::size_t width)
+{
+    std::size_t max_width = sqlite3_limit(sql.getHandle(), SQLITE_LIMIT_VARIABLE_NUMBER, -1) / columns;
+    return std::max<std::size_t>(1, std::min(width, max_width));
+}
+
+static std::string insert_statement(const std::string& table, const std::string& columns, std::size_t rows)
+{
+    std::string row = "(?";
+    for (std::size_t ct = count_columns(columns); ct > 1; --ct) row += ",?";
+    row += ')';
+
+    std::string statement = fmt::format("INSERT INTO {0} ({1}) VALUES ", table, columns);
+    statement.reserve(statement.size() + rows * (row.size() + 1));
+    for (std::size_t ct = 0; ct < rows; ++ct) {
+        if (ct) statement += ',';
+        statement += row;
+    }
+    return statement;
+}
+
+BatchInserter::BatchInserter(SQLite::Database& sql, const std::string& table, const std::string& columns, std::size_t width)
+: m_table(table)
+, m_columns(count_columns(columns))
+, m_width(limit_width(sql, m_columns, width))
+, m_batch(sql, insert_statement(table, columns, m_width))
+, m_single(sql, insert_statement(table, columns, 1))
+, m_values(m_columns * m_width)
+{
+}
+
+void BatchInserter::push(int64_t value)
+{
+    value_t& field = m_values[m_pending * m_columns + m_column++];
+    field.text = false;
+    field.number = value;
+}
+
+void BatchInserter::push(const std::string& value)
+{
+    value_t& field = m_values[m_pending * m_columns + m_column++];
+    field.text = true;
+    field.str = value;
+}
+
+void BatchInserter::write(SQLite::Statement& statement, std::size_t rows)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // the single row statement writes the rest of a batch row by row
+    std::size_t per_statement = (&statement == &m_batch) ? rows : 1;
+
+    for (std::size_t row = 0; row < rows; row += per_statement) {
+        const value_t* field = &m_values[row * m_columns];
+        for (std::size_t ct = 0; ct < per_statement * m_columns; ++ct, ++field) {
+            if (field->text) statement.bind(static_cast<int>(ct + 1), field->str);
+            else statement.bind(static_cast<int>(ct + 1), static_cast<sqlite3_int64>(field->number));
+        }
+        statement.exec();
+        statement.reset();
+    }
+
+    m_rows += rows;
+    m_pending = 0;
+    m_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BatchInserter::flush()
+{
+    if (m_pending) write(m_single, m_pending);
+}
+
+std::string BatchInserter::to_string() const
+{
+    uint64_t rate = m_nanoseconds ? m_rows * 1000000000 / m_nanoseconds : 0;
+    return fmt::format("{0}: {1} rows in {2}, {3} rows/s (batches of {4})",
+                       m_table, m_rows, Duration::to_string(m_nanoseconds, Duration::Precision::Milliseconds), rate, m_width);
+}
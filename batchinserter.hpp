@@ -0,0 +1,96 @@
+//
+//  batchinserter.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef batchinserter_hpp_LKSJDHVBKSJDHVBSKDJHVBSKJDHVBSKJDHB
+#define batchinserter_hpp_LKSJDHVBKSJDHVBSKDJHVBSKJDHVBSKJDHB
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "sqlitecpp/SQLiteCpp.h"
+
+
+namespace CDDB {
+
+/// Collects the rows for one table, and writes them with a prepared multi-row
+/// INSERT ... VALUES (...),(...) statement: one statement run for width rows
+/// instead of one per row. Pending rows are not visible to queries before
+/// they are written, so flush() before reading the table.
+
+class BatchInserter {
+public:
+    /// columns is the comma separated column list of the INSERT
+    BatchInserter(SQLite::Database& sql, const std::string& table, const std::string& columns, std::size_t width = 64);
+
+    /// adds a row with one value per column, returns true if this wrote a batch
+    template <class... Values>
+    bool add(const Values&... values)
+    {
+        if (sizeof...(values) != m_columns) throw std::runtime_error("BatchInserter: wrong number of values for " + m_table);
+        int expand[] = { (push(values), 0)... };
+        (void)expand;
+        m_column = 0;
+        if (++m_pending < m_width) return false;
+        write(m_batch, m_pending);
+        return true;
+    }
+
+    /// writes the pending rows
+    void flush();
+
+    std::size_t width() const { return m_width; }
+    uint64_t rows() const { return m_rows; }
+    /// rows written and their rate, counting only the time spent in the statements
+    std::string to_string() const;
+
+private:
+    struct value_t {
+        bool text = false;
+        int64_t number = 0;
+        std::string str;
+    };
+
+    void push(int64_t value);
+    void push(const std::string& value);
+    void write(SQLite::Statement& statement, std::size_t rows);
+
+    std::string m_table;
+    std::size_t m_columns;
+    std::size_t m_width;
+    SQLite::Statement m_batch;
+    SQLite::Statement m_single;
+    std::vector<value_t> m_values;
+    std::size_t m_pending = 0;
+    std::size_t m_column = 0;
+    uint64_t m_rows = 0;
+    uint64_t m_nanoseconds = 0;
+};
+
+}
+
+#endif /* batchinserter_hpp */
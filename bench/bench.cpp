@@ -0,0 +1,124 @@
+//
+//  bench.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include "bench.hpp"
+#include "../helper.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+Registry& Registry::instance()
+{
+    static Registry registry;
+    return registry;
+}
+
+void Registry::add(const std::string& name, function_t function)
+{
+    m_benchmarks.push_back({ name, function });
+}
+
+void Registry::list() const
+{
+    for (const auto& bm : m_benchmarks) std::cout << bm.name << std::endl;
+}
+
+static bool matches(const std::string& name, const std::string& filter)
+{
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+int Registry::run(const Options& options) const
+{
+    bool any = false;
+    for (const auto& bm : m_benchmarks) if (matches(bm.name, options.filter)) any = true;
+    if (!any) {
+        std::cerr << "no benchmark matches '" << options.filter << "'" << std::endl;
+        return 1;
+    }
+
+    CDDB::Duration corpustime;
+    Corpus corpus(options.corpus);
+    corpustime.lap();
+
+    std::cout << "corpus: " << corpus.size() << " records, " << corpus.bytes() << " bytes, seed "
+              << options.corpus.seed << " (generated in " << corpustime.to_string() << ")" << std::endl;
+    std::cout << std::left << std::setw(32) << "benchmark" << std::right
+              << std::setw(12) << "iterations"
+              << std::setw(16) << "ns/iter"
+              << std::setw(12) << "MB/s"
+              << std::setw(16) << "items/s" << std::endl;
+
+    uint64_t min_ns = static_cast<uint64_t>(options.min_seconds * 1e9);
+
+    for (const auto& bm : m_benchmarks) {
+
+        if (!matches(bm.name, options.filter)) continue;
+
+        // start with one iteration and scale up until the minimum run time is reached
+        uint64_t iterations = 1;
+        uint64_t ns = 0;
+        State* result = nullptr;
+        std::unique_ptr<State> state;
+
+        for (;;) {
+            state.reset(new State(iterations, corpus));
+            CDDB::Duration duration;
+            bm.function(*state);
+            duration.lap();
+            ns = std::max<uint64_t>(duration.get(), 1);
+            if (ns >= min_ns || iterations >= 1000000000) break;
+            // aim 20% above the minimum, but grow by at most 10x per round
+            double factor = std::min(10.0, std::max(1.5, 1.2 * min_ns / ns));
+            iterations = static_cast<uint64_t>(iterations * factor) + 1;
+        }
+        result = state.get();
+
+        double per_iteration = static_cast<double>(ns) / iterations;
+        double seconds = ns / 1e9;
+
+        std::cout << std::left << std::setw(32) << bm.name << std::right
+                  << std::setw(12) << iterations
+                  << std::setw(16) << std::fixed << std::setprecision(1) << per_iteration;
+        if (result->bytes_per_iteration())
+            std::cout << std::setw(12) << std::setprecision(1) << result->bytes_per_iteration() * iterations / seconds / 1e6;
+        else
+            std::cout << std::setw(12) << "-";
+        if (result->items_per_iteration())
+            std::cout << std::setw(16) << std::setprecision(0) << result->items_per_iteration() * iterations / seconds;
+        else
+            std::cout << std::setw(16) << "-";
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+//
+//  bench.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef bench_hpp_KJHDSVKJBSDLKVJBSDLKVJBSDVLKJSBDVLKJ
+#define bench_hpp_KJHDSVKJBSDLKVJBSDLKVJBSDVLKJSBDVLKJ
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <functional>
+#include "corpus.hpp"
+
+
+namespace CDDB {
+namespace Bench {
+
+/// A minimal benchmark harness. A benchmark is a function that loops
+/// while (state.keep_running()) over the code to measure, and reports
+/// the processed bytes and items per iteration. The runner calibrates
+/// the iteration count until the minimum run time is reached.
+
+class State {
+public:
+    State(uint64_t iterations, const Corpus& corpus)
+    : m_iterations(iterations)
+    , m_corpus(corpus) {}
+
+    bool keep_running() { return m_done++ < m_iterations; }
+    uint64_t iterations() const { return m_iterations; }
+
+    /// bytes and items processed by one iteration, to compute throughput
+    void set_bytes_per_iteration(uint64_t bytes) { m_bytes = bytes; }
+    void set_items_per_iteration(uint64_t items) { m_items = items; }
+    uint64_t bytes_per_iteration() const { return m_bytes; }
+    uint64_t items_per_iteration() const { return m_items; }
+
+    const Corpus& corpus() const { return m_corpus; }
+
+private:
+    uint64_t m_iterations;
+    uint64_t m_done = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_items = 0;
+    const Corpus& m_corpus;
+};
+
+typedef std::function<void(State&)> function_t;
+
+class Registry {
+public:
+    struct Options {
+        std::string filter;
+        double min_seconds = 0.5;
+        Corpus::Options corpus;
+    };
+
+    static Registry& instance();
+
+    void add(const std::string& name, function_t function);
+    void list() const;
+    int run(const Options& options) const;
+
+private:
+    struct Benchmark {
+        std::string name;
+        function_t function;
+    };
+    std::vector<Benchmark> m_benchmarks;
+};
+
+struct Registrar {
+    Registrar(const char* name, function_t function) { Registry::instance().add(name, function); }
+};
+
+/// keep the compiler from optimizing away a computed value
+template <class T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace Bench
+} // namespace CDDB
+
+#define CDDB_BENCHMARK(name, function) \
+    static CDDB::Bench::Registrar registrar_##function(name, function)
+
+#endif /* bench_hpp */
@@ -0,0 +1,123 @@
+//
+//  bench_discid.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "bench.hpp"
+#include "../cddbdefines.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+namespace {
+
+/// the frame offsets and lengths of the corpus discs, as the importer sees them
+struct Frames {
+    struct Disc {
+        uint32_t seconds;
+        std::vector<uint32_t> starts;
+        std::vector<uint32_t> lengths;
+        uint32_t startframe;
+    };
+
+    std::vector<Disc> discs;
+    uint64_t frames = 0;
+
+    Frames(const Corpus& corpus)
+    {
+        for (const auto& disc : corpus.discs()) {
+            Disc d;
+            d.seconds = disc.seconds;
+            d.starts = disc.frames;
+            d.lengths = disc.frames;
+            d.startframe = convert_frame_starts_in_frame_lengths(d.seconds, d.lengths);
+            frames += disc.frames.size();
+            discs.push_back(std::move(d));
+        }
+    }
+};
+
+const Frames& frames(const Corpus& corpus)
+{
+    static Frames frames(corpus);
+    return frames;
+}
+
+}
+
+static void fnv_frames(State& state)
+{
+    const Frames& f = frames(state.corpus());
+    while (state.keep_running()) {
+        for (const auto& disc : f.discs) {
+            CDDB::FNVHash32 hash;
+            for (auto frame : disc.lengths) hash.add(frame, true);
+            do_not_optimize(hash.result());
+        }
+    }
+    state.set_bytes_per_iteration(f.frames * sizeof(uint32_t));
+    state.set_items_per_iteration(f.discs.size());
+}
+
+static void discid(State& state)
+{
+    const Frames& f = frames(state.corpus());
+    while (state.keep_running()) {
+        for (const auto& disc : f.discs) do_not_optimize(private_discid(disc.startframe, disc.lengths));
+    }
+    state.set_bytes_per_iteration(f.frames * sizeof(uint32_t));
+    state.set_items_per_iteration(f.discs.size());
+}
+
+static void fuzzy_discid(State& state)
+{
+    const Frames& f = frames(state.corpus());
+    while (state.keep_running()) {
+        for (const auto& disc : f.discs) do_not_optimize(private_fuzzy_discid(disc.startframe, disc.lengths));
+    }
+    state.set_bytes_per_iteration(f.frames * sizeof(uint32_t));
+    state.set_items_per_iteration(f.discs.size());
+}
+
+/// includes copying the frame starts, as the conversion works in place
+static void starts_to_lengths(State& state)
+{
+    const Frames& f = frames(state.corpus());
+    std::vector<uint32_t> work;
+    while (state.keep_running()) {
+        for (const auto& disc : f.discs) {
+            work.assign(disc.starts.begin(), disc.starts.end());
+            do_not_optimize(convert_frame_starts_in_frame_lengths(disc.seconds, work));
+        }
+    }
+    state.set_bytes_per_iteration(f.frames * sizeof(uint32_t));
+    state.set_items_per_iteration(f.discs.size());
+}
+
+CDDB_BENCHMARK("FNVHash32/frames", fnv_frames);
+CDDB_BENCHMARK("discid/private", discid);
+CDDB_BENCHMARK("discid/private_fuzzy", fuzzy_discid);
+CDDB_BENCHMARK("frames/starts_to_lengths", starts_to_lengths);
@@ -0,0 +1,88 @@
+//
+//  bench_diskrecord.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <memory>
+#include "bench.hpp"
+#include "../diskrecord.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+static void parse(State& state)
+{
+    const Corpus& corpus = state.corpus();
+    while (state.keep_running()) {
+        for (const auto& file : corpus.files()) {
+            CDDB::DiskRecord rec(file);
+            do_not_optimize(rec.songs().size());
+        }
+    }
+    state.set_bytes_per_iteration(corpus.bytes());
+    state.set_items_per_iteration(corpus.size());
+}
+
+/// parse, and compute what the importer needs of each record - including the
+/// comparisons it runs for duplicates, here against the previous record
+static void analyze(State& state)
+{
+    const Corpus& corpus = state.corpus();
+    while (state.keep_running()) {
+        std::unique_ptr<CDDB::DiskRecord> previous;
+        for (const auto& file : corpus.files()) {
+            std::unique_ptr<CDDB::DiskRecord> rec(new CDDB::DiskRecord(file));
+            do_not_optimize(rec->normalized_hash());
+            do_not_optimize(rec->entropy());
+            if (previous) {
+                do_not_optimize(previous->compare_normalized_artist_title(*rec));
+                do_not_optimize(previous->compare_normalized_artist(*rec));
+                do_not_optimize(previous->compare_normalized_title(*rec));
+                do_not_optimize(rec->equal_lowercase_strings(*previous));
+            }
+            previous = std::move(rec);
+        }
+    }
+    state.set_bytes_per_iteration(corpus.bytes());
+    state.set_items_per_iteration(corpus.size());
+}
+
+/// the normalization of the title strings for the normalized hash
+static void normalize(State& state)
+{
+    static const std::vector<std::string> titles = state.corpus().titles();
+    uint64_t bytes = 0;
+    for (const auto& title : titles) bytes += title.size();
+    while (state.keep_running()) {
+        for (const auto& title : titles) do_not_optimize(CDDB::DiskRecord::normalize(title).size());
+    }
+    state.set_bytes_per_iteration(bytes);
+    state.set_items_per_iteration(titles.size());
+}
+
+CDDB_BENCHMARK("DiskRecord/parse", parse);
+CDDB_BENCHMARK("DiskRecord/analyze", analyze);
+CDDB_BENCHMARK("DiskRecord/normalize", normalize);
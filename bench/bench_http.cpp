@@ -0,0 +1,71 @@
+//
+//  bench_http.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "bench.hpp"
+#include "../cddbserver.hpp"
+#include "../format.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+namespace {
+
+/// cddb queries over HTTP for the corpus discs, as cddb clients send them
+const std::vector<std::string>& requests(const Corpus& corpus)
+{
+    static std::vector<std::string> requests;
+    if (requests.empty()) {
+        for (const auto& disc : corpus.discs()) {
+            std::string request = fmt::format("GET /~cddb/cddb.cgi?cmd=cddb+query+{0:08x}+{1}", Corpus::legacy_discid(disc), disc.frames.size());
+            for (auto frame : disc.frames) request += fmt::format("+{0}", frame);
+            request += fmt::format("+{0}&hello=joachim+client+cddb-tool+0.4.7&proto=6 HTTP/1.1", disc.seconds);
+            requests.push_back(std::move(request));
+        }
+    }
+    return requests;
+}
+
+}
+
+static void split(State& state)
+{
+    const std::vector<std::string>& r = requests(state.corpus());
+    uint64_t bytes = 0;
+    for (const auto& request : r) bytes += request.size();
+    std::vector<std::string> commands;
+    while (state.keep_running()) {
+        for (const auto& request : r) {
+            commands.clear();
+            do_not_optimize(split_http_cddb(request, commands));
+        }
+    }
+    state.set_bytes_per_iteration(bytes);
+    state.set_items_per_iteration(r.size());
+}
+
+CDDB_BENCHMARK("HTTP/split_http_cddb", split);
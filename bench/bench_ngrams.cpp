@@ -0,0 +1,192 @@
+//
+//  bench_ngrams.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <stdexcept>
+#include "bench.hpp"
+#include "../helper.hpp"
+#include "../diskrecord.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+namespace {
+
+/// the implementation of NGrams before the n-grams were packed into integers,
+/// to compare against
+template <uint16_t nglen, bool added_spaces>
+class LegacyNGrams {
+public:
+    LegacyNGrams(const std::wstring& str = L"")
+    {
+        if (nglen < 2) throw std::runtime_error("NGram minimum len is 2");
+        init(str);
+    }
+
+    std::size_t init(const std::wstring& str)
+    {
+        m_ngrams.clear();
+
+        std::size_t minlen;
+        if (added_spaces) {
+            if (nglen == 2) minlen = 1;
+            else minlen = nglen-2;
+        } else {
+            minlen = nglen;
+        }
+        if (str.size() < minlen) return 0;
+
+        if (added_spaces) {
+            m_count = str.size() - (nglen-3);
+        } else {
+            m_count = str.size() - (nglen-1);
+        }
+
+        if (added_spaces) add_char(' ');
+        for (auto ch : str) add_char(ch);
+        if (added_spaces) add_char(' ');
+        return m_ngrams.size();
+    }
+
+    uint16_t compare(const LegacyNGrams& other)
+    {
+        if (!m_count) return 0;
+
+        uint16_t found = 0;
+        std::vector<bool> used;
+        used.insert(used.begin(), m_ngrams.size(), false);
+
+        for (auto& o : other.m_ngrams) {
+            auto u = used.begin();
+            for (auto& g : m_ngrams) {
+                if (!*u && o == g) {
+                    ++found;
+                    *u = true;
+                    break;
+                }
+                ++u;
+            }
+        }
+
+        return found * 100 / m_count;
+    }
+
+    static uint16_t compare(const std::wstring& left, const std::wstring& right)
+    {
+        LegacyNGrams<nglen, added_spaces> g_left(left);
+        LegacyNGrams<nglen, added_spaces> g_right(right);
+        return g_left.compare(g_right);
+    }
+
+private:
+    typedef std::string ngram_t;
+    typedef std::vector<ngram_t> ngrams_t;
+
+    void add_char(std::wstring::value_type ch)
+    {
+        auto size = m_ngrams.size();
+        if (size < m_count) {
+            m_ngrams.emplace_back("");
+            ++size;
+        }
+        for (uint16_t ct = 0; ct < nglen && ct < size; ++ct) {
+            m_ngrams[size - ct - 1] += ch;
+        }
+    }
+
+    ngrams_t m_ngrams;
+    std::size_t m_count = 0;
+};
+
+/// normalized strings as the importer compares them, in pairs of neighbours
+struct Strings {
+    // artist + title of all discs
+    std::vector<std::wstring> titles;
+    // title and all songs of the compilations, which are the long ones
+    std::vector<std::wstring> compilations;
+
+    Strings(const Corpus& corpus)
+    {
+        for (const auto& disc : corpus.discs()) {
+            titles.push_back(CDDB::DiskRecord::wnormalize(disc.artist + disc.title));
+            if (disc.artist == "Various") {
+                std::string all = disc.title;
+                for (const auto& song : disc.songs) all += song;
+                compilations.push_back(CDDB::DiskRecord::wnormalize(all));
+            }
+        }
+    }
+};
+
+const Strings& strings(const Corpus& corpus)
+{
+    static Strings strings(corpus);
+    return strings;
+}
+
+typedef uint16_t (*compare_t)(const std::wstring& left, const std::wstring& right);
+
+void run(State& state, const std::vector<std::wstring>& strings, compare_t compare)
+{
+    uint64_t chars = 0;
+    for (std::size_t ct = 1; ct < strings.size(); ++ct) chars += strings[ct - 1].size() + strings[ct].size();
+
+    while (state.keep_running()) {
+        for (std::size_t ct = 1; ct < strings.size(); ++ct) {
+            do_not_optimize(compare(strings[ct - 1], strings[ct]));
+        }
+    }
+    state.set_bytes_per_iteration(chars * sizeof(std::wstring::value_type));
+    state.set_items_per_iteration(strings.size() - 1);
+}
+
+}
+
+static void legacy_titles(State& state)
+{
+    run(state, strings(state.corpus()).titles, LegacyNGrams<3, false>::compare);
+}
+
+static void packed_titles(State& state)
+{
+    run(state, strings(state.corpus()).titles, CDDB::NGrams<3, false>::compare);
+}
+
+static void legacy_compilations(State& state)
+{
+    run(state, strings(state.corpus()).compilations, LegacyNGrams<3, false>::compare);
+}
+
+static void packed_compilations(State& state)
+{
+    run(state, strings(state.corpus()).compilations, CDDB::NGrams<3, false>::compare);
+}
+
+CDDB_BENCHMARK("NGrams/legacy/titles", legacy_titles);
+CDDB_BENCHMARK("NGrams/packed/titles", packed_titles);
+CDDB_BENCHMARK("NGrams/legacy/compilations", legacy_compilations);
+CDDB_BENCHMARK("NGrams/packed/compilations", packed_compilations);
@@ -0,0 +1,138 @@
+//
+//  bench_untar.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+#include "bench.hpp"
+#include "../untar.hpp"
+#include "../format.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+namespace {
+
+/// the corpus as uncompressed tar archive in a temporary file
+class Archive {
+public:
+    Archive(const Corpus& corpus)
+    {
+        char path[] = "/tmp/cppcddb-bench-XXXXXX";
+        int fd = ::mkstemp(path);
+        if (fd < 0) throw std::runtime_error("cannot create temporary file");
+        m_path = path;
+
+        std::string tar;
+        uint32_t ct = 0;
+        for (const auto& file : corpus.files()) {
+            tar += Corpus::tar_header(fmt::format("./rock/{0:08x}", ct++), file.size());
+            tar.append(file.begin(), file.end());
+            tar.append((TarHeader::HeaderLen - file.size() % TarHeader::HeaderLen) % TarHeader::HeaderLen, 0);
+        }
+        // the end of archive marker
+        tar.append(2 * TarHeader::HeaderLen, 0);
+
+        if (::write(fd, tar.data(), tar.size()) != static_cast<ssize_t>(tar.size())) {
+            ::close(fd);
+            throw std::runtime_error("cannot write temporary file");
+        }
+        ::close(fd);
+        m_bytes = tar.size();
+    }
+
+    ~Archive() { ::unlink(m_path.c_str()); }
+
+    const std::string& path() const { return m_path; }
+    uint64_t bytes() const { return m_bytes; }
+
+    static const Archive& get(const Corpus& corpus)
+    {
+        static Archive archive(corpus);
+        return archive;
+    }
+
+private:
+    std::string m_path;
+    uint64_t m_bytes = 0;
+};
+
+}
+
+/// the classic interface, copying every file into a buffer
+static void copy(State& state)
+{
+    const Archive& archive = Archive::get(state.corpus());
+    while (state.keep_running()) {
+        UnTar tar(archive.path());
+        UnTar::buf_t data;
+        while (tar.entry(data) != TarHeader::Unknown) do_not_optimize(data.size());
+    }
+    state.set_bytes_per_iteration(archive.bytes());
+    state.set_items_per_iteration(state.corpus().size());
+}
+
+/// the zero copy interface, pointing into the mapped archive
+static void mapped(State& state)
+{
+    const Archive& archive = Archive::get(state.corpus());
+    while (state.keep_running()) {
+        UnTar tar(archive.path());
+        CDDB::StringView data;
+        while (tar.entry(data) != TarHeader::Unknown) do_not_optimize(data.size());
+    }
+    state.set_bytes_per_iteration(archive.bytes());
+    state.set_items_per_iteration(state.corpus().size());
+}
+
+/// the header of every file, without reading the archive. analyze() overwrites
+/// the checksum field, so each header is copied in first
+static void analyze(State& state)
+{
+    static std::vector<std::string> headers;
+    if (headers.empty()) {
+        uint32_t ct = 0;
+        for (const auto& file : state.corpus().files()) headers.push_back(Corpus::tar_header(fmt::format("./rock/{0:08x}", ct++), file.size()));
+    }
+    TarHeader header;
+    while (state.keep_running()) {
+        for (const auto& raw : headers) {
+            std::memcpy(*header, raw.data(), TarHeader::HeaderLen);
+            header.reset();
+            header.analyze();
+            do_not_optimize(header.filesize());
+        }
+    }
+    state.set_bytes_per_iteration(headers.size() * TarHeader::HeaderLen);
+    state.set_items_per_iteration(headers.size());
+}
+
+CDDB_BENCHMARK("UnTar/copy", copy);
+CDDB_BENCHMARK("UnTar/mapped", mapped);
+CDDB_BENCHMARK("TarHeader/analyze", analyze);
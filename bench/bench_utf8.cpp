@@ -0,0 +1,148 @@
+//
+//  bench_utf8.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "bench.hpp"
+#include "../utf8.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+namespace {
+
+/// A sample of the title strings of the corpus, in the encodings the benchmarks
+/// need. The conversions normally run on data that was just read, so the sample
+/// is kept small enough to stay in the cache, and the narrow strings are stored
+/// back to back like they are in the tar buffer.
+
+struct Titles {
+    struct Range {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::string utf8;
+    std::vector<Range> utf8_ranges;
+    std::string latin1;
+    std::vector<Range> latin1_ranges;
+    std::vector<std::wstring> wide;
+    uint64_t wide_chars = 0;
+
+    Titles(const Corpus& corpus)
+    {
+        for (const auto& title : corpus.titles()) {
+            if (utf8.size() + title.size() > 64 * 1024) break;
+            utf8_ranges.push_back({ utf8.size(), title.size() });
+            utf8 += title;
+            std::wstring w;
+            CDDB::Unicode::from_utf8(title, w);
+            wide_chars += w.size();
+            // only keep the titles that have an ISO-8859-1 representation
+            std::string l;
+            for (auto ch : w) {
+                if (ch > 0xff) {
+                    l.clear();
+                    break;
+                }
+                l += static_cast<char>(ch);
+            }
+            if (!l.empty()) {
+                latin1_ranges.push_back({ latin1.size(), l.size() });
+                latin1 += l;
+            }
+            wide.push_back(std::move(w));
+        }
+    }
+};
+
+const Titles& titles(const Corpus& corpus)
+{
+    static Titles titles(corpus);
+    return titles;
+}
+
+}
+
+static void valid_utf8(State& state)
+{
+    const Titles& t = titles(state.corpus());
+    while (state.keep_running()) {
+        for (const auto& r : t.utf8_ranges) do_not_optimize(CDDB::Unicode::valid_utf8(t.utf8.data() + r.offset, r.size));
+    }
+    state.set_bytes_per_iteration(t.utf8.size());
+    state.set_items_per_iteration(t.utf8_ranges.size());
+}
+
+static void from_utf8(State& state)
+{
+    const Titles& t = titles(state.corpus());
+    std::wstring wide;
+    while (state.keep_running()) {
+        for (const auto& r : t.utf8_ranges) {
+            wide.clear();
+            CDDB::Unicode::from_utf8(t.utf8.data() + r.offset, r.size, wide);
+            do_not_optimize(wide.size());
+        }
+    }
+    state.set_bytes_per_iteration(t.utf8.size());
+    state.set_items_per_iteration(t.utf8_ranges.size());
+}
+
+static void to_utf8(State& state)
+{
+    const Titles& t = titles(state.corpus());
+    std::string narrow;
+    while (state.keep_running()) {
+        for (const auto& title : t.wide) {
+            narrow.clear();
+            CDDB::Unicode::to_utf8(title, narrow);
+            do_not_optimize(narrow.size());
+        }
+    }
+    state.set_bytes_per_iteration(t.wide_chars * sizeof(std::wstring::value_type));
+    state.set_items_per_iteration(t.wide.size());
+}
+
+static void latin1_to_utf8(State& state)
+{
+    const Titles& t = titles(state.corpus());
+    std::string narrow;
+    while (state.keep_running()) {
+        for (const auto& r : t.latin1_ranges) {
+            narrow.clear();
+            CDDB::Unicode::latin1_to_utf8(t.latin1.data() + r.offset, r.size, narrow);
+            do_not_optimize(narrow.size());
+        }
+    }
+    state.set_bytes_per_iteration(t.latin1.size());
+    state.set_items_per_iteration(t.latin1_ranges.size());
+}
+
+CDDB_BENCHMARK("Unicode/valid_utf8", valid_utf8);
+CDDB_BENCHMARK("Unicode/from_utf8", from_utf8);
+CDDB_BENCHMARK("Unicode/to_utf8", to_utf8);
+CDDB_BENCHMARK("Unicode/latin1_to_utf8", latin1_to_utf8);
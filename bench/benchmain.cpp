@@ -0,0 +1,91 @@
+//
+//  benchmain.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <iostream>
+#include <unistd.h>
+#include "bench.hpp"
+#include "../helper.hpp"
+#include "../cddbexception.hpp"
+
+
+int main(int argc, char *argv[]) {
+
+    CDDB::set_unicode_locale("", true);
+
+    try {
+
+        CDDB::Bench::Registry::Options options;
+        bool list = false;
+
+        {
+            int opt;
+
+            while ((opt = ::getopt(argc, argv, "f:hln:s:t:")) != -1) {
+                switch (opt) {
+                    case 'f':
+                        options.filter = optarg;
+                        break;
+                    default:
+                    case 'h':
+                        std::cout << argv[0] << " - help:" << std::endl;
+                        std::cout << std::endl;
+                        std::cout << " -f name  : only run benchmarks whose name contains 'name'" << std::endl;
+                        std::cout << " -l       : list the benchmarks" << std::endl;
+                        std::cout << " -n count : number of records in the synthetic corpus (default 10000)" << std::endl;
+                        std::cout << " -s seed  : seed for the synthetic corpus (default 1)" << std::endl;
+                        std::cout << " -t sec   : minimum run time per benchmark (default 0.5)" << std::endl;
+                        std::cout << std::endl;
+                        exit(0);
+                    case 'l':
+                        list = true;
+                        break;
+                    case 'n':
+                        options.corpus.records = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 's':
+                        options.corpus.seed = ::strtoull(optarg, nullptr, 10);
+                        break;
+                    case 't':
+                        options.min_seconds = ::strtod(optarg, nullptr);
+                        break;
+                }
+            }
+        }
+
+        if (list) {
+            CDDB::Bench::Registry::instance().list();
+            return 0;
+        }
+
+        return CDDB::Bench::Registry::instance().run(options);
+
+    } catch (std::exception& e) {
+        std::cerr << "exception: " << e.what() << std::endl;
+    }
+
+    return 1;
+}
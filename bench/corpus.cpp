@@ -0,0 +1,312 @@
+//
+//  corpus.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "corpus.hpp"
+#include "../helper.hpp"
+#include "../utf8.hpp"
+#include "../format.hpp"
+#include "../untar.hpp"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+
+using namespace CDDB::Bench;
+
+
+// words as they typically show up in freedb titles
+static const char* ascii_words[] = {
+    "the", "of", "and", "love", "night", "day", "blue", "rock", "live", "concert", "dream",
+    "greatest", "hits", "vol.", "part", "symphony", "no.", "in", "major", "minor", "remix",
+    "version", "edit", "original", "mix", "feat.", "(live)", "[bonus track]", "-", "/", "&",
+    "heart", "fire", "rain", "city", "road", "home", "song", "music", "world", "time", "one",
+    "1", "2", "3", "10", "1999", "best", "collection", "anthology", "disc", "cd", "2/3"
+};
+
+// words that can be represented in ISO-8859-1
+static const char* latin1_words[] = {
+    "café", "über", "straße", "señor", "élan", "ñandú", "ärger", "ça", "garçon", "mädchen",
+    "öffentlich", "déjà", "crème", "brûlée", "façade", "naïve", "smörgåsbord", "Ølstue", "Århus",
+    "«live»", "½", "©", "¿qué?", "¡olé!"
+};
+
+// words that can only be represented in UTF-8
+static const char* unicode_words[] = {
+    "Ἀθῆναι", "Москва", "東京", "音楽", "서울", "Ελλάδα", "Київ", "שלום", "مرحبا", "♪", "€"
+};
+
+// words that are written in Greek, for the mis-encoded records
+static const char* greek_words[] = {
+    "Γιώργος", "Δημήτρης", "Ελλάδα", "αγάπη", "καρδιά", "τραγούδια", "νύχτα", "θάλασσα",
+    "Ζωντανά", "Μουσική", "Λαϊκά", "Ρεμπέτικα", "και", "της", "το", "η"
+};
+
+static const char* genres[] = {
+    "Rock", "Jazz", "Classical", "Blues", "Misc", "Folk", "Newage", "Data", "Country",
+    "Soundtrack", "Reggae", "Pop", "Metal", "Electronic", "Hip-Hop"
+};
+
+template <class T, std::size_t N>
+static const T& pick(Random& random, const T (&array)[N])
+{
+    return array[random.uniform(N)];
+}
+
+static std::string random_phrase(Random& random, uint32_t words, bool latin1)
+{
+    std::string phrase;
+    for (uint32_t ct = 0; ct < words; ++ct) {
+        if (!phrase.empty()) phrase += ' ';
+        uint32_t kind = random.uniform(100);
+        std::string word;
+        if (kind < 75) word = pick(random, ascii_words);
+        else if (kind < 92 || latin1) word = pick(random, latin1_words);
+        else word = pick(random, unicode_words);
+        // titlecase most of the words
+        if (random.chance(0.7) && !word.empty() && word[0] >= 'a' && word[0] <= 'z') word[0] -= 'a' - 'A';
+        phrase += word;
+    }
+    return phrase;
+}
+
+/// what a Greek phrase looks like after its ISO-8859-7 bytes were read as ISO-8859-1
+static std::string mis_encoded_phrase(Random& random, uint32_t words)
+{
+    std::string phrase;
+    for (uint32_t ct = 0; ct < words; ++ct) {
+        if (!phrase.empty()) phrase += ' ';
+        phrase += pick(random, greek_words);
+    }
+    std::wstring wide;
+    CDDB::Unicode::from_utf8(phrase, wide);
+    // ISO-8859-7 has the Greek letters at their code point minus 0x2d0
+    for (auto& ch : wide) if (ch >= 0x386 && ch <= 0x3ce) ch -= 0x2d0;
+    std::string encoded;
+    CDDB::Unicode::to_utf8(wide, encoded);
+    return encoded;
+}
+
+static std::string to_upper(const std::string& str)
+{
+    std::wstring wide;
+    CDDB::Unicode::from_utf8(str, wide);
+    CDDB::toupper(wide);
+    std::string upper;
+    CDDB::Unicode::to_utf8(wide, upper);
+    return upper;
+}
+
+static std::string to_latin1(const std::string& str)
+{
+    std::wstring wide;
+    CDDB::Unicode::from_utf8(str, wide);
+    std::string latin1;
+    for (auto ch : wide) latin1 += (ch < 0x100) ? static_cast<char>(ch) : '?';
+    return latin1;
+}
+
+Corpus::Disc Corpus::random_disc(Random& random, const Options& options)
+{
+    Disc disc;
+
+    disc.latin1 = random.chance(options.latin1);
+    disc.crlf = random.chance(options.crlf);
+
+    // compilations are the long ones
+    bool compilation = random.chance(0.1);
+
+    disc.artist = compilation ? "Various" : random_phrase(random, random.uniform(1, 3), disc.latin1);
+    disc.title = random_phrase(random, random.uniform(1, 7), disc.latin1);
+    disc.genre = pick(random, genres);
+    disc.year = random.chance(0.8) ? random.uniform(1950, 2016) : 0;
+    disc.revision = random.chance(0.7) ? 0 : random.uniform(1, 9);
+
+    // track count peaks in the middle of the range, compilations have more
+    uint32_t half = std::max(options.max_tracks / 2, 1U);
+    uint32_t tracks = random.uniform(1, half) + random.uniform(0, std::max(options.max_tracks, half) - half);
+    if (compilation) tracks += random.uniform(0, 20);
+
+    bool uppercase = random.chance(options.uppercase);
+
+    uint32_t offset = 150;
+    for (uint32_t ct = 0; ct < tracks; ++ct) {
+        disc.frames.push_back(offset);
+        // 30 seconds to 7 minutes per track
+        offset += random.uniform(30 * 75, 420 * 75);
+        std::string song;
+        if (compilation) song = random_phrase(random, random.uniform(1, 3), disc.latin1) + " / ";
+        song += random_phrase(random, random.uniform(1, 6), disc.latin1);
+        if (uppercase) song = to_upper(song);
+        disc.songs.push_back(std::move(song));
+    }
+    disc.seconds = offset / 75 + 2;
+
+    if (uppercase) {
+        disc.artist = to_upper(disc.artist);
+        disc.title = to_upper(disc.title);
+    }
+
+    return disc;
+}
+
+Corpus::Disc Corpus::Generator::next()
+{
+    Disc disc;
+
+    if (m_options.duplicates > 0 && !m_earlier.empty() && m_random.chance(m_options.duplicates)) {
+
+        disc = m_earlier[m_random.uniform(m_earlier.size())];
+        disc.revision += 1;
+        // another pressing of the same CD, with slightly different frames
+        if (m_random.chance(0.5)) {
+            for (auto& frame : disc.frames) frame += m_random.uniform(0, 4);
+        }
+        if (m_random.chance(0.3)) {
+            disc.artist = to_upper(disc.artist);
+            disc.title = to_upper(disc.title);
+            for (auto& song : disc.songs) song = to_upper(song);
+        }
+
+    } else {
+
+        disc = random_disc(m_random, m_options);
+
+        if (m_options.collisions > 0 && !m_earlier.empty() && m_random.chance(m_options.collisions)) {
+            const Disc& other = m_earlier[m_random.uniform(m_earlier.size())];
+            disc.frames = other.frames;
+            disc.seconds = other.seconds;
+            disc.songs.resize(std::min(disc.songs.size(), disc.frames.size()));
+            while (disc.songs.size() < disc.frames.size()) disc.songs.push_back(random_phrase(m_random, m_random.uniform(1, 6), disc.latin1));
+        }
+
+        if (m_options.bad_encoding > 0 && m_random.chance(m_options.bad_encoding)) {
+            disc.latin1 = false;
+            disc.artist = mis_encoded_phrase(m_random, m_random.uniform(1, 3));
+            disc.title = mis_encoded_phrase(m_random, m_random.uniform(1, 5));
+            for (auto& song : disc.songs) song = mis_encoded_phrase(m_random, m_random.uniform(1, 5));
+        }
+    }
+
+    if (m_options.duplicates > 0 || m_options.collisions > 0) {
+        // keep a window of earlier discs, replacing random ones once it is full
+        if (m_earlier.size() < 4096) m_earlier.push_back(disc);
+        else m_earlier[m_random.uniform(m_earlier.size())] = disc;
+    }
+
+    return disc;
+}
+
+uint32_t Corpus::legacy_discid(const Disc& disc)
+{
+    uint32_t sum = 0;
+    for (auto frame : disc.frames) {
+        for (uint32_t sec = frame / 75; sec > 0; sec /= 10) sum += sec % 10;
+    }
+    uint32_t length = disc.seconds - (disc.frames.empty() ? 0 : disc.frames.front() / 75);
+    return ((sum % 0xff) << 24) | (length << 8) | static_cast<uint32_t>(disc.frames.size());
+}
+
+std::string Corpus::category(const Disc& disc)
+{
+    static const char* categories[] = {
+        "blues", "classical", "country", "data", "folk", "jazz", "newage", "reggae", "rock", "soundtrack"
+    };
+    std::string genre = disc.genre;
+    for (auto& ch : genre) if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+    for (auto category : categories) if (genre == category) return genre;
+    return "misc";
+}
+
+std::string Corpus::tar_header(const std::string& name, std::size_t size, char type)
+{
+    char header[TarHeader::HeaderLen] = {};
+    std::snprintf(header, 100, "%s", name.c_str());
+    std::snprintf(header + 100, 8, "%07o", type == '5' ? 0755 : 0644);
+    std::snprintf(header + 108, 8, "%07o", 0);
+    std::snprintf(header + 116, 8, "%07o", 0);
+    std::snprintf(header + 124, 12, "%011o", static_cast<unsigned>(size));
+    std::snprintf(header + 136, 12, "%011o", 1456790400);
+    header[156] = type;
+    std::memcpy(header + 257, "ustar\0" "00", 8);
+    // the checksum is computed with blanks in its own field
+    std::memset(header + 148, ' ', 8);
+    unsigned sum = 0;
+    for (auto ch : header) sum += static_cast<unsigned char>(ch);
+    std::snprintf(header + 148, 8, "%06o", sum);
+    return std::string(header, sizeof(header));
+}
+
+Corpus::file_t Corpus::xmcd_file(const Disc& disc)
+{
+    const char* eol = disc.crlf ? "\r\n" : "\n";
+
+    std::string file;
+    file.reserve(2048);
+
+    file += fmt::format("# xmcd CD database file{0}#{0}# Track frame offsets:{0}", eol);
+    for (auto frame : disc.frames) file += fmt::format("#\t{0}{1}", frame, eol);
+    file += fmt::format("#{0}# Disc length: {1} seconds{0}#{0}", eol, disc.seconds);
+    file += fmt::format("# Revision: {1}{0}# Submitted via: cppcddb-bench 1.0{0}#{0}", eol, disc.revision);
+    file += fmt::format("DISCID={1:08x}{0}", eol, legacy_discid(disc));
+    file += fmt::format("DTITLE={1} / {2}{0}", eol, disc.artist, disc.title);
+    file += "DYEAR=";
+    if (disc.year) file += std::to_string(disc.year);
+    file += eol;
+    file += fmt::format("DGENRE={1}{0}", eol, disc.genre);
+    int tct = 0;
+    for (const auto& song : disc.songs) file += fmt::format("TTITLE{1}={2}{0}", eol, tct++, song);
+    file += fmt::format("EXTD={0}", eol);
+    for (std::size_t ct = 0; ct < disc.songs.size(); ++ct) file += fmt::format("EXTT{1}={0}", eol, ct);
+    file += fmt::format("PLAYORDER={0}", eol);
+
+    if (disc.latin1) file = to_latin1(file);
+
+    return file_t(file.begin(), file.end());
+}
+
+Corpus::Corpus(const Options& options)
+{
+    Generator generator(options);
+
+    m_discs.reserve(options.records);
+    m_files.reserve(options.records);
+
+    for (uint32_t ct = 0; ct < options.records; ++ct) {
+        m_discs.push_back(generator.next());
+        m_files.push_back(xmcd_file(m_discs.back()));
+        m_bytes += m_files.back().size();
+    }
+}
+
+std::vector<std::string> Corpus::titles() const
+{
+    std::vector<std::string> titles;
+    for (const auto& disc : m_discs) {
+        titles.push_back(disc.artist + " / " + disc.title);
+        titles.insert(titles.end(), disc.songs.begin(), disc.songs.end());
+    }
+    return titles;
+}
@@ -0,0 +1,152 @@
+//
+//  corpus.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef corpus_hpp_SDLKJVBSDLKJBVSLDKJBVSLDKJVBSLDKJVB
+#define corpus_hpp_SDLKJVBSDLKJBVSLDKJBVSLDKJVBSLDKJVB
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+
+namespace CDDB {
+namespace Bench {
+
+/// A small deterministic pseudo random generator (xorshift64*). The
+/// distributions of the standard library are implementation defined, and
+/// would yield different corpora on different platforms.
+
+class Random {
+public:
+    Random(uint64_t seed) : m_state(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+
+    uint64_t next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 2685821657736338717ULL;
+    }
+
+    /// returns a value in [0, range)
+    uint32_t uniform(uint32_t range) { return range ? static_cast<uint32_t>(next() % range) : 0; }
+    /// returns a value in [min, max]
+    uint32_t uniform(uint32_t min, uint32_t max) { return min + uniform(max - min + 1); }
+    /// returns true with the given probability
+    bool chance(double probability) { return (next() >> 11) * (1.0 / 9007199254740992.0) < probability; }
+
+private:
+    uint64_t m_state;
+};
+
+/// A synthetic corpus of xmcd files in the format of the freedb archive,
+/// generated deterministically from a seed so that results are comparable
+/// across machines and commits.
+
+class Corpus {
+public:
+    struct Options {
+        uint32_t records = 10000;
+        uint64_t seed = 1;
+        // fraction of records in ISO-8859-1 instead of UTF-8
+        double latin1 = 0.25;
+        // fraction of records with all uppercase titles
+        double uppercase = 0.1;
+        // fraction of records with CRLF line endings
+        double crlf = 0.02;
+        // track counts are spread between 1 and max_tracks, peaking in the middle
+        // (compilations get up to 20 more)
+        uint32_t max_tracks = 24;
+        // fraction of records that are resubmissions of an earlier disc: same
+        // titles, but revised, and maybe with other frames or in uppercase
+        double duplicates = 0;
+        // fraction of records with the frames of an earlier disc, but other titles
+        double collisions = 0;
+        // fraction of records with mis-encoded titles (ISO-8859-7 read as ISO-8859-1)
+        double bad_encoding = 0;
+    };
+
+    struct Disc {
+        std::string artist;
+        std::string title;
+        std::string genre;
+        uint16_t year = 0;
+        uint16_t revision = 0;
+        std::vector<std::string> songs;
+        // frame start offsets as found in the xmcd file
+        std::vector<uint32_t> frames;
+        uint32_t seconds = 0;
+        bool latin1 = false;
+        bool crlf = false;
+    };
+
+    typedef std::vector<char> file_t;
+
+    /// Generates the discs of a corpus one by one, so that large archives can be
+    /// written without keeping them in memory. Duplicates and collisions are
+    /// drawn from a window of earlier discs. Options that are 0 take no random
+    /// numbers, so corpora without them stay the same as they always were.
+    class Generator {
+    public:
+        Generator(const Options& options) : m_options(options), m_random(options.seed) {}
+        Disc next();
+    private:
+        Options m_options;
+        Random m_random;
+        std::vector<Disc> m_earlier;
+    };
+
+    Corpus(const Options& options);
+
+    const std::vector<file_t>& files() const { return m_files; }
+    const std::vector<Disc>& discs() const { return m_discs; }
+    std::size_t size() const { return m_files.size(); }
+    uint64_t bytes() const { return m_bytes; }
+
+    /// all disc and song titles, as UTF-8
+    std::vector<std::string> titles() const;
+
+    /// generate one random disc
+    static Disc random_disc(Random& random, const Options& options);
+    /// render a disc as xmcd file
+    static file_t xmcd_file(const Disc& disc);
+    /// the legacy CDDB1 discid of a disc
+    static uint32_t legacy_discid(const Disc& disc);
+    /// the freedb category directory of a disc, derived from its genre
+    static std::string category(const Disc& disc);
+    /// a ustar header as UnTar parses it, type is the tar type flag
+    static std::string tar_header(const std::string& name, std::size_t size, char type = '0');
+
+private:
+    std::vector<Disc> m_discs;
+    std::vector<file_t> m_files;
+    uint64_t m_bytes = 0;
+};
+
+} // namespace Bench
+} // namespace CDDB
+
+#endif /* corpus_hpp */
@@ -0,0 +1,92 @@
+//
+//  blockingqueue.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef blockingqueue_hpp_SLDKJVHBSLDKJVBSLKDJVBSLKDJVBSLKDJVB
+#define blockingqueue_hpp_SLDKJVHBSLDKJVBSLKDJVBSLKDJVBSLKDJVB
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+
+namespace CDDB {
+
+/// A bounded FIFO to hand work from producer to consumer threads. push() blocks
+/// while the queue is full, pop() while it is empty. After close() the consumers
+/// drain the remaining values, and then pop() returns false.
+
+template <class T>
+class BlockingQueue {
+public:
+    BlockingQueue(std::size_t capacity) : m_capacity(capacity ? capacity : 1) {}
+
+    /// returns false if the queue is closed, the value is then dropped
+    bool push(T&& value)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this]{ return m_closed || m_queue.size() < m_capacity; });
+        if (m_closed) return false;
+        m_queue.push_back(std::move(value));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /// returns false if the queue is closed and empty
+    bool pop(T& value)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this]{ return m_closed || !m_queue.empty(); });
+        if (m_queue.empty()) return false;
+        value = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+    std::deque<T> m_queue;
+    std::size_t m_capacity;
+    bool m_closed = false;
+};
+
+}
+
+#endif /* blockingqueue_hpp */
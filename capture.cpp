@@ -0,0 +1,102 @@
+//
+//  capture.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <cstring>
+#include <ctime>
+#include "capture.hpp"
+#include "cddbexception.hpp"
+#include "format.hpp"
+
+
+using namespace CDDB;
+
+
+ProtocolCapture::ProtocolCapture(const std::string& filename)
+: m_file(std::fopen(filename.c_str(), "w"))
+, m_start(std::chrono::steady_clock::now())
+{
+    if (!m_file) throw CDDBException(filename + ": cannot create: " + std::strerror(errno));
+
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+    std::fputs(fmt::format("# cppcddbd protocol capture, started {0}\n"
+                           "# microseconds connection type(o=opened r=request c=closed) [request]\n", date).c_str(), m_file);
+    std::fflush(m_file);
+}
+
+ProtocolCapture::~ProtocolCapture()
+{
+    std::fclose(m_file);
+}
+
+void ProtocolCapture::open(uint64_t connection)
+{
+    write(connection, 'o', std::string());
+}
+
+void ProtocolCapture::request(uint64_t connection, const std::string& line)
+{
+    write(connection, 'r', line);
+}
+
+void ProtocolCapture::close(uint64_t connection)
+{
+    write(connection, 'c', std::string());
+}
+
+void ProtocolCapture::write(uint64_t connection, char type, const std::string& line)
+{
+    auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+    std::string event = fmt::format("{0} {1} {2}", time, connection, type);
+    if (type == 'r') {
+        event += ' ';
+        event += line;
+    }
+    event += '\n';
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::fwrite(event.data(), 1, event.size(), m_file);
+    // the server is stopped by a signal, so do not keep events in the buffer
+    std::fflush(m_file);
+}
+
+bool ProtocolCapture::parse(const std::string& line, Event& event)
+{
+    if (line.empty() || line[0] == '#') return false;
+
+    char* end;
+    event.time = std::strtoull(line.c_str(), &end, 10);
+    event.connection = std::strtoull(end, &end, 10);
+    if (*end++ != ' ' || !*end) throw CDDBException("invalid capture line: " + line);
+    event.type = *end++;
+    if (event.type != 'o' && event.type != 'r' && event.type != 'c') throw CDDBException("invalid capture line: " + line);
+    // the request is everything after the separating blank, including a trailing \r
+    if (event.type == 'r' && *end == ' ') event.request.assign(end + 1);
+    else event.request.clear();
+
+    return true;
+}
@@ -0,0 +1,81 @@
+//
+//  capture.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef capture_hpp_LKQJWHEGRFTZUIOPASDMNBVCXYQWERTZUI
+#define capture_hpp_LKQJWHEGRFTZUIOPASDMNBVCXYQWERTZUI
+
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+#include <mutex>
+#include <chrono>
+
+
+namespace CDDB {
+
+/// Records the protocol traffic of the server, to replay it later with
+/// cppcddb-replay. Every event is a line of
+///
+///   microseconds connection type [request]
+///
+/// with the microseconds since the start of the capture, the number of the
+/// connection, and the type o (opened), r (request) or c (closed). A request
+/// is the line as the server read it, without the newline. Lines that start
+/// with # are comments.
+
+class ProtocolCapture {
+public:
+    struct Event {
+        uint64_t time = 0;
+        uint64_t connection = 0;
+        char type = 0;
+        std::string request;
+    };
+
+    ProtocolCapture(const std::string& filename);
+    ~ProtocolCapture();
+
+    void open(uint64_t connection);
+    void request(uint64_t connection, const std::string& line);
+    void close(uint64_t connection);
+
+    /// parses a line of a capture, returns false for comments
+    static bool parse(const std::string& line, Event& event);
+
+private:
+    std::mutex m_mutex;
+    std::FILE* m_file;
+    std::chrono::steady_clock::time_point m_start;
+
+    ProtocolCapture(const ProtocolCapture&) = delete;
+    ProtocolCapture& operator=(const ProtocolCapture&) = delete;
+
+    void write(uint64_t connection, char type, const std::string& line);
+};
+
+}
+
+#endif /* capture_hpp */
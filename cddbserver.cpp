@@ -27,18 +27,43 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
 
 #include "cddbserver.hpp"
 #include "cddbexception.hpp"
 #include "helper.hpp"
 #include "format.hpp"
 #include "diskrecord.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 
 
 
 using namespace CDDB;
 
 
+namespace {
+
+/// microseconds since start, and start set to now
+inline uint64_t lap(std::chrono::steady_clock::time_point& start)
+{
+    auto now = std::chrono::steady_clock::now();
+    uint64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+    start = now;
+    return microseconds;
+}
+
+std::string milliseconds(uint64_t microseconds)
+{
+    return fmt::format("{0}.{1:03}ms", microseconds / 1000, microseconds % 1000);
+}
+
+}
+
+
 
 CDDBSQLServer::CDList::CDList(SQLite::Database& sql)
 : m_query2(sql,  "SELECT artist, title, seconds, tracks FROM CD WHERE cd=?1")
@@ -48,6 +73,8 @@ CDDBSQLServer::CDList::CDList(SQLite::Database& sql)
 
 void CDDBSQLServer::CDList::sort()
 {
+    CDDB_TRACE_SCOPE("sort");
+
     // sort by best frames match
     std::sort(cdvec.begin(), cdvec.end(), [](const cd_t& a, const cd_t& b)
               {
@@ -66,10 +93,13 @@ bool CDDBSQLServer::CDList::has(uint32_t cdid) const
 
 bool CDDBSQLServer::CDList::get(uint32_t cdid, cd_t& cd)
 {
+    CDDB_TRACE_SCOPE("CDList::get");
+
     frames_t frames;
     m_frames2.bind(1, int64_t(cdid));
     while (m_frames2.executeStep()) {
         frames.push_back(static_cast<uint32_t>(m_frames2.getColumn(0).getInt64()));
+        ++m_rows;
     }
     m_frames2.reset();
 
@@ -81,6 +111,7 @@ bool CDDBSQLServer::CDList::get(uint32_t cdid, cd_t& cd)
     if (m_query2.executeStep()) {
 
         found = true;
+        ++m_rows;
         cd.cd = cdid;
         cd.artist = m_query2.getColumn(0).getText();
         cd.title = m_query2.getColumn(1).getText();
@@ -148,22 +179,39 @@ bool CDDBSQLServer::CDList::add_if(uint32_t cdid, const frames_t& tracks, uint32
 }
 
 
-std::string CDDBSQLServer::cddb_query_by_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds)
+std::string CDDBSQLServer::cddb_query_by_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds, stats_t& stats)
 {
+    auto start = std::chrono::steady_clock::now();
+
     // protect sql (or map) access by a lock
     std::lock_guard<std::mutex> lock(m_sqlmutex);
+    stats.lock_wait += lap(start);
+
+    Metrics::Timer sqltime(Metrics::SQLiteTime);
 
     CDList cdlist(m_sql);
 
+    CDDB_TRACE_BEGIN(lookup, "exact lookup");
     m_query.bind(1, int64_t(discid));
     while (m_query.executeStep()) {
         uint32_t cdid = static_cast<uint32_t>(m_query.getColumn(0).getInt64());
         cdlist.add_if(cdid, tracks, m_max_trackdiff);
+        ++stats.exact_candidates;
     }
     m_query.reset();
+    CDDB_TRACE_END(lookup);
+    // before the statements of the cdlist are finalized
+    m_profile.sample("exact lookup");
+    stats.rows += stats.exact_candidates + cdlist.rows();
+    stats.exact_lookup += lap(start);
 
     // sort by best match if there are multiple results
     cdlist.sort();
+    stats.sort += lap(start);
+
+    sqltime.stop();
+    Metrics::Timer formattime(Metrics::FormatTime);
+    CDDB_TRACE_SCOPE("format");
 
     std::string reply;
 
@@ -180,26 +228,43 @@ std::string CDDBSQLServer::cddb_query_by_discid(uint32_t discid, const frames_t&
         reply = fmt::format("200 generic {0:x} {1} / {2}\n", discid, cdlist.begin()->artist, cdlist.begin()->title);
 
     }
-    
+    stats.format += lap(start);
+
     return reply;
 }
 
-std::string CDDBSQLServer::cddb_query_by_fuzzy_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds)
+std::string CDDBSQLServer::cddb_query_by_fuzzy_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds, stats_t& stats)
 {
+    auto start = std::chrono::steady_clock::now();
+
     // protect sql (or map) access by a lock
     std::lock_guard<std::mutex> lock(m_sqlmutex);
+    stats.lock_wait += lap(start);
+
+    Metrics::Timer sqltime(Metrics::SQLiteTime);
 
     CDList cdlist(m_sql);
 
+    CDDB_TRACE_BEGIN(lookup, "fuzzy lookup");
     m_fquery.bind(1, int64_t(discid));
     while (m_fquery.executeStep()) {
         uint32_t cdid = static_cast<uint32_t>(m_fquery.getColumn(0).getInt64());
         cdlist.add_if(cdid, tracks, m_max_trackdiff);
+        ++stats.fuzzy_candidates;
     }
     m_fquery.reset();
+    CDDB_TRACE_END(lookup);
+    m_profile.sample("fuzzy lookup");
+    stats.rows += stats.fuzzy_candidates + cdlist.rows();
+    stats.fuzzy_lookup += lap(start);
 
     // sort by best match if there are multiple results
     cdlist.sort();
+    stats.sort += lap(start);
+
+    sqltime.stop();
+    Metrics::Timer formattime(Metrics::FormatTime);
+    CDDB_TRACE_SCOPE("format");
 
     std::string reply;
 
@@ -217,64 +282,95 @@ std::string CDDBSQLServer::cddb_query_by_fuzzy_discid(uint32_t discid, const fra
         reply += ".\n";
 
     }
+    stats.format += lap(start);
 
     return reply;
 }
 
-std::string CDDBSQLServer::cddb_query(uint32_t discid, const frames_t& tracks, uint32_t seconds)
+std::size_t CDDBSQLServer::frames_hash::operator()(const frames_t& frames) const
+{
+    std::size_t hash = 0;
+    for (auto frame : frames) hash = hash * 31 + frame;
+    return hash;
+}
+
+std::string CDDBSQLServer::cddb_lookup(uint32_t discid, const frames_t& tracks, uint32_t seconds, stats_t& stats)
 {
-    // calculate private discid
-    discid = private_discid(seconds, tracks);
     // try exact discid
-    std::string reply = cddb_query_by_discid(discid, tracks, seconds);
+    std::string reply = cddb_query_by_discid(discid, tracks, seconds, stats);
 
-    // try fuzzy discid if no result
     if (reply.empty()) {
+
+        // try fuzzy discid if no result
         // calculate private fuzzy discid
-        discid = private_fuzzy_discid(seconds, tracks);
-        reply = cddb_query_by_fuzzy_discid(discid, tracks, seconds);
+        uint32_t fuzzyid = private_fuzzy_discid(seconds, tracks);
+        reply = cddb_query_by_fuzzy_discid(fuzzyid, tracks, seconds, stats);
+
+        if (reply.empty()) reply = "202\n";
+
     }
 
-    if (reply.empty()) reply = "202\n";
+    Metrics::record(Metrics::QueryCandidates, stats.exact_candidates + stats.fuzzy_candidates);
+
+    return reply;
+}
+
+std::string CDDBSQLServer::cddb_query(uint32_t discid, const frames_t& tracks, uint32_t seconds, Parameters& parameters)
+{
+    // calculate private discid
+    discid = private_discid(seconds, tracks);
+
+    // the same TOC from several clients at once is looked up only once
+    frames_t key(tracks);
+    key.push_back(seconds);
+    key.push_back(discid);
+    auto start = std::chrono::steady_clock::now();
+    bool shared;
+    std::string reply = m_queries.run(key, [&]{ return cddb_lookup(discid, tracks, seconds, parameters.stats); }, shared);
+    if (shared) {
+        parameters.stats.coalesced += lap(start);
+        Metrics::add(Metrics::QueriesCoalesced);
+    }
+
+    if (CDDB::begins_with(reply, "202")) Metrics::add(Metrics::QueryMiss);
+    else if (CDDB::begins_with(reply, "211")) Metrics::add(Metrics::QueryFuzzy);
+    else {
+
+        // 210 for multiple matches, 200 for one
+        Metrics::add(reply[1] == '1' ? Metrics::QueryExactMultiple : Metrics::QueryExact);
+        // all matches have this discid, so whichever the client reads is the same
+        if (parameters.prefetch) m_prefetch->prefetch(parameters.prefetch, discid);
+
+    }
 
     return reply;
 }
 
-std::string CDDBSQLServer::build_cddb_file(uint32_t discid, const std::string& category)
+std::string CDDBSQLServer::build_cddb_file(uint32_t discid, const std::string& category, stats_t& stats)
 {
+    auto start = std::chrono::steady_clock::now();
+
     // protect sql (or map) access by a lock
     std::lock_guard<std::mutex> lock(m_sqlmutex);
+    stats.lock_wait += lap(start);
 
     std::string file;
 
-    m_qcd.bind(1, int64_t(discid));
-    if (m_qcd.executeStep()) {
-
-        int32_t cd          = static_cast<uint32_t>(m_qcd.getColumn(0).getInt64());
-        std::string artist  = m_qcd.getColumn(1).getText();
-        std::string title   = m_qcd.getColumn(2).getText();
-        int32_t genre_id    = static_cast<uint32_t>(m_qcd.getColumn(3).getInt64());
-        int32_t year        = static_cast<uint32_t>(m_qcd.getColumn(4).getInt64());
-        int32_t seconds     = static_cast<uint32_t>(m_qcd.getColumn(5).getInt64());
-        int32_t revision    = static_cast<uint32_t>(m_qcd.getColumn(6).getInt64());
-        std::string genre   = m_genres.map(genre_id);
-
-        std::vector<std::string> songs;
-        std::vector<uint32_t> frames;
-
-        m_qtracks.bind(1, cd);
-        while (m_qtracks.executeStep()) {
-            songs.push_back(m_qtracks.getColumn(0).getText());
-            frames.push_back(static_cast<uint32_t>(m_qtracks.getColumn(1).getInt64()));
-        }
-        m_qtracks.reset();
-        
-        DiskRecord rec(discid, std::move(artist), std::move(title), year, std::move(genre),
-                       std::move(songs), std::move(frames), revision, seconds);
-
-        file = rec.cddb_file();
+    Metrics::Timer sqltime(Metrics::SQLiteTime);
+    CDDB_TRACE_BEGIN(lookup, "read lookup");
+    auto rec = m_reader.read(discid);
+    m_profile.sample("read");
+    CDDB_TRACE_END(lookup);
+    sqltime.stop();
+    stats.read += lap(start);
+
+    if (rec) {
+        stats.rows += 1 + static_cast<uint32_t>(rec->songs().size());
+        Metrics::Timer formattime(Metrics::FormatTime);
+        CDDB_TRACE_SCOPE("format");
+        file = rec->cddb_file();
+        stats.format += lap(start);
     }
-    m_qcd.reset();
 
     return file;
 }
@@ -297,11 +393,17 @@ std::string CDDBSQLServer::register_user(std::vector<std::string>::const_iterato
 
 std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& parameters)
 {
+    auto start = std::chrono::steady_clock::now();
+    Metrics::Counter command = Metrics::CommandOther;
+    CDDB_TRACE_SCOPE("request");
+
     std::string reply;
     std::vector<std::string> words;
 
+    CDDB_TRACE_BEGIN(tokenize, "tokenize");
     CDDB::StringTokenizer<std::string> tokenizer(qstr, " \t\r\n");
     tokenizer.split(words);
+    CDDB_TRACE_END(tokenize);
     
     auto wordct = words.size();
 
@@ -330,6 +432,7 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
                 // cddb hello username hostname clientname version
 
+                command = Metrics::CommandHello;
                 reply = register_user(++it, words.cend());
 
                 parameters.handshake = true;
@@ -345,11 +448,14 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
                 if (*it == "lscat") {
 
+                    command = Metrics::CommandLscat;
                     reply = "200 Okay category list follows (until terminating marker)\ngeneric\n.\n";
                 }
 
                 else if (*it == "query") {
 
+                    command = Metrics::CommandQuery;
+
                     if (wordct < 6) {
 
                         reply = "530 insufficient parameters\n";
@@ -376,7 +482,7 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
                             seconds = convert_frame_starts_in_frame_lengths(seconds, tracks);
 
-                            reply = cddb_query(discid, tracks, seconds);
+                            reply = cddb_query(discid, tracks, seconds, parameters);
 
                         } else {
 
@@ -392,6 +498,8 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
                 else if (*it == "read") {
 
+                    command = Metrics::CommandRead;
+
                     if (wordct != 4) {
 
                         reply = "530 invalid parameter count\n";
@@ -400,17 +508,30 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
                     } else {
 
                         // cddb read categ discid
-                        std::string rec = build_cddb_file(static_cast<uint32_t>(std::stoul(words[3], nullptr, 16)), words[2]);
+                        uint32_t discid = static_cast<uint32_t>(std::stoul(words[3], nullptr, 16));
+                        std::string rec;
+                        if (!parameters.prefetch || !m_prefetch->take(*parameters.prefetch, discid, rec)) {
+                            // the same CD for several clients at once is read only once
+                            auto start = std::chrono::steady_clock::now();
+                            bool shared;
+                            rec = m_reads.run(discid, [&]{ return build_cddb_file(discid, words[2], parameters.stats); }, shared);
+                            if (shared) {
+                                parameters.stats.coalesced += lap(start);
+                                Metrics::add(Metrics::ReadsCoalesced);
+                            }
+                        }
 
                         if (!rec.empty()) {
 
                             reply = fmt::format("210 {0} {1}\n", words[2], words[3]);
                             reply += rec;
                             reply += ".\n";
+                            Metrics::add(Metrics::ReadFound);
 
                         } else {
 
                             reply = fmt::format("{0} {1} {2} No such CD entry in database.\n", 401, words[2], words[3]);
+                            Metrics::add(Metrics::ReadMissing);
                             
                         }
                     }
@@ -431,6 +552,7 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
             // hello username hostname clientname version
 
+            command = Metrics::CommandHello;
             reply = register_user(++it, words.cend());
 
             parameters.handshake = true;
@@ -445,6 +567,7 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
         else if (*it == "stat") {
 
+            command = Metrics::CommandStat;
             reply = "210 OK, status information follows (until terminating `.')\n";
             reply += "current proto: 6\n";
             reply += "max proto: 6\n";
@@ -452,10 +575,10 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
             reply += "updates: no\n";
             reply += "posting: no\n";
             reply += "quotes: no\n";
-            reply += "current users: 1\n";
+            reply += fmt::format("current users: {0}\n", Metrics::collect().connections());
             reply += "max users: 1000\n";
             reply += "strip ext: yes\n";
-            reply += "Database entries: 3565787\n";
+            reply += fmt::format("Database entries: {0}\n", database_entries());
             reply += ".\n";
 
         }
@@ -463,6 +586,7 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
         else if (*it == "proto") {
 
             // proto [level]
+            command = Metrics::CommandProto;
             int level = 0;
             if (++it != words.end()) level = std::stoi(*it);
             if (level == 6) reply = "502 Protocol level already 6\n";
@@ -473,12 +597,14 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
         else if (*it == "ver") {
 
+            command = Metrics::CommandVer;
             reply = "200 hostname C++CDDB v1.0 (c) Joachim Schurig 2016.\n";
 
         }
 
         else if (*it == "quit") {
 
+            command = Metrics::CommandQuit;
             reply = "230 hostname Closing connection. Goodbye.\n";
             parameters.terminate = true;
             
@@ -493,9 +619,36 @@ std::string CDDBSQLServer::cddb_request(const std::string& qstr, Parameters& par
 
     }
 
+    Metrics::add(command);
+    Metrics::record(command == Metrics::CommandQuery ? Metrics::LatencyQuery : command == Metrics::CommandRead ? Metrics::LatencyRead : Metrics::LatencyOther,
+                    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
     return reply;
 }
 
+uint64_t CDDBSQLServer::database_entries()
+{
+    std::lock_guard<std::mutex> lock(m_sqlmutex);
+
+    // counted on first use, as the database does not change while we serve it
+    if (m_entries < 0) m_entries = m_sql.execAndGet("SELECT count(*) FROM CD").getInt64();
+
+    return m_entries;
+}
+
+std::string CDDBSQLServer::metrics()
+{
+    std::string text = Metrics::prometheus(Metrics::collect());
+
+    text += Metrics::prometheus("cddb_database_entries", "gauge", "CDs in the database.", database_entries());
+
+    std::lock_guard<std::mutex> lock(m_sqlmutex);
+    m_profile.sample("other");
+    text += m_profile.prometheus();
+
+    return text;
+}
+
 inline uint16_t hex_digit(std::string::value_type ch)
 {
     if (ch >= '0' && ch <= '9') return ch - '0';
@@ -569,13 +722,68 @@ std::size_t split_http_cddb(const std::string qstr, std::vector<std::string>& sv
     return svec.size();
 }
 
+/// the CDDB reply code, also of a reply in a HTTP response, or else the HTTP status
+static int reply_code(const std::string& reply)
+{
+    const char* code = reply.c_str();
+    if (CDDB::begins_with(reply, "HTTP/")) {
+        auto body = reply.find("\r\n\r\n");
+        if (body != std::string::npos && body + 7 <= reply.size() && std::isdigit(reply[body + 4])) code += body + 4;
+        else if (reply.size() > 9) code += 9;
+    }
+    return std::atoi(code);
+}
+
 std::string CDDBSQLServer::request(const std::string& qstr, ASIOServer::param_t parameters)
 {
     param_t par = std::dynamic_pointer_cast<Parameters>(parameters);
-    if (m_print_protocol) std::cerr << qstr << std::endl;
+    if (m_log && m_log->protocol()) m_log->request(par->connection, qstr);
+    if (par->capture) par->capture->request(par->connection, qstr);
+
+    auto start = std::chrono::steady_clock::now();
+    par->stats = stats_t();
+    std::string command;
+    std::string reply = dispatch(qstr, par, command);
+
+    if (m_log && !reply.empty()) {
+        uint64_t latency = lap(start);
+        if (m_log->protocol()) m_log->reply(par->connection, reply);
+        if (m_log->access()) m_log->access(par->peer, par->connection, command, reply_code(reply), latency);
+        if (m_log->slow() && latency >= m_slow_threshold) {
+            const stats_t& stats = par->stats;
+            m_log->slow(fmt::format("{0} #{1} \"{2}\" {3} {4} candidates exact={5} fuzzy={6} rows={7}"
+                                    " lock={8} exact={9} fuzzy={10} sort={11} format={12} read={13} coalesced={14}",
+                                    par->peer, par->connection, command, reply_code(reply), milliseconds(latency),
+                                    stats.exact_candidates, stats.fuzzy_candidates, stats.rows,
+                                    milliseconds(stats.lock_wait), milliseconds(stats.exact_lookup), milliseconds(stats.fuzzy_lookup),
+                                    milliseconds(stats.sort), milliseconds(stats.format), milliseconds(stats.read),
+                                    milliseconds(stats.coalesced)));
+        }
+    }
+
+    return reply;
+}
+
+std::string CDDBSQLServer::dispatch(const std::string& qstr, param_t par, std::string& command)
+{
+    command = qstr;
+
+    if (CDDB::begins_with(qstr, "GET /trace")) {
+        par->is_http = true;
+        std::string json = Trace::chrome_json();
+        return fmt::format("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: {0}\r\n\r\n", json.size()) + json;
+    }
+
+    if (CDDB::begins_with(qstr, "GET /metrics")) {
+        par->is_http = true;
+        Metrics::add(Metrics::MetricsRequests);
+        std::string text = metrics();
+        return fmt::format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {0}\r\n\r\n", text.size()) + text;
+    }
 
     if (CDDB::begins_with(qstr, "GET ")) {
         par->is_http = true;
+        Metrics::add(Metrics::HttpRequests);
         std::vector<std::string> cmds;
         if (split_http_cddb(qstr, cmds) == 3) {
             // parse the cddb hello
@@ -583,13 +791,12 @@ std::string CDDBSQLServer::request(const std::string& qstr, ASIOServer::param_t
             // parse the proto command
             cddb_request(cmds[2], *par);
             // and finally parse the query
-            if (m_print_protocol) std::cerr << cmds[0] << std::endl;
+            command = cmds[0];
             std::string cddbres = cddb_request(cmds[0], *par);
             std::string res;
             res.reserve(cddbres.size() + 80);
             res = fmt::format("HTTP/1.1 200 OK\r\nContent-Length: {0}\r\n\r\n", cddbres.size());
             res += cddbres;
-            if (m_print_protocol) std::cerr << res << std::endl;
             return res;
         }
         throw std::runtime_error("invalid query");
@@ -607,23 +814,83 @@ std::string CDDBSQLServer::init(ASIOServer::param_t parameters)
 {
     // do not send the welcome message if we expect HTTP on this port (it would destroy the first HTTP response)
     if (m_expect_http) return std::string();
-    else return request("", parameters);
+    // else answer an empty request, but not through request(), which would capture it
+    else return cddb_request("", *std::dynamic_pointer_cast<Parameters>(parameters));
+}
+
+ASIOServer::param_t CDDBSQLServer::get_parameters()
+{
+    auto parameters = std::make_shared<Parameters>();
+    Metrics::add(Metrics::ConnectionsOpened);
+    parameters->connection = ++m_connections;
+    if (m_prefetch) parameters->prefetch = std::make_shared<Prefetcher::Slot>();
+    if (m_capture) {
+        parameters->capture = m_capture;
+        m_capture->open(parameters->connection);
+    }
+    return parameters;
+}
+
+CDDBSQLServer::file_t CDDBSQLServer::open_log(const std::string& filename)
+{
+    if (filename == "-") return file_t(stderr, [](std::FILE*) { return 0; });
+    file_t file(std::fopen(filename.c_str(), "a"), std::fclose);
+    if (!file) throw CDDBException(filename + ": cannot open: " + std::strerror(errno));
+    return file;
+}
+
+void CDDBSQLServer::start_log()
+{
+    // only one log for the lifetime of the server, the session threads keep a pointer to it
+    if (m_log || (!m_print_protocol && !m_access_file && !m_slow_file)) return;
+    m_log = std::make_unique<AsyncLog>(m_print_protocol ? stderr : nullptr, m_access_file.get(), m_slow_file.get());
+}
+
+bool CDDBSQLServer::start(uint16_t timeout_seconds, bool block)
+{
+    start_log();
+    return ASIOServer::start(timeout_seconds, block);
+}
+
+void CDDBSQLServer::access_log(const std::string& filename)
+{
+    if (m_log) throw CDDBException("the access log has to be set before the server starts");
+    m_access_file = open_log(filename);
+}
+
+void CDDBSQLServer::enable_prefetch()
+{
+    m_prefetch = std::make_unique<Prefetcher>(m_sql.getFilename());
+}
+
+void CDDBSQLServer::slow_log(const std::string& filename, uint32_t milliseconds)
+{
+    if (m_log) throw CDDBException("the slow log has to be set before the server starts");
+    m_slow_file = open_log(filename);
+    m_slow_threshold = uint64_t(milliseconds) * 1000;
 }
 
 CDDBSQLServer::CDDBSQLServer(const std::string& dbname, uint16_t port, bool expect_http, bool print_protocol, uint16_t max_trackdiff)
 : ASIOServer(port)
 , m_sql(dbname, SQLITE_OPEN_READONLY, 1000) // set busy timeout to 1000ms
-, m_qcd(m_sql,     "SELECT CD.cd, CD.artist, CD.title, CD.genre, CD.year, CD.seconds, CD.revision"
-                   " FROM DISCID,CD WHERE DISCID.discid=?1 AND CD.cd=DISCID.cd")
-, m_qtracks(m_sql, "SELECT song, frames FROM TRACKS WHERE cd=?1 ORDER BY track ASC")
+, m_reader(m_sql)
 , m_query(m_sql,   "SELECT cd FROM DISCID WHERE discid=?1")
 , m_fquery(m_sql,  "SELECT cd FROM FUZZYID WHERE fuzzyid=?1")
 , m_frames(m_sql,  "SELECT cd FROM TRACKS WHERE frames>?1 AND frames<?2 AND track=?3")
-, m_genres(m_sql,  "GENRE")
+, m_profile(m_sql)
 , m_expect_http(expect_http)
 , m_print_protocol(print_protocol)
+, m_access_file(nullptr, std::fclose)
+, m_slow_file(nullptr, std::fclose)
 , m_max_trackdiff(max_trackdiff * 75)
 {
+    // check that the statements of the queries and reads find their rows by index
+    CDList cdlist(m_sql);
+    std::vector<const SQLite::Statement*> statements { &m_query, &m_fquery };
+    for (const auto* statement : m_reader.statements()) statements.push_back(statement);
+    for (const auto* statement : cdlist.statements()) statements.push_back(statement);
+    for (const auto& warning : m_profile.check_plans(statements)) std::cerr << "warning: " << warning << std::endl;
+    m_profile.sample("startup");
 }
 
 
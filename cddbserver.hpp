@@ -29,11 +29,21 @@
 
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdio>
 
 #include "sqlitecpp/SQLiteCpp.h"
 #include "cddbstringintmap.hpp"
 #include "asioserver.hpp"
 #include "cddbdefines.hpp"
+#include "capture.hpp"
+#include "metrics.hpp"
+#include "asynclog.hpp"
+#include "sqliteprofile.hpp"
+#include "cdreader.hpp"
+#include "prefetch.hpp"
+#include "singleflight.hpp"
 
 
 namespace CDDB {
@@ -42,17 +52,57 @@ class CDDBSQLServer : public ASIOServer {
 public:
     CDDBSQLServer(const std::string& dbname, uint16_t port = 8880, bool expect_http = true, bool print_protocol = false, uint16_t max_trackdiff = 4);
 
+    /// record all connections and requests into filename, see ProtocolCapture
+    void capture_protocol(const std::string& filename) { m_capture = std::make_shared<ProtocolCapture>(filename); }
+    /// append one line per request to filename ("-" is stderr), see AsyncLog
+    void access_log(const std::string& filename);
+    /// append the requests that took at least milliseconds to filename ("-" is stderr),
+    /// with the candidates, rows and time of each stage
+    void slow_log(const std::string& filename, uint32_t milliseconds);
+    /// read the CD of an exact query result on a worker thread, for the read that usually follows, see Prefetcher
+    void enable_prefetch();
+    /// starts the logs that were set up before, and the server
+    bool start(uint16_t timeout_seconds = 5 * 60, bool block = false);
+
 protected:
+    /// what the current request did, for the slow log
+    struct stats_t {
+        // CDs found by discid and by fuzzy discid
+        uint32_t exact_candidates = 0;
+        uint32_t fuzzy_candidates = 0;
+        // rows read from the database
+        uint32_t rows = 0;
+        // microseconds per stage
+        uint64_t lock_wait = 0;
+        uint64_t exact_lookup = 0;
+        uint64_t fuzzy_lookup = 0;
+        uint64_t sort = 0;
+        uint64_t format = 0;
+        uint64_t read = 0;
+        // waiting for the same query or read of another client
+        uint64_t coalesced = 0;
+    };
+
     struct Parameters : public ASIOServer::Parameters {
         bool handshake = false;
         bool is_http = false;
+        // the number of the connection in the logs and the capture
+        uint64_t connection = 0;
+        std::shared_ptr<ProtocolCapture> capture;
+        stats_t stats;
+        std::shared_ptr<Prefetcher::Slot> prefetch;
+        virtual ~Parameters()
+        {
+            Metrics::add(Metrics::ConnectionsClosed);
+            if (capture) capture->close(connection);
+        }
     };
     typedef std::vector<uint32_t> frames_t;
     typedef std::shared_ptr<Parameters> param_t;
     
     virtual std::string init(ASIOServer::param_t parameters) override;
     virtual std::string request(const std::string& qstr, ASIOServer::param_t parameters) override;
-    virtual ASIOServer::param_t get_parameters() override { return std::make_shared<Parameters>(); }
+    virtual ASIOServer::param_t get_parameters() override;
 
 private:
     class CDList {
@@ -83,37 +133,66 @@ private:
         cdvec_t::iterator begin() { return cdvec.begin(); }
         cdvec_t::iterator end() { return cdvec.end(); }
 
+        std::vector<const SQLite::Statement*> statements() const { return { &m_query2, &m_frames2 }; }
+        /// rows read by the CDs added so far
+        uint32_t rows() const { return m_rows; }
+
     private:
         bool get(uint32_t cdid, cd_t& cd);
         SQLite::Statement m_query2;
         SQLite::Statement m_frames2;
         cdvec_t cdvec;
+        uint32_t m_rows = 0;
     };
 
     SQLite::Database m_sql;
-    SQLite::Statement m_qcd;
-    SQLite::Statement m_qtracks;
+    CDReader m_reader;
     SQLite::Statement m_query;
     SQLite::Statement m_fquery;
     SQLite::Statement m_frames;
-    StringIntMapCache m_genres;
+    SQLiteProfile m_profile;
     std::mutex m_sqlmutex;
     bool m_expect_http = true;
     bool m_print_protocol = false;
+    std::shared_ptr<ProtocolCapture> m_capture;
+    std::atomic<uint64_t> m_connections { 0 };
+    typedef std::unique_ptr<std::FILE, int(*)(std::FILE*)> file_t;
+    file_t m_access_file;
+    file_t m_slow_file;
+    uint64_t m_slow_threshold = 0;
+    std::unique_ptr<Prefetcher> m_prefetch;
+    struct frames_hash {
+        std::size_t operator()(const frames_t& frames) const;
+    };
+    SingleFlight<frames_t, std::string, frames_hash> m_queries;
+    SingleFlight<uint32_t, std::string> m_reads;
+    // declared after the files, so that it is flushed before they close
+    std::unique_ptr<AsyncLog> m_log;
+    int64_t m_entries = -1;
     uint32_t m_max_trackdiff = 4 * 75;
 
     CDDBSQLServer(const CDDBSQLServer&) = delete;
     CDDBSQLServer& operator=(const CDDBSQLServer&) = delete;
 
+    std::string dispatch(const std::string& qstr, param_t parameters, std::string& command);
     std::string cddb_request(const std::string& qstr, Parameters& parameters);
-    std::string build_cddb_file(uint32_t discid, const std::string& category);
-    std::string cddb_query_by_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds);
-    std::string cddb_query_by_fuzzy_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds);
-    std::string cddb_query(uint32_t discid, const frames_t& tracks, uint32_t seconds);
+    std::string build_cddb_file(uint32_t discid, const std::string& category, stats_t& stats);
+    std::string cddb_query_by_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds, stats_t& stats);
+    std::string cddb_query_by_fuzzy_discid(uint32_t discid, const frames_t& tracks, uint32_t seconds, stats_t& stats);
+    std::string cddb_lookup(uint32_t discid, const frames_t& tracks, uint32_t seconds, stats_t& stats);
+    std::string cddb_query(uint32_t discid, const frames_t& tracks, uint32_t seconds, Parameters& parameters);
+    static file_t open_log(const std::string& filename);
+    void start_log();
+    uint64_t database_entries();
+    /// the metrics in the Prometheus text format, for GET /metrics
+    std::string metrics();
     std::string register_user(std::vector<std::string>::const_iterator it, std::vector<std::string>::const_iterator end);
 };
 
 
 }
 
+/// splits the cddb commands out of the query string of a HTTP GET request, returns their count
+std::size_t split_http_cddb(const std::string qstr, std::vector<std::string>& svec);
+
 #endif /* cddbserver_hpp */
@@ -52,6 +52,13 @@ StringIntMapCache::StringIntMapCache(SQLite::Database& sql, const std::string& t
 : m_insert_new(sql, fmt::format("INSERT INTO {0} (name) VALUES (?1)", tablename))
 , m_find_id(sql, fmt::format("SELECT name FROM {0} WHERE id=?1", tablename))
 {
+    load(sql, tablename);
+}
+
+void StringIntMapCache::load(SQLite::Database& sql, const std::string& tablename)
+{
+    m_map.clear();
+
     // prepare the query statement
     SQLite::Statement query(sql, fmt::format("SELECT * FROM {0}", tablename));
 
@@ -61,6 +68,11 @@ StringIntMapCache::StringIntMapCache(SQLite::Database& sql, const std::string& t
     }
 }
 
+void StringIntMapCache::unload()
+{
+    m_map.clear();
+}
+
 /// map() is currently not threadsafe. Add locks if you will access it from multiple threads!
 
 int64_t StringIntMapCache::map(SQLite::Database& sql, const std::string& str)
@@ -28,9 +28,22 @@
 #include "cddbexception.hpp"
 #include "untar.hpp"
 #include "diskrecord.hpp"
+#include "blockingqueue.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <chrono>
 #include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <thread>
+#include <future>
+#include <cstring>
+#include <atomic>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
 #include "format.hpp"
 #include "utf8.hpp"
 
@@ -56,6 +69,11 @@ SchemaInit::SchemaInit(const std::string& dbname)
         sql.exec("CREATE INDEX discid_id_idx ON DISCID (discid)");
         sql.exec("CREATE INDEX fuzzyid_id_idx ON FUZZYID (fuzzyid)");
     }
+
+    if (!sql.tableExists("IMPORTSTATE")) {
+        // the last checkpoint of a running import
+        sql.exec("CREATE TABLE IMPORTSTATE (key TEXT PRIMARY KEY, value)");
+    }
 }
 
 
@@ -66,9 +84,6 @@ CDDBSQLUpdater::CDDBSQLUpdater(const std::string& dbname)
 , qcd       (m_sql, "INSERT INTO CD (artist, title, genre, year, seconds, revision, tracks) VALUES (?1,?2,?3,?4,?5,?6,?7)")
 , qupdatecd (m_sql, "UPDATE CD SET artist=?2, title=?3, genre=?4, year=?5, seconds=?6, revision=?7, tracks=?8 WHERE cd=?1")
 , qcd2      (m_sql, "SELECT cd, artist, title, genre, year, seconds, revision FROM CD WHERE cd=?1")
-, qtracks   (m_sql, "INSERT INTO TRACKS (cd, track, song, frames) VALUES (?1,?2,?3,?4)")
-, qdiscid   (m_sql, "INSERT INTO DISCID (discid, cd) VALUES (?1,?2)")
-, qfdiscid  (m_sql, "INSERT INTO FUZZYID (fuzzyid, cd) VALUES (?1,?2)")
 , qscrc     (m_sql, "SELECT cd FROM NAMEHASH WHERE hash=?1")
 , qdhash    (m_sql, "SELECT cd FROM DISCID WHERE discid=?1")
 , qicrc     (m_sql, "INSERT INTO NAMEHASH (hash, cd) VALUES (?1,?2)")
@@ -80,19 +95,122 @@ CDDBSQLUpdater::CDDBSQLUpdater(const std::string& dbname)
 , qdeltracks(m_sql, "DELETE FROM TRACKS WHERE cd=?1")
 , qdelhash  (m_sql, "DELETE FROM NAMEHASH WHERE hash=?1")
 , qerror    (m_sql, "INSERT INTO ERRORS (reason, extended, file) VALUES (?1,?2,?3)")
+, qsavestate(m_sql, "INSERT OR REPLACE INTO IMPORTSTATE (key, value) VALUES (?1,?2)")
+, m_tracks  (m_sql, "TRACKS", "cd, track, song, frames")
+, m_discids (m_sql, "DISCID", "discid, cd")
+, m_fuzzyids(m_sql, "FUZZYID", "fuzzyid, cd")
+, m_profile(m_sql)
 {
 }
 
-void CDDBSQLUpdater::error(const std::string& error, const std::string& exterror, UnTar::buf_t& data)
+void CDDBSQLUpdater::error(const std::string& error, const std::string& exterror, const StringView& data)
 {
-    data.push_back(0);
     qerror.bind(1, error);
     qerror.bind(2, exterror);
-    qerror.bind(3, &data[0]);
+    qerror.bind(3, data.to_string());
     qerror.exec();
     qerror.reset();
 }
 
+const std::pair<const char*, uint64_t CDDBSQLUpdater::report_t::*> CDDBSQLUpdater::report_t::counters[] = {
+    { "rct", &report_t::rct },
+    { "lct", &report_t::lct },
+    { "dcrcct", &report_t::dcrcct },
+    { "frct", &report_t::frct },
+    { "bct", &report_t::bct },
+    { "realcddidcollct", &report_t::realcddidcollct },
+    { "samecdframesct", &report_t::samecdframesct },
+    { "realdidcollct", &report_t::realdidcollct },
+    { "sameframesct", &report_t::sameframesct },
+    { "entropy_gt", &report_t::entropy_gt },
+    { "entropy_eq", &report_t::entropy_eq },
+    { "entropy_lt", &report_t::entropy_lt },
+    { "duplicate", &report_t::duplicate },
+    { "duplicate_lower", &report_t::duplicate_lower },
+    { "upper_count_gt", &report_t::upper_count_gt },
+    { "upper_count_eqlt", &report_t::upper_count_eqlt },
+    { "overall_count_gt", &report_t::overall_count_gt },
+    { "overall_count_eqlt", &report_t::overall_count_eqlt },
+    { "added", &report_t::added },
+    { "updated", &report_t::updated }
+};
+
+void CDDBSQLUpdater::save_state(const char* key, const std::string& value)
+{
+    qsavestate.bind(1, key);
+    qsavestate.bind(2, value);
+    qsavestate.exec();
+    qsavestate.reset();
+}
+
+void CDDBSQLUpdater::save_state(const char* key, int64_t value)
+{
+    qsavestate.bind(1, key);
+    qsavestate.bind(2, value);
+    qsavestate.exec();
+    qsavestate.reset();
+}
+
+void CDDBSQLUpdater::save_checkpoint(const std::string& importfile, int64_t filesize, const UnTar& tar)
+{
+    save_state("file", importfile);
+    save_state("filesize", filesize);
+    save_state("offset", int64_t(tar.offset()));
+    save_state("entries", int64_t(tar.entries()));
+    for (const auto& counter : report_t::counters) save_state(counter.first, int64_t(m_rep.*counter.second));
+}
+
+bool CDDBSQLUpdater::load_state(const std::string& importfile, int64_t filesize, UnTar& tar, bool& complete)
+{
+    std::string file;
+    std::unordered_map<std::string, int64_t> values;
+
+    SQLite::Statement query(m_sql, "SELECT key, value FROM IMPORTSTATE");
+    while (query.executeStep()) {
+        std::string key = query.getColumn(0).getText();
+        if (key == "file") file = query.getColumn(1).getText();
+        else values[key] = query.getColumn(1).getInt64();
+    }
+
+    if (file.empty()) return false;
+
+    complete = values.count("complete") != 0;
+
+    if (file != importfile || values["filesize"] != filesize) {
+        // a finished import of another file leaves nothing to resume
+        if (complete) return false;
+        throw CDDBException(fmt::format("cannot resume, the last checkpoint is from importing {0}", file));
+    }
+
+    if (complete) return true;
+
+    for (const auto& counter : report_t::counters) m_rep.*counter.second = values[counter.first];
+
+    tar.skip(values["offset"], values["entries"]);
+
+    return true;
+}
+
+void CDDBSQLUpdater::check_interrupted()
+{
+    // importing on top of the records of an interrupted import would link them twice
+    if (m_sql.execAndGet("SELECT count(*) FROM IMPORTSTATE WHERE key='offset'").getInt64()) {
+        throw CDDBException("the database contains an interrupted import, use --resume to continue it or --restart to start over");
+    }
+}
+
+void CDDBSQLUpdater::restart()
+{
+    // the ids of an empty table start again at 1, so the next import
+    // writes the same database as one into a new file
+    m_sql.exec("BEGIN TRANSACTION");
+    for (const char* table : { "CD", "TRACKS", "DISCID", "FUZZYID", "NAMEHASH", "GENRE", "ERRORS", "IMPORTSTATE" }) {
+        m_sql.exec(fmt::format("DELETE FROM {0}", table));
+    }
+    m_sql.exec("COMMIT TRANSACTION");
+    m_genres.load(m_sql, "GENRE");
+}
+
 uint32_t CDDBSQLUpdater::check_title_hash(uint32_t hash)
 {
     // check if we know that CD already by its CRC across title/tracks (as opposed to the discid)
@@ -139,13 +257,7 @@ uint32_t CDDBSQLUpdater::write_record(const DiskRecord& rec, bool check_hash)
     // now write all the songs of a disc
     int tct = 0;
     for (const auto& song : rec.songs()) {
-        qtracks.bind(1, int64_t(cdid));
-        qtracks.bind(2, tct);
-        qtracks.bind(3, song);
-        if (rec.frames().empty()) qtracks.bind(4, 0);
-        else qtracks.bind(4, int64_t(rec.frames()[tct]));
-        qtracks.exec();
-        qtracks.reset();
+        m_tracks.add(int64_t(cdid), tct, song, rec.frames().empty() ? 0 : int64_t(rec.frames()[tct]));
         ++tct;
     }
 
@@ -156,6 +268,8 @@ uint32_t CDDBSQLUpdater::write_record(const DiskRecord& rec, bool check_hash)
 
 void CDDBSQLUpdater::update_record(uint32_t cdid, const DiskRecord& rec)
 {
+    m_tracks.flush();
+
     // convert the genre string to an int
     int64_t genre = m_genres.map(m_sql, rec.genre());
 
@@ -198,27 +312,41 @@ uint32_t CDDBSQLUpdater::check_discid(uint32_t discid)
     }
     qdhash.reset();
 
+    // links in the table are older than the pending ones
+    if (!ecd) {
+        auto it = m_pending_discids.find(discid);
+        if (it != m_pending_discids.end()) ecd = it->second;
+    }
+
     return ecd;
 }
 
 void CDDBSQLUpdater::write_discid(uint32_t discid, uint32_t cdid)
 {
-    qdiscid.bind(1, int64_t(discid));
-    qdiscid.bind(2, int64_t(cdid));
-    qdiscid.exec();
-    qdiscid.reset();
+    bool written = m_discids.add(int64_t(discid), int64_t(cdid));
+    // emplace() keeps the first link of a discid
+    if (written) m_pending_discids.clear();
+    else m_pending_discids.emplace(discid, cdid);
 }
 
 void CDDBSQLUpdater::write_fuzzy_discid(uint32_t fuzzyid, uint32_t cdid)
 {
-    qfdiscid.bind(1, int64_t(fuzzyid));
-    qfdiscid.bind(2, int64_t(cdid));
-    qfdiscid.exec();
-    qfdiscid.reset();
+    m_fuzzyids.add(int64_t(fuzzyid), int64_t(cdid));
+}
+
+void CDDBSQLUpdater::flush_batches()
+{
+    CDDB_TRACE_SCOPE("flush batches");
+    m_tracks.flush();
+    m_discids.flush();
+    m_fuzzyids.flush();
+    m_pending_discids.clear();
 }
 
 void CDDBSQLUpdater::delete_record(uint32_t cdid, uint32_t hashvalue)
 {
+    m_tracks.flush();
+
     qdelcd.bind(1, int64_t(cdid));
     qdelcd.exec();
     qdelcd.reset();
@@ -234,6 +362,8 @@ void CDDBSQLUpdater::delete_record(uint32_t cdid, uint32_t hashvalue)
 
 DiskRecord CDDBSQLUpdater::read_record(uint32_t cdid, uint32_t discid)
 {
+    m_tracks.flush();
+
     qcd2.bind(1, int64_t(cdid));
 
     if (!qcd2.executeStep()) {
@@ -266,33 +396,312 @@ DiskRecord CDDBSQLUpdater::read_record(uint32_t cdid, uint32_t discid)
     return rec;
 }
 
-void CDDBSQLUpdater::import(const std::string& importfile, bool initial_import)
+CDDBSQLUpdater::collision_t CDDBSQLUpdater::resolve_collision(const DiskRecord& rec, const DiskRecord& existing_rec)
+{
+    // trouble - the discid is already known
+    //
+    // check if it is some sort of a collision
+    //  a. hash collision, where different frame lengths yield the same hash value
+    //  b. "real world" collision, where different CDs yield the same frame lengths
+    //      (in this case we can not do a lot to resolve it automatically)
+    //  c. actually same discid pointing to the same CD, which simply means that we
+    //      had undetected dupes in the original CDDB database
+    //
+    // Case a. concerns about one record in 2800 with FNV hash computation on frames
+    //      (which is really good, the original discid algorithm has a collision of
+    //      one record in 3 (which renders it unusable if it were not checking for
+    //      the frame lengths after fetching all the duplicate CDID records).
+    // Case b. concerns about one in 146 records, in which the user needs to pick
+    //      the right disc.
+    // Case c. is the most frequent one (about one in 23 records). In most cases,
+    // those are duplicates due to improved text content (like accents in titles, etc.)
+    //
+    // For case c. we should then check if the new version is preferrable over the existing
+    // version (higher revision, or if equal revision higher entropy value), and update if it is.
+
+    // for now - we check later down if we still want to write it
+    collision_t result;
+
+    // now check if this really is a collision, that is, the
+    // track sequences of the existing cd are different
+
+    bool same_frames = existing_rec.seconds() == rec.seconds() && existing_rec.frames() == rec.frames();
+
+    // now check if this is actually the same CD (by comparing the disc artist and title)
+    bool same_title = (existing_rec.compare_normalized_artist_title(rec) >= 25
+                 || existing_rec.compare_normalized_artist(rec) >= 25
+                 || existing_rec.compare_normalized_title(rec) >= 25);
+
+    if (!same_frames) {
+
+        // write the discid link to the CD. It is a collision, the user will have to pick the right choice.
+        result.link = true;
+
+        if (same_title) {
+            ++m_rep.realcddidcollct;
+            result.reason = "SAMECDDID";
+        } else {
+            ++m_rep.realdidcollct;
+            result.reason = "SAMEDID";
+        }
+
+    } else {
+
+        // same frames ->
+
+        std::string add_reason;
+
+        if (same_title) {
+
+            bool update_with_this = false;
+
+            ++m_rep.samecdframesct;
+            add_reason += "_REQ";
+
+            // now compare entropy - higher entropy is an indicator for more information and more
+            // accurate code points (think of accented chars vs. ASCII)
+            
+            if (rec.entropy() > existing_rec.entropy()) {
+
+                ++m_rep.entropy_gt;
+                add_reason += "_EGT";
+                // update the existing record with this one, and remove the record if we had written one
+                update_with_this = true;
+
+            }
+            else if (rec.entropy() == existing_rec.entropy()) {
+
+                // now check if the strings are EXACTLY the same
+                if (rec.equal_strings(existing_rec)) {
+
+                    ++m_rep.duplicate;
+                    add_reason += "_DUP";
+                    // skip this, and remove the record if we had written one (not very probable)
+
+                } else if (rec.equal_lowercase_strings(existing_rec)) {
+
+                    ++m_rep.duplicate_lower;
+                    add_reason += "_DLP";
+
+                    // check which of the strings contains more uppercase characters (which, if they
+                    // are not all uppercase, is normally an indication of a more accurate record)
+
+                    if (rec.charcount_upper() > existing_rec.charcount_upper()) {
+                        ++m_rep.upper_count_gt;
+                        // update the existing record with this one, and remove the record if we had written one
+                        update_with_this = true;
+                    } else {
+                        ++m_rep.upper_count_eqlt;
+                    }
+
+                } else {
+
+                    // now check which one contains more characters (which we take as an indication
+                    // of more complete information)
+                    
+                    if (rec.charcount() > existing_rec.charcount()) {
+                        ++m_rep.overall_count_gt;
+                        // update the existing record with this one, and remove the record if we had written one
+                        update_with_this = true;
+                    } else {
+                        ++m_rep.overall_count_eqlt;
+                    }
+
+                    ++m_rep.entropy_eq;
+                    add_reason += "_EEQ";
+
+                }
+
+            }
+            else {
+
+                ++m_rep.entropy_lt;
+                add_reason += "_ELT";
+                // skip this, and remove the record if we had written one (not very probable)
+
+            }
+
+            result.remove = true;
+            result.update = update_with_this;
+            // these are duplicate CD titles (well, they vary slightly, but mean the same CD)
+            result.reason = "SAMECDFRAMES" + add_reason;
+
+        } else {
+            ++m_rep.sameframesct;
+            // these are really same frames, but not same CDs
+            result.reason = "SAMEFRAMES";
+        }
+        
+    }
+
+    return result;
+}
+
+bool CDDBSQLUpdater::resolve_discid(const DiskRecord& rec, uint32_t cdid, uint32_t ecd, bool record_written, uint32_t hash, const StringView& data)
+{
+    DiskRecord existing_rec = read_record(ecd, rec.discid());
+
+    collision_t result = resolve_collision(rec, existing_rec);
+
+    // remove the record if we had written one, and update the existing record with it
+    if (result.remove && record_written) delete_record(cdid, hash);
+    if (result.update) update_record(ecd, rec);
+
+    if (m_debug) {
+        std::string exterr = fmt::format("discid {0}, cd {1}, {2} / {3} - {4} / {5}",
+                                         rec.discid(), ecd, rec.artist(), rec.title(),
+                                         existing_rec.artist(), existing_rec.title());
+        error(result.reason, exterr, data);
+    }
+
+    return result.link;
+}
+
+void CDDBSQLUpdater::add_record(const DiskRecord& rec, const StringView& data)
+{
+    ++m_rep.rct;
+    m_rep.bct += data.size();
+
+    // check if the record contains plausible data
+    if (!rec.valid()) {
+
+        if (m_debug) {
+            std::string exterr = rec.artist() + " / " + rec.title();
+            error("INVALID", exterr, data);
+        }
+
+        ++m_rep.frct;
+        return;
+    }
+
+    bool record_written = false;
+
+    CDDB_TRACE_BEGIN(hash, "title hash");
+    uint32_t cdid = check_title_hash(rec.normalized_hash());
+    CDDB_TRACE_END(hash);
+
+    if (!cdid) {
+
+        // this is a new record, write it
+        CDDB_TRACE_SCOPE("write record");
+        cdid = write_record(rec, false);
+        record_written = true;
+
+    } else {
+
+        ++m_rep.dcrcct;
+
+        if (m_debug) {
+            // this CD CRC is already known. For debug purposes, let's store them
+            // to find out if they are legitimately so, or CRC collisions
+            // (investigations showed they are legitimate dupes, but with differing discids due to
+            // slightly different track offsets..)
+            std::string exterr = fmt::format("hash duplicate: {0}", rec.normalized_hash());
+            error("HASHDUP", exterr, data);
+        }
+
+        // on purpose, fall through to writing the discid links -
+        // all needed data is valid: the cdid, and the rec.discid() is actually a new
+        // valid discid for that already known cdid
+        
+    }
+    
+    // now write the discid link(s)
+    {
+
+        CDDB_TRACE_SCOPE("discid links");
+
+        uint32_t ecd = check_discid(rec.discid());
+
+        bool discid_valid = !ecd || resolve_discid(rec, cdid, ecd, record_written, rec.normalized_hash(), data);
+
+        if (discid_valid) {
+            write_discid(rec.discid(), cdid);
+            write_fuzzy_discid(rec.fuzzy_discid(), cdid);
+        }
+    }
+}
+
+void CDDBSQLUpdater::import(const std::string& importfile, bool initial_import, bool resume)
 {
     m_rep.clear();
     
     Duration duration;
 
-    // construct an untar object and tell it to use bz2 when the file has the
-    // .bz2 suffix (it should always have..)
-    UnTar tar(importfile, (importfile.rfind(".bz2") == importfile.length() - 4));
+    // construct an untar object, it detects by itself if the archive is compressed,
+    // and with which algorithm
+    UnTar tar(importfile);
+
+    // the file size tells on a resume if the checkpoint belongs to this file
+    int64_t filesize = -1;
+    struct stat st;
+    if (importfile != "-" && ::stat(importfile.c_str(), &st) == 0) filesize = st.st_size;
 
     m_sql.exec("PRAGMA synchronous=OFF");
     m_sql.exec("PRAGMA count_changes=OFF");
-    m_sql.exec("PRAGMA journal_mode=MEMORY");
+    // a checkpoint is only worth something if the journal survives a crash of
+    // the process - an in-memory journal would leave a half written database
+    if (m_checkpoint_interval) m_sql.exec("PRAGMA journal_mode=DELETE");
+    else m_sql.exec("PRAGMA journal_mode=MEMORY");
     m_sql.exec("PRAGMA temp_store=MEMORY");
 
+    if (resume) {
+        bool complete = false;
+        if (load_state(importfile, filesize, tar, complete)) {
+            if (complete) {
+                std::cout << fmt::format("import of {0} is already complete", importfile) << std::endl;
+                return;
+            }
+            duration.lap();
+            std::cout << fmt::format("{0} - resumed import after {1} records",
+                                     duration.to_string(Duration::Precision::Seconds),
+                                     m_rep.rct)
+            << std::endl;
+        } else {
+            std::cout << "no checkpoint found, importing from the start" << std::endl;
+        }
+    } else {
+        check_interrupted();
+    }
+
+    uint64_t resumed = m_rep.rct;
+    uint64_t checkpoint = resumed;
+
     m_sql.exec("BEGIN TRANSACTION");
 
+    if (!resume) m_sql.exec("DELETE FROM IMPORTSTATE");
+
     if (initial_import) {
-        m_sql.exec("DROP INDEX fuzzyid_id_idx");
+        // already dropped if this is a resumed import
+        m_sql.exec("DROP INDEX IF EXISTS fuzzyid_id_idx");
     }
 
-    UnTar::buf_t data;
+    // points into the mapped archive for uncompressed files
+    StringView data;
 
     // get file after file
-    while (tar.entry(data, TarHeader::File, true) != TarHeader::Unknown) {
+    while (true) {
+
+        if (m_checkpoint_interval && m_rep.rct > checkpoint && m_rep.rct % m_checkpoint_interval == 0) {
+            // all records up to here are complete, so persist them together with
+            // the position in the tar stream to restart from
+            CDDB_TRACE_SCOPE("checkpoint");
+            flush_batches();
+            save_checkpoint(importfile, filesize, tar);
+            m_sql.exec("COMMIT TRANSACTION");
+            m_sql.exec("BEGIN TRANSACTION");
+            checkpoint = m_rep.rct;
+        }
+
+        // decompressing and reading the tar entry
+        CDDB_TRACE_BEGIN(untar, "untar");
+        auto type = tar.entry(data, TarHeader::File, true);
+        CDDB_TRACE_END(untar);
+
+        if (type == TarHeader::Unknown) break;
 
         if (m_rep.rct && m_rep.rct % 100000 == 0) {
+            m_profile.sample("import");
             duration.lap();
             std::cout << fmt::format("{0} - records read: {1}, rps: {2}",
                                      duration.to_string(Duration::Precision::Seconds),
@@ -301,241 +710,876 @@ void CDDBSQLUpdater::import(const std::string& importfile, bool initial_import)
             << std::endl;
         }
 
-        ++m_rep.rct;
-        m_rep.bct += data.size();
-
         // following here is handling of normal files
 
         // construct DiskRecord from the data
+        CDDB_TRACE_BEGIN(parse, "parse");
         DiskRecord rec(data);
+        CDDB_TRACE_END(parse);
 
-        // check if the record contains plausible data
-        if (!rec.valid()) {
-
-            if (m_debug) {
-                std::string exterr = rec.artist() + " / " + rec.title();
-                error("INVALID", exterr, data);
-            }
+        CDDB_TRACE_SCOPE("add record");
+        add_record(rec, data);
+    }
 
-            ++m_rep.frct;
-            continue;
-        }
+    flush_batches();
 
-        bool record_written = false;
+    duration.lap();
+    std::cout << fmt::format("{0} - records read: {1}, rps: {2}",
+                             duration.to_string(Duration::Precision::Seconds),
+                             m_rep.rct,
+                             ((m_rep.rct - resumed)*1000) / (duration.get(Duration::Precision::Milliseconds)))
+        << std::endl;
 
-        uint32_t cdid = check_title_hash(rec.normalized_hash());
+    std::cout << m_rep.to_string();
+    for (const auto* inserter : { &m_tracks, &m_discids, &m_fuzzyids }) std::cout << inserter->to_string() << std::endl;
+    m_profile.sample("import");
+    std::cout << m_profile.report();
 
-        if (!cdid) {
+    if (initial_import) {
+        CDDB_TRACE_SCOPE("create index");
+        Duration idxduration;
+        m_sql.exec("CREATE INDEX fuzzyid_id_idx ON FUZZYID (fuzzyid)");
+        idxduration.lap();
+        std::cout << fmt::format("index creation took {0}", idxduration.to_string(Duration::Precision::Milliseconds)) << std::endl;
+    }
 
-            // this is a new record, write it
-            cdid = write_record(rec, false);
-            record_written = true;
+    // the import is complete, only remember that for a late --resume
+    m_sql.exec("DELETE FROM IMPORTSTATE");
+    save_state("file", importfile);
+    save_state("filesize", filesize);
+    save_state("complete", 1);
 
-        } else {
+    m_sql.exec("COMMIT TRANSACTION");
 
-            ++m_rep.dcrcct;
+    duration.lap();
 
-            if (m_debug) {
-                // this CD CRC is already known. For debug purposes, let's store them
-                // to find out if they are legitimately so, or CRC collisions
-                // (investigations showed they are legitimate dupes, but with differing discids due to
-                // slightly different track offsets..)
-                std::string exterr = fmt::format("hash duplicate: {0}", rec.normalized_hash());
-                error("HASHDUP", exterr, data);
-            }
+    std::cout << fmt::format("total time used: {0}", duration.to_string(Duration::Precision::Milliseconds)) << std::endl;
+}
 
-            // on purpose, fall through to writing the discid links -
-            // all needed data is valid: the cdid, and the rec.discid() is actually a new
-            // valid discid for that already known cdid
-            
+CDDBSQLUpdater::batch_t CDDBSQLUpdater::parse_batch(batch_t batch)
+{
+    // parsing is the expensive part, do it together with everything
+    // that is computed lazily from the parsed record
+    CDDB_TRACE_SCOPE("parse batch");
+    for (auto& record : batch) {
+        record.rec = std::make_unique<DiskRecord>(record.data);
+        if (record.rec->valid()) {
+            record.rec->normalized_hash();
+            record.rec->discid();
+            record.rec->fuzzy_discid();
         }
-        
-        // now write the discid link(s)
-        {
-
-            bool discid_valid = true;
-
-            uint32_t ecd = check_discid(rec.discid());
-
-            if (ecd) {
-
-                // trouble - the discid is already known
-                //
-                // check if it is some sort of a collision
-                //  a. hash collision, where different frame lengths yield the same hash value
-                //  b. "real world" collision, where different CDs yield the same frame lengths
-                //      (in this case we can not do a lot to resolve it automatically)
-                //  c. actually same discid pointing to the same CD, which simply means that we
-                //      had undetected dupes in the original CDDB database
-                //
-                // Case a. concerns about one record in 2800 with FNV hash computation on frames
-                //      (which is really good, the original discid algorithm has a collision of
-                //      one record in 3 (which renders it unusable if it were not checking for
-                //      the frame lengths after fetching all the duplicate CDID records).
-                // Case b. concerns about one in 146 records, in which the user needs to pick
-                //      the right disc.
-                // Case c. is the most frequent one (about one in 23 records). In most cases,
-                // those are duplicates due to improved text content (like accents in titles, etc.)
-                //
-                // For case c. we should then check if the new version is preferrable over the existing
-                // version (higher revision, or if equal revision higher entropy value), and update if it is.
-
-                // for now - we check later down if we still want to write it
-                discid_valid  = false;
-
-                // now check if this really is a collision, that is, the
-                // track sequences of the existing cd are different
-
-                DiskRecord existing_rec = read_record(ecd, rec.discid());
-
-                bool same_frames = existing_rec.seconds() == rec.seconds() && existing_rec.frames() == rec.frames();
-
-                // now check if this is actually the same CD (by comparing the disc artist and title)
-                bool same_title = (DiskRecord::compare_normalized(existing_rec.artist() + existing_rec.title(), rec.artist() + rec.title()) >= 25
-                             || DiskRecord::compare_normalized(existing_rec.artist(), rec.artist()) >= 25
-                             || DiskRecord::compare_normalized(existing_rec.title(), rec.title()) >= 25);
-
-                if (!same_frames) {
-
-                    // write the discid link to the CD. It is a collision, the user will have to pick the right choice.
-                    discid_valid = true;
-
-                    if (same_title) ++m_rep.realcddidcollct;
-                    else ++m_rep.realdidcollct;
-
-                    if (m_debug) {
-                        std::string exterr = fmt::format("discid {0}, cd {1}, {2} / {3} - {4} / {5}",
-                                                         rec.discid(), ecd, rec.artist(), rec.title(),
-                                                         existing_rec.artist(), existing_rec.title());
-                        if (same_title) error("SAMECDDID", exterr, data);
-                        else error("SAMEDID", exterr, data);
-                    }
+    }
+    return batch;
+}
 
-                } else {
+std::vector<std::string> CDDBSQLUpdater::update_files(const std::vector<std::string>& paths)
+{
+    std::vector<std::string> files;
 
-                    // same frames ->
+    for (const auto& path : paths) {
 
-                    std::string add_reason;
+        struct stat st;
+        if (path == "-" || ::stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            files.push_back(path);
+            continue;
+        }
 
-                    if (same_title) {
+        DIR* dir = ::opendir(path.c_str());
+        if (!dir) throw CDDBException(fmt::format("cannot read directory {0}", path));
 
-                        bool update_with_this = false;
+        std::vector<std::string> entries;
+        while (struct dirent* entry = ::readdir(dir)) {
+            if (entry->d_name[0] == '.') continue;
+            std::string name = path + '/' + entry->d_name;
+            if (::stat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode)) entries.push_back(name);
+        }
+        ::closedir(dir);
 
-                        ++m_rep.samecdframesct;
-                        add_reason += "_REQ";
+        // the freedb update archives are named by their date range, so the
+        // name order is the chronological order
+        std::sort(entries.begin(), entries.end());
+        files.insert(files.end(), entries.begin(), entries.end());
+    }
 
-                        // now compare entropy - higher entropy is an indicator for more information and more
-                        // accurate code points (think of accented chars vs. ASCII)
-                        
-                        if (rec.entropy() > existing_rec.entropy()) {
+    return files;
+}
 
-                            ++m_rep.entropy_gt;
-                            add_reason += "_EGT";
-                            // update the existing record with this one, and remove the record if we had written one
-                            update_with_this = true;
+void CDDBSQLUpdater::update(const std::vector<std::string>& updatefiles, uint32_t threads, bool resume)
+{
+    Duration duration;
 
-                        }
-                        else if (rec.entropy() == existing_rec.entropy()) {
+    std::size_t first = 0;
 
-                            // now check if the strings are EXACTLY the same
-                            if (rec.equal_strings(existing_rec)) {
+    if (resume) {
+        std::string file;
+        bool complete = false;
+        SQLite::Statement query(m_sql, "SELECT key, value FROM IMPORTSTATE");
+        while (query.executeStep()) {
+            std::string key = query.getColumn(0).getText();
+            if (key == "file") file = query.getColumn(1).getText();
+            else if (key == "complete") complete = true;
+        }
+        auto it = std::find(updatefiles.begin(), updatefiles.end(), file);
+        if (!file.empty() && !complete) {
+            if (it == updatefiles.end()) {
+                throw CDDBException(fmt::format("cannot resume, the last checkpoint is from importing {0}", file));
+            }
+            throw CDDBException(fmt::format("cannot resume, first resume the interrupted update of {0} on its own", file));
+        }
+        if (it != updatefiles.end()) {
+            first = it - updatefiles.begin() + 1;
+            std::cout << fmt::format("skipping {0} archives that were already applied", first) << std::endl;
+        } else {
+            std::cout << "no checkpoint found, updating from the first archive" << std::endl;
+        }
+    } else {
+        check_interrupted();
+    }
 
-                                ++m_rep.duplicate;
-                                add_reason += "_DUP";
-                                // skip this, and remove the record if we had written one (not very probable)
+    m_sql.exec("PRAGMA synchronous=OFF");
+    m_sql.exec("PRAGMA count_changes=OFF");
+    if (m_checkpoint_interval) m_sql.exec("PRAGMA journal_mode=DELETE");
+    else m_sql.exec("PRAGMA journal_mode=MEMORY");
+    m_sql.exec("PRAGMA temp_store=MEMORY");
 
-                            } else if (rec.equal_lowercase_strings(existing_rec)) {
+    struct archive_t {
+        std::string file;
+        int64_t filesize = -1;
+        // bounds the read ahead of an archive that is not yet applied
+        BlockingQueue<batch_t> queue{64};
+        std::exception_ptr failed;
+    };
+
+    std::vector<std::unique_ptr<archive_t>> archives;
+
+    for (const auto& file : updatefiles) {
+        archives.push_back(std::make_unique<archive_t>());
+        archives.back()->file = file;
+        struct stat st;
+        if (file != "-" && ::stat(file.c_str(), &st) == 0) archives.back()->filesize = st.st_size;
+    }
 
-                                ++m_rep.duplicate_lower;
-                                add_reason += "_DLP";
+    const std::size_t batch_size = 256;
+
+    // the readers take the archives in order, so the one that is applied next
+    // is always being read
+    std::atomic<std::size_t> next(first);
+
+    auto read_archives = [&]{
+        for (std::size_t index = next++; index < archives.size(); index = next++) {
+            archive_t& archive = *archives[index];
+            try {
+                UnTar tar(archive.file);
+                batch_t batch;
+                StringView data;
+                int64_t seq = 0;
+                bool open = true;
+                while (open && tar.entry(data, TarHeader::File, true) != TarHeader::Unknown) {
+                    batch.push_back(parsed_t{seq++, std::vector<char>(data.begin(), data.end()), nullptr});
+                    if (batch.size() == batch_size) {
+                        open = archive.queue.push(parse_batch(std::move(batch)));
+                        batch = batch_t();
+                    }
+                }
+                if (open && !batch.empty()) archive.queue.push(parse_batch(std::move(batch)));
+            } catch (...) {
+                archive.failed = std::current_exception();
+            }
+            archive.queue.close();
+        }
+    };
 
-                                // check which of the strings contains more uppercase characters (which, if they
-                                // are not all uppercase, is normally an indication of a more accurate record)
+    std::vector<std::thread> readers;
+    for (uint32_t ct = 0; ct < std::max(threads, 1U); ++ct) readers.emplace_back(read_archives);
 
-                                if (rec.charcount_upper() > existing_rec.charcount_upper()) {
-                                    ++m_rep.upper_count_gt;
-                                    // update the existing record with this one, and remove the record if we had written one
-                                    update_with_this = true;
-                                } else {
-                                    ++m_rep.upper_count_eqlt;
-                                }
+    auto stop_readers = [&]{
+        for (auto& archive : archives) archive->queue.close();
+        for (auto& reader : readers) reader.join();
+        readers.clear();
+    };
 
-                            } else {
+    report_t total;
 
-                                // now check which one contains more characters (which we take as an indication
-                                // of more complete information)
-                                
-                                if (rec.charcount() > existing_rec.charcount()) {
-                                    ++m_rep.overall_count_gt;
-                                    // update the existing record with this one, and remove the record if we had written one
-                                    update_with_this = true;
-                                } else {
-                                    ++m_rep.overall_count_eqlt;
-                                }
+    try {
 
-                                ++m_rep.entropy_eq;
-                                add_reason += "_EEQ";
+        for (std::size_t index = first; index < archives.size(); ++index) {
 
-                            }
+            archive_t& archive = *archives[index];
 
-                        }
-                        else {
+            m_rep.clear();
+            Duration archiveduration;
 
-                            ++m_rep.entropy_lt;
-                            add_reason += "_ELT";
-                            // skip this, and remove the record if we had written one (not very probable)
+            m_sql.exec("BEGIN TRANSACTION");
+            m_sql.exec("DELETE FROM IMPORTSTATE");
 
-                        }
+            batch_t batch;
+            while (archive.queue.pop(batch)) {
+                for (const auto& record : batch) add_record(*record.rec, StringView(record.data.data(), record.data.size()));
+            }
 
-                        if (record_written) delete_record(cdid, rec.normalized_hash());
-                        if (update_with_this) update_record(ecd, rec);
+            if (archive.failed) std::rethrow_exception(archive.failed);
 
-                    } else {
-                        ++m_rep.sameframesct;
-                    }
+            flush_batches();
 
-                    if (m_debug) {
-                        std::string exterr = fmt::format("discid {0}, cd {1}, {2} / {3} - {4} / {5}",
-                                                         rec.discid(), ecd, rec.artist(), rec.title(),
-                                                         existing_rec.artist(), existing_rec.title());
-                        if (same_title) error(std::string("SAMECDFRAMES") + add_reason, exterr, data); // these are duplicate CD titles (well, they vary slightly, but mean the same CD)
-                        else error("SAMEFRAMES", exterr, data); // these are really same frames, but not same CDs
-                    }
-                    
-                }
+            // remember the archive for a --resume
+            save_state("file", archive.file);
+            save_state("filesize", archive.filesize);
+            save_state("complete", 1);
 
-            }
+            m_sql.exec("COMMIT TRANSACTION");
+            m_profile.sample("import");
 
-            if (discid_valid) {
-                write_discid(rec.discid(), cdid);
-                write_fuzzy_discid(rec.fuzzy_discid(), cdid);
-            }
+            archiveduration.lap();
+            duration.lap();
+            std::cout << fmt::format("{0} - {1}: {2} records in {3}, added {4} CDs, updated {5} CDs",
+                                     duration.to_string(Duration::Precision::Seconds),
+                                     archive.file,
+                                     m_rep.rct,
+                                     archiveduration.to_string(Duration::Precision::Milliseconds),
+                                     m_rep.added,
+                                     m_rep.updated)
+            << std::endl;
+
+            for (const auto& counter : report_t::counters) total.*counter.second += m_rep.*counter.second;
         }
+
+    } catch (...) {
+        stop_readers();
+        throw;
     }
 
+    stop_readers();
+
+    m_rep = total;
+
     duration.lap();
     std::cout << fmt::format("{0} - records read: {1}, rps: {2}",
                              duration.to_string(Duration::Precision::Seconds),
                              m_rep.rct,
-                             (m_rep.rct*1000) / (duration.get(Duration::Precision::Milliseconds)))
+                             (m_rep.rct*1000) / std::max<uint64_t>(1, duration.get(Duration::Precision::Milliseconds)))
         << std::endl;
 
     std::cout << m_rep.to_string();
+    for (const auto* inserter : { &m_tracks, &m_discids, &m_fuzzyids }) std::cout << inserter->to_string() << std::endl;
+    m_profile.sample("import");
+    std::cout << m_profile.report();
 
-    if (initial_import) {
-        Duration idxduration;
-        m_sql.exec("CREATE INDEX fuzzyid_id_idx ON FUZZYID (fuzzyid)");
-        idxduration.lap();
-        std::cout << fmt::format("index creation took {0}", idxduration.to_string(Duration::Precision::Milliseconds)) << std::endl;
+    std::cout << fmt::format("total time used: {0}", duration.to_string(Duration::Precision::Milliseconds)) << std::endl;
+}
+
+namespace {
+
+/// the columns of a staged record, in the order staged_record() reads them
+const char* staged_columns = "s.discid, s.genre, s.entropy, s.charcount, s.uppercount, d.artist, d.title, d.year, d.seconds, d.revision, d.songs, d.frames";
+
+/// the select over all stages of an import, which are attached as stage0, stage1, ..
+/// The select names the schema of a stage as {0}.
+std::string all_stages(uint32_t stages, const std::string& select)
+{
+    std::string query;
+    for (uint32_t ct = 0; ct < stages; ++ct) {
+        if (ct) query += " UNION ALL ";
+        query += fmt::format(select, ct);
+    }
+    return query;
+}
+
+void create_stage(const std::string& filename)
+{
+    // an attached database cannot be created, the main one was opened without
+    SQLite::Database sql(filename, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    // the values the resolution sorts by are kept apart from the strings, which keeps its sweeps short
+    sql.exec("CREATE TABLE STAGE (seq INTEGER PRIMARY KEY, discid INTEGER, fuzzyid INTEGER, hash INTEGER, entropy INTEGER, charcount INTEGER, uppercount INTEGER, genre TEXT)");
+    sql.exec("CREATE TABLE STAGEDATA (seq INTEGER PRIMARY KEY, artist TEXT, title TEXT, year INTEGER, seconds INTEGER, revision INTEGER, songs BLOB, frames BLOB)");
+}
+
+/// the complete string of a column, which may contain zero bytes
+std::string column_string(const SQLite::Column& column)
+{
+    const char* data = static_cast<const char*>(column.getBlob());
+    return data ? std::string(data, column.getBytes()) : std::string();
+}
+
+/// the songs of a record are staged in one blob, each with its size in front
+std::string pack_songs(const DiskRecord::list_t& songs)
+{
+    std::string blob;
+    for (const auto& song : songs) {
+        uint32_t size = static_cast<uint32_t>(song.size());
+        blob.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        blob += song;
+    }
+    return blob;
+}
+
+/// writes the valid records of an import into a stage, the sequence numbers
+/// follow the order of the import file
+class Stager {
+public:
+    Stager(SQLite::Database& sql, const std::string& schema)
+    : qstage(sql, fmt::format("INSERT INTO {0}.STAGE (seq, discid, fuzzyid, hash, entropy, charcount, uppercount, genre) VALUES (?1,?2,?3,?4,?5,?6,?7,?8)", schema))
+    , qstagedata(sql, fmt::format("INSERT INTO {0}.STAGEDATA (seq, artist, title, year, seconds, revision, songs, frames) VALUES (?1,?2,?3,?4,?5,?6,?7,?8)", schema))
+    {
+    }
+
+    void add(uint32_t seq, const DiskRecord& rec)
+    {
+        std::string songs = pack_songs(rec.songs());
+
+        qstage.bind(1, int64_t(seq));
+        qstage.bind(2, int64_t(rec.discid()));
+        qstage.bind(3, int64_t(rec.fuzzy_discid()));
+        qstage.bind(4, int64_t(rec.normalized_hash()));
+        qstage.bind(5, int64_t(rec.entropy()));
+        qstage.bind(6, int64_t(rec.charcount()));
+        qstage.bind(7, int64_t(rec.charcount_upper()));
+        qstage.bind(8, rec.genre());
+        qstage.exec();
+        qstage.reset();
+
+        qstagedata.bind(1, int64_t(seq));
+        qstagedata.bind(2, rec.artist());
+        qstagedata.bind(3, rec.title());
+        qstagedata.bind(4, rec.year());
+        qstagedata.bind(5, int64_t(rec.seconds()));
+        qstagedata.bind(6, rec.revision());
+        qstagedata.bind(7, songs.data(), static_cast<int>(songs.size()));
+        qstagedata.bind(8, rec.frames().data(), static_cast<int>(rec.frames().size() * sizeof(uint32_t)));
+        qstagedata.exec();
+        qstagedata.reset();
+    }
+
+private:
+    SQLite::Statement qstage;
+    SQLite::Statement qstagedata;
+};
+
+DiskRecord::list_t unpack_songs(const SQLite::Column& column)
+{
+    DiskRecord::list_t songs;
+    const char* p = static_cast<const char*>(column.getBlob());
+    const char* end = p + column.getBytes();
+    while (end - p >= static_cast<std::ptrdiff_t>(sizeof(uint32_t))) {
+        uint32_t size;
+        std::memcpy(&size, p, sizeof(size));
+        p += sizeof(size);
+        songs.emplace_back(p, size);
+        p += size;
+    }
+    return songs;
+}
+
+DiskRecord::frame_t unpack_frames(const SQLite::Column& column)
+{
+    DiskRecord::frame_t frames(column.getBytes() / sizeof(uint32_t));
+    if (!frames.empty()) std::memcpy(frames.data(), column.getBlob(), frames.size() * sizeof(uint32_t));
+    return frames;
+}
+
+/// a staged record as it was parsed, from a row of staged_columns
+DiskRecord staged_record(SQLite::Statement& query)
+{
+    DiskRecord rec(static_cast<uint32_t>(query.getColumn(0).getInt64()),
+                   column_string(query.getColumn(5)),
+                   column_string(query.getColumn(6)),
+                   static_cast<uint16_t>(query.getColumn(7).getInt()),
+                   column_string(query.getColumn(1)),
+                   unpack_songs(query.getColumn(10)),
+                   unpack_frames(query.getColumn(11)),
+                   static_cast<uint16_t>(query.getColumn(9).getInt()),
+                   static_cast<uint32_t>(query.getColumn(8).getInt64()));
+    rec.set_counts(query.getColumn(2).getInt64(), query.getColumn(3).getInt64(), query.getColumn(4).getInt64());
+    return rec;
+}
+
+/// the content of a CD as the database would hold it
+struct staged_cd_t {
+    std::string artist;
+    std::string title;
+    std::string genre;
+    uint16_t year;
+    uint16_t revision;
+    uint32_t seconds;
+    std::size_t tracks;
+    DiskRecord::list_t songs;
+    DiskRecord::frame_t frames;
+
+    /// as write_record() writes it
+    staged_cd_t(const DiskRecord& rec)
+    : artist(rec.artist())
+    , title(rec.title())
+    , genre(rec.genre())
+    , year(rec.year())
+    , revision(rec.revision())
+    , seconds(rec.seconds())
+    , tracks(rec.songs().size())
+    , songs(rec.songs())
+    , frames(rec.frames().empty() ? DiskRecord::frame_t(rec.songs().size(), 0) : rec.frames())
+    {
+    }
+
+    /// as update_record() changes it, which only updates the tracks the CD already has
+    void update(const DiskRecord& rec)
+    {
+        artist = rec.artist();
+        title = rec.title();
+        genre = rec.genre();
+        year = rec.year();
+        revision = rec.revision();
+        seconds = rec.seconds();
+        tracks = rec.songs().size();
+        for (std::size_t tct = 0; tct < songs.size() && tct < rec.songs().size(); ++tct) {
+            songs[tct] = rec.songs()[tct];
+            frames[tct] = rec.frames().empty() ? 0 : rec.frames()[tct];
+        }
+    }
+
+    /// as read_record() reads it back, the strings from the database end at a zero byte
+    DiskRecord record(uint32_t discid) const
+    {
+        DiskRecord::list_t stored;
+        for (const auto& song : songs) stored.emplace_back(song.c_str());
+        return DiskRecord(discid, artist.c_str(), title.c_str(), year, std::string(genre),
+                          std::move(stored), DiskRecord::frame_t(frames), revision, seconds);
+    }
+};
+
+}
+
+/// the state of a staged import while its records are resolved, the vectors
+/// are indexed by the sequence number of a record in the stage
+struct CDDBSQLUpdater::stage_t {
+    enum : uint32_t { none = 0xffffffff };
+    // the number of attached stages the records are spread over
+    uint32_t stages = 1;
+    // the first record with the same discid, for all later ones
+    std::vector<uint32_t> anchor;
+    // the group of records with the same normalized hash
+    std::vector<uint32_t> hashgroup;
+    // the CD of a record, and if its discid is linked to it
+    std::vector<uint32_t> cd;
+    std::vector<bool> linked;
+    // the record that wrote a CD, by cd id - 1
+    std::vector<uint32_t> creator;
+    // the content of the CDs that later records updated
+    std::unordered_map<uint32_t, staged_cd_t> updated;
+};
+
+void CDDBSQLUpdater::import_staged(const std::string& importfile, uint32_t threads)
+{
+    if (m_sql.execAndGet("SELECT count(*) FROM CD").getInt64()) {
+        throw CDDBException("a staged or parallel import needs an empty database");
     }
 
+    m_rep.clear();
+
+    Duration duration;
+
+    UnTar tar(importfile);
+
+    int64_t filesize = -1;
+    struct stat st;
+    if (importfile != "-" && ::stat(importfile.c_str(), &st) == 0) filesize = st.st_size;
+
+    stage_t stage;
+    // with more threads, every one writes its own stage, and all of them have to be attached at the same time
+    if (threads > 1) stage.stages = std::min(threads, static_cast<uint32_t>(sqlite3_limit(m_sql.getHandle(), SQLITE_LIMIT_ATTACHED, -1)));
+
+    // the stages live in their own files next to the database, and are deleted at the end
+    std::vector<std::string> names;
+    for (uint32_t ct = 0; ct < stage.stages; ++ct) {
+        names.push_back(fmt::format("{0}.stage{1}", m_sql.getFilename(), ct));
+        // left over from an aborted run
+        ::unlink(names.back().c_str());
+        create_stage(names.back());
+    }
+
+    auto remove_stages = [&names]{
+        for (const auto& name : names) ::unlink(name.c_str());
+    };
+
+    m_sql.exec("PRAGMA synchronous=OFF");
+    m_sql.exec("PRAGMA count_changes=OFF");
+    m_sql.exec("PRAGMA journal_mode=MEMORY");
+    m_sql.exec("PRAGMA temp_store=MEMORY");
+
+    for (uint32_t ct = 0; ct < stage.stages; ++ct) {
+        SQLite::Statement attach(m_sql, fmt::format("ATTACH DATABASE ?1 AS stage{0}", ct));
+        attach.bind(1, names[ct]);
+        attach.exec();
+        m_sql.exec(fmt::format("PRAGMA stage{0}.synchronous=OFF", ct));
+        m_sql.exec(fmt::format("PRAGMA stage{0}.journal_mode=OFF", ct));
+    }
+
+    m_sql.exec("BEGIN TRANSACTION");
+    m_sql.exec("DELETE FROM IMPORTSTATE");
+    m_sql.exec("DROP INDEX IF EXISTS fuzzyid_id_idx");
+
+    try {
+
+        // the sequence numbers of the staged records are below
+        uint32_t records = (stage.stages > 1) ? stage_parallel(tar, duration, names, threads) : stage_records(tar, duration);
+
+        duration.lap();
+        std::cout << fmt::format("{0} - records read: {1}, rps: {2}",
+                                 duration.to_string(Duration::Precision::Seconds),
+                                 m_rep.rct,
+                                 (m_rep.rct*1000) / (duration.get(Duration::Precision::Milliseconds)))
+            << std::endl;
+
+        Duration phase;
+
+        resolve_stage(stage, records);
+        phase.lap();
+        std::cout << fmt::format("resolving {0} staged records took {1}", m_rep.rct - m_rep.frct, phase.print_lap()) << std::endl;
+
+        write_stage(stage);
+        phase.lap();
+        std::cout << fmt::format("writing the records took {0}", phase.print_lap()) << std::endl;
+
+    } catch (...) {
+        remove_stages();
+        throw;
+    }
+
+    std::cout << m_rep.to_string();
+    for (const auto* inserter : { &m_tracks, &m_discids, &m_fuzzyids }) std::cout << inserter->to_string() << std::endl;
+    m_profile.sample("import");
+    std::cout << m_profile.report();
+
+    Duration idxduration;
+    m_sql.exec("CREATE INDEX fuzzyid_id_idx ON FUZZYID (fuzzyid)");
+    idxduration.lap();
+    std::cout << fmt::format("index creation took {0}", idxduration.to_string(Duration::Precision::Milliseconds)) << std::endl;
+
+    // remember the complete import for a late --resume
+    save_state("file", importfile);
+    save_state("filesize", filesize);
+    save_state("complete", 1);
+
     m_sql.exec("COMMIT TRANSACTION");
+    for (uint32_t ct = 0; ct < stage.stages; ++ct) m_sql.exec(fmt::format("DETACH DATABASE stage{0}", ct));
+    remove_stages();
 
     duration.lap();
 
     std::cout << fmt::format("total time used: {0}", duration.to_string(Duration::Precision::Milliseconds)) << std::endl;
 }
 
+uint32_t CDDBSQLUpdater::stage_records(UnTar& tar, Duration& duration)
+{
+    Stager stager(m_sql, "stage0");
+
+    uint32_t staged = 0;
+    StringView data;
+
+    while (tar.entry(data, TarHeader::File, true) != TarHeader::Unknown) {
+
+        if (m_rep.rct && m_rep.rct % 100000 == 0) {
+            m_profile.sample("import");
+            duration.lap();
+            std::cout << fmt::format("{0} - records read: {1}, rps: {2}",
+                                     duration.to_string(Duration::Precision::Seconds),
+                                     m_rep.rct,
+                                     (100000*1000) / (duration.get_lap(Duration::Precision::Milliseconds)))
+            << std::endl;
+        }
+
+        DiskRecord rec(data);
+
+        ++m_rep.rct;
+        m_rep.bct += data.size();
+
+        if (!rec.valid()) {
+            if (m_debug) {
+                std::string exterr = rec.artist() + " / " + rec.title();
+                error("INVALID", exterr, data);
+            }
+            ++m_rep.frct;
+            continue;
+        }
+
+        stager.add(staged++, rec);
+    }
+
+    // before the statements of the stage are finalized
+    m_profile.sample("import");
+
+    return staged;
+}
+
+uint32_t CDDBSQLUpdater::stage_parallel(UnTar& tar, Duration& duration, const std::vector<std::string>& names, uint32_t threads)
+{
+    // A fixed set of parser threads takes the batches in any order, and hands them
+    // to one writer thread per stage, each with its own connection. The sequence
+    // number of a record is its position in the file, so the order in which the
+    // batches arrive does not matter, and the invalid ones leave gaps.
+    const std::size_t batch_size = 256;
+    BlockingQueue<batch_t> unparsed(2 * threads);
+    std::vector<std::unique_ptr<BlockingQueue<batch_t>>> queues;
+    std::vector<std::exception_ptr> failed(names.size() + threads);
+    std::vector<uint64_t> invalid(names.size());
+    std::mutex errors;
+    std::vector<std::thread> parsers;
+    std::vector<std::thread> writers;
+
+    for (std::size_t ct = 0; ct < names.size(); ++ct) queues.push_back(std::make_unique<BlockingQueue<batch_t>>(4));
+
+    for (std::size_t ct = 0; ct < names.size(); ++ct) {
+        writers.emplace_back([&, ct]{
+            batch_t batch;
+            try {
+                SQLite::Database sql(names[ct], SQLITE_OPEN_READWRITE);
+                sql.exec("PRAGMA synchronous=OFF");
+                sql.exec("PRAGMA journal_mode=OFF");
+                Stager stager(sql, "main");
+                sql.exec("BEGIN TRANSACTION");
+                while (queues[ct]->pop(batch)) {
+                    for (const auto& record : batch) {
+                        if (record.rec->valid()) {
+                            stager.add(static_cast<uint32_t>(record.seq), *record.rec);
+                            continue;
+                        }
+                        ++invalid[ct];
+                        if (m_debug) {
+                            std::string exterr = record.rec->artist() + " / " + record.rec->title();
+                            std::lock_guard<std::mutex> lock(errors);
+                            error("INVALID", exterr, StringView(record.data.data(), record.data.size()));
+                        }
+                    }
+                }
+                sql.exec("COMMIT TRANSACTION");
+            } catch (...) {
+                failed[ct] = std::current_exception();
+                // keep draining the queue, the parsers would block otherwise
+                while (queues[ct]->pop(batch)) {}
+            }
+        });
+    }
+
+    for (uint32_t ct = 0; ct < threads; ++ct) {
+        parsers.emplace_back([&, ct]{
+            batch_t batch;
+            try {
+                while (unparsed.pop(batch)) {
+                    // the stages get whole batches in turn
+                    std::size_t stage = (batch.front().seq / batch_size) % queues.size();
+                    queues[stage]->push(parse_batch(std::move(batch)));
+                }
+            } catch (...) {
+                failed[names.size() + ct] = std::current_exception();
+                while (unparsed.pop(batch)) {}
+            }
+        });
+    }
+
+    auto stop = [&]{
+        unparsed.close();
+        for (auto& parser : parsers) parser.join();
+        parsers.clear();
+        for (auto& queue : queues) queue->close();
+        for (auto& writer : writers) writer.join();
+        writers.clear();
+    };
+
+    int64_t seq = 0;
+
+    try {
+
+        batch_t batch;
+        StringView data;
+
+        while (tar.entry(data, TarHeader::File, true) != TarHeader::Unknown) {
+
+            if (seq && seq % 100000 == 0) {
+                duration.lap();
+                std::cout << fmt::format("{0} - records read: {1}, rps: {2}",
+                                         duration.to_string(Duration::Precision::Seconds),
+                                         seq,
+                                         (100000*1000) / (duration.get_lap(Duration::Precision::Milliseconds)))
+                << std::endl;
+            }
+
+            m_rep.bct += data.size();
+            batch.push_back(parsed_t{seq++, std::vector<char>(data.begin(), data.end()), nullptr});
+
+            if (batch.size() == batch_size) {
+                unparsed.push(std::move(batch));
+                batch = batch_t();
+            }
+        }
+
+        if (!batch.empty()) unparsed.push(std::move(batch));
+
+    } catch (...) {
+        stop();
+        throw;
+    }
+
+    stop();
+
+    for (const auto& exception : failed) {
+        if (exception) std::rethrow_exception(exception);
+    }
+
+    m_rep.rct = seq;
+    for (auto count : invalid) m_rep.frct += count;
+
+    return static_cast<uint32_t>(seq);
+}
+
+void CDDBSQLUpdater::resolve_stage(stage_t& stage, uint32_t records)
+{
+    stage.anchor.assign(records, stage_t::none);
+    stage.hashgroup.assign(records, 0);
+    stage.cd.assign(records, 0);
+    stage.linked.assign(records, false);
+
+    // sweep the records sorted by their normalized hash, and number the groups of
+    // records with the same hash - the first one of a group that survives owns the hash
+    uint32_t groups = 0;
+    {
+        SQLite::Statement query(m_sql, all_stages(stage.stages, "SELECT seq, hash FROM stage{0}.STAGE") + " ORDER BY hash, seq");
+        int64_t last = -1;
+        while (query.executeStep()) {
+            int64_t hash = query.getColumn(1).getInt64();
+            if (hash != last) ++groups;
+            last = hash;
+            stage.hashgroup[query.getColumn(0).getInt64()] = groups - 1;
+        }
+    }
+
+    // sweep them sorted by discid - the first record of a discid is always linked, and
+    // all later ones collide with the CD it was linked to
+    {
+        SQLite::Statement query(m_sql, all_stages(stage.stages, "SELECT seq, discid FROM stage{0}.STAGE") + " ORDER BY discid, seq");
+        int64_t last = -1;
+        uint32_t first = 0;
+        while (query.executeStep()) {
+            uint32_t seq = static_cast<uint32_t>(query.getColumn(0).getInt64());
+            int64_t discid = query.getColumn(1).getInt64();
+            if (discid != last) first = seq;
+            else stage.anchor[seq] = first;
+            last = discid;
+        }
+    }
+
+    // now replay the records in their original order, with the same rules as the
+    // sequential import. Only the colliding ones need their strings.
+
+    std::vector<uint32_t> owners(groups, 0);
+
+    SQLite::Statement qrecord(m_sql, all_stages(stage.stages, fmt::format("SELECT {0} FROM stage{{0}}.STAGE s JOIN stage{{0}}.STAGEDATA d ON d.seq = s.seq WHERE s.seq = ?1", staged_columns)));
+    SQLite::Statement query(m_sql, all_stages(stage.stages, "SELECT seq, genre FROM stage{0}.STAGE") + " ORDER BY seq");
+
+    auto read_staged = [&qrecord](uint32_t seq) {
+        qrecord.bind(1, int64_t(seq));
+        if (!qrecord.executeStep()) throw std::runtime_error("cannot read staged record");
+        DiskRecord rec = staged_record(qrecord);
+        qrecord.reset();
+        return rec;
+    };
+
+    while (query.executeStep()) {
+
+        uint32_t seq = static_cast<uint32_t>(query.getColumn(0).getInt64());
+        uint32_t& owner = owners[stage.hashgroup[seq]];
+        bool record_written = false;
+
+        if (owner) {
+            ++m_rep.dcrcct;
+        } else {
+            // a new record gets the next cd id, as it would in the database
+            stage.creator.push_back(seq);
+            owner = static_cast<uint32_t>(stage.creator.size());
+            m_genres.map(m_sql, column_string(query.getColumn(1)));
+            ++m_rep.added;
+            record_written = true;
+        }
+
+        stage.cd[seq] = owner;
+
+        if (stage.anchor[seq] == stage_t::none) {
+            stage.linked[seq] = true;
+            continue;
+        }
+
+        uint32_t ecd = stage.cd[stage.anchor[seq]];
+
+        DiskRecord rec = read_staged(seq);
+
+        auto it = stage.updated.find(ecd);
+        staged_cd_t existing = (it != stage.updated.end()) ? it->second : staged_cd_t(read_staged(stage.creator[ecd - 1]));
+
+        collision_t result = resolve_collision(rec, existing.record(rec.discid()));
+
+        if (result.remove && record_written) {
+            // the record was the last one written, so its id is free again
+            stage.creator.pop_back();
+            owner = 0;
+            --m_rep.added;
+        }
+
+        if (result.update) {
+            existing.update(rec);
+            if (it != stage.updated.end()) it->second = std::move(existing);
+            else stage.updated.emplace(ecd, std::move(existing));
+            m_genres.map(m_sql, rec.genre());
+            ++m_rep.updated;
+        }
+
+        stage.linked[seq] = result.link;
+    }
+}
+
+void CDDBSQLUpdater::write_stage(const stage_t& stage)
+{
+    // the stages are merged in the order of the sequence numbers
+    SQLite::Statement query(m_sql, all_stages(stage.stages, fmt::format("SELECT {0}, s.seq AS seq, s.fuzzyid, s.hash FROM stage{{0}}.STAGE s JOIN stage{{0}}.STAGEDATA d ON d.seq = s.seq", staged_columns)) + " ORDER BY seq");
+    SQLite::Statement qwritecd(m_sql, "INSERT INTO CD (cd, artist, title, genre, year, seconds, revision, tracks) VALUES (?1,?2,?3,?4,?5,?6,?7,?8)");
+
+    while (query.executeStep()) {
+
+        uint32_t seq = static_cast<uint32_t>(query.getColumn(12).getInt64());
+        uint32_t cdid = stage.cd[seq];
+
+        if (cdid <= stage.creator.size() && stage.creator[cdid - 1] == seq) {
+
+            // the record created a CD that survived, write it with its last content
+            auto it = stage.updated.find(cdid);
+            staged_cd_t cd = (it != stage.updated.end()) ? it->second : staged_cd_t(staged_record(query));
+
+            qwritecd.bind(1, int64_t(cdid));
+            qwritecd.bind(2, cd.artist);
+            qwritecd.bind(3, cd.title);
+            qwritecd.bind(4, m_genres.map(m_sql, cd.genre));
+            qwritecd.bind(5, cd.year);
+            qwritecd.bind(6, int64_t(cd.seconds));
+            qwritecd.bind(7, cd.revision);
+            qwritecd.bind(8, int64_t(cd.tracks));
+            qwritecd.exec();
+            qwritecd.reset();
+
+            qicrc.bind(1, query.getColumn(14).getInt64());
+            qicrc.bind(2, int64_t(cdid));
+            qicrc.exec();
+            qicrc.reset();
+
+            for (std::size_t tct = 0; tct < cd.songs.size(); ++tct) {
+                m_tracks.add(int64_t(cdid), int64_t(tct), cd.songs[tct], int64_t(cd.frames[tct]));
+            }
+        }
+
+        if (stage.linked[seq]) {
+            write_discid(static_cast<uint32_t>(query.getColumn(0).getInt64()), cdid);
+            write_fuzzy_discid(static_cast<uint32_t>(query.getColumn(13).getInt64()), cdid);
+        }
+    }
+
+    flush_batches();
+    m_profile.sample("import");
+}
+
 std::string CDDBSQLUpdater::report_t::to_string()
 {
     std::string report;
@@ -33,6 +33,11 @@
 #include "cddbdefines.hpp"
 #include "diskrecord.hpp"
 #include "untar.hpp"
+#include "batchinserter.hpp"
+#include "sqliteprofile.hpp"
+#include <unordered_map>
+#include <memory>
+#include <vector>
 
 
 
@@ -49,8 +54,30 @@ public:
     CDDBSQLUpdater(const std::string& dbname);
     ~CDDBSQLUpdater() {}
 
-    void import(const std::string& importfile, bool initial_import);
+    /// import or update from a (bzip2 compressed) tar file. With resume, an import
+    /// that was interrupted is continued at its last checkpoint.
+    void import(const std::string& importfile, bool initial_import, bool resume = false);
     void add_fuzzy_table();
+    /// initial import into an empty database in two phases: all records are staged
+    /// first, then sweeps over the stage sorted by hash and discid find the duplicates,
+    /// which are resolved like in import() before the result is written in one pass.
+    /// With more threads the records are parsed on them, and staged into one temporary
+    /// database per thread, which are written concurrently. There are no checkpoints.
+    void import_staged(const std::string& importfile, uint32_t threads = 1);
+    /// apply several update archives in the given order, so that newer revisions win.
+    /// Up to threads archives are decompressed and parsed ahead on worker threads
+    /// while the records of the current one are written. Every archive is committed
+    /// when it is complete, and with resume the completed archives are skipped.
+    void update(const std::vector<std::string>& updatefiles, uint32_t threads, bool resume = false);
+
+    /// expands directories in paths into the files they contain, sorted by name
+    static std::vector<std::string> update_files(const std::vector<std::string>& paths);
+
+    /// commit every records and save the position in the import file (0 = never).
+    /// Shorter intervals cost throughput, longer ones cost more work after a resume.
+    void set_checkpoint_interval(uint64_t records) { m_checkpoint_interval = records; }
+    /// empty all tables, to import again after an interrupted import that is not resumed
+    void restart();
 
 private:
     struct report_t {
@@ -93,8 +120,30 @@ private:
         // clear counters
         void clear() { std::memset(this, 0, sizeof(report_t)); }
         std::string to_string();
+        // names of the counters, to persist them in a checkpoint
+        static const std::pair<const char*, uint64_t report_t::*> counters[];
     };
 
+    /// the outcome of comparing a record with the existing CD of its discid
+    struct collision_t {
+        // link the discid to the CD of the record as well
+        bool link = false;
+        // the record is a duplicate, remove its CD if it wrote one
+        bool remove = false;
+        // and update the existing CD with it
+        bool update = false;
+        // for the error log
+        std::string reason;
+    };
+
+    // a record read from an archive, parsed on a worker thread
+    struct parsed_t {
+        int64_t seq;
+        std::vector<char> data;
+        std::unique_ptr<DiskRecord> rec;
+    };
+    typedef std::vector<parsed_t> batch_t;
+
     SchemaInit m_schema;
     SQLite::Database m_sql;
     StringIntMapCache m_genres;
@@ -103,9 +152,6 @@ private:
     SQLite::Statement qcd;
     SQLite::Statement qupdatecd;
     SQLite::Statement qcd2;
-    SQLite::Statement qtracks;
-    SQLite::Statement qdiscid;
-    SQLite::Statement qfdiscid;
     SQLite::Statement qscrc;
     SQLite::Statement qdhash;
     SQLite::Statement qicrc;
@@ -117,8 +163,19 @@ private:
     SQLite::Statement qdeltracks;
     SQLite::Statement qdelhash;
     SQLite::Statement qerror;
+    SQLite::Statement qsavestate;
+
+    // the tables with the most rows are written in batches
+    BatchInserter m_tracks;
+    BatchInserter m_discids;
+    BatchInserter m_fuzzyids;
+    // the first pending link of a discid, as check_discid() cannot see them in the table
+    std::unordered_map<uint32_t, uint32_t> m_pending_discids;
+    // statement counters and page cache hits for the report
+    SQLiteProfile m_profile;
 
     bool m_debug = false;
+    uint64_t m_checkpoint_interval = 100000;
 
     CDDBSQLUpdater(const CDDBSQLUpdater&) = delete;
     CDDBSQLUpdater& operator=(const CDDBSQLUpdater&) = delete;
@@ -128,10 +185,27 @@ private:
     uint32_t check_discid(uint32_t discid);
     void write_fuzzy_discid(uint32_t fuzzyid, uint32_t cdid);
     void write_discid(uint32_t discid, uint32_t cdid);
+    void flush_batches();
     DiskRecord read_record(uint32_t cdid, uint32_t discid);
     void update_record(uint32_t cdid, const DiskRecord& rec);
     void delete_record(uint32_t cdid, uint32_t hashvalue);
-    void error(const std::string& error, const std::string& exterror, UnTar::buf_t& data);
+    void error(const std::string& error, const std::string& exterror, const StringView& data);
+    collision_t resolve_collision(const DiskRecord& rec, const DiskRecord& existing_rec);
+    bool resolve_discid(const DiskRecord& rec, uint32_t cdid, uint32_t ecd, bool record_written, uint32_t hash, const StringView& data);
+    void add_record(const DiskRecord& rec, const StringView& data);
+    static batch_t parse_batch(batch_t batch);
+    struct stage_t;
+    /// both return the bound of the sequence numbers of the staged records
+    uint32_t stage_records(UnTar& tar, Duration& duration);
+    uint32_t stage_parallel(UnTar& tar, Duration& duration, const std::vector<std::string>& names, uint32_t threads);
+    void resolve_stage(stage_t& stage, uint32_t records);
+    void write_stage(const stage_t& stage);
+    void save_state(const char* key, const std::string& value);
+    void save_state(const char* key, int64_t value);
+    void save_checkpoint(const std::string& importfile, int64_t filesize, const UnTar& tar);
+    bool load_state(const std::string& importfile, int64_t filesize, UnTar& tar, bool& complete);
+    /// throws if an interrupted import left a checkpoint
+    void check_interrupted();
 };
 
 }
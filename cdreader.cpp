@@ -0,0 +1,82 @@
+//
+//  cdreader.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "cdreader.hpp"
+
+
+using namespace CDDB;
+
+
+CDReader::CDReader(SQLite::Database& sql)
+: m_qcd(sql,     "SELECT CD.cd, CD.artist, CD.title, CD.genre, CD.year, CD.seconds, CD.revision"
+                 " FROM DISCID,CD WHERE DISCID.discid=?1 AND CD.cd=DISCID.cd")
+, m_qtracks(sql, "SELECT song, frames FROM TRACKS WHERE cd=?1 ORDER BY track ASC")
+, m_genres(sql,  "GENRE")
+{
+}
+
+std::unique_ptr<DiskRecord> CDReader::read(uint32_t discid)
+{
+    std::unique_ptr<DiskRecord> rec;
+
+    m_qcd.bind(1, int64_t(discid));
+    try {
+        if (m_qcd.executeStep()) {
+
+            int32_t cd          = static_cast<uint32_t>(m_qcd.getColumn(0).getInt64());
+            std::string artist  = m_qcd.getColumn(1).getText();
+            std::string title   = m_qcd.getColumn(2).getText();
+            int32_t genre_id    = static_cast<uint32_t>(m_qcd.getColumn(3).getInt64());
+            int32_t year        = static_cast<uint32_t>(m_qcd.getColumn(4).getInt64());
+            int32_t seconds     = static_cast<uint32_t>(m_qcd.getColumn(5).getInt64());
+            int32_t revision    = static_cast<uint32_t>(m_qcd.getColumn(6).getInt64());
+            std::string genre   = m_genres.map(genre_id);
+
+            std::vector<std::string> songs;
+            std::vector<uint32_t> frames;
+
+            m_qtracks.bind(1, cd);
+            while (m_qtracks.executeStep()) {
+                songs.push_back(m_qtracks.getColumn(0).getText());
+                frames.push_back(static_cast<uint32_t>(m_qtracks.getColumn(1).getInt64()));
+            }
+            m_qtracks.reset();
+
+            rec = std::make_unique<DiskRecord>(discid, std::move(artist), std::move(title), year, std::move(genre),
+                                               std::move(songs), std::move(frames), revision, seconds);
+        }
+    } catch (...) {
+        // a failed statement (e.g. busy) has to be reset for its next run, reset()
+        // returns the error of the failed step again, but resets nevertheless
+        try { m_qtracks.reset(); } catch (...) {}
+        try { m_qcd.reset(); } catch (...) {}
+        throw;
+    }
+    m_qcd.reset();
+
+    return rec;
+}
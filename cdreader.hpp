@@ -0,0 +1,61 @@
+//
+//  cdreader.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef cdreader_hpp_PLOKIJUHYGTFRDESWAQPLOKIJUHYGTFRDES
+#define cdreader_hpp_PLOKIJUHYGTFRDESWAQPLOKIJUHYGTFRDES
+
+#include <cinttypes>
+#include <memory>
+#include <vector>
+#include "sqlitecpp/SQLiteCpp.h"
+#include "cddbstringintmap.hpp"
+#include "diskrecord.hpp"
+
+
+namespace CDDB {
+
+/// Reads the CD of a discid from the database, as the answer of a cddb read.
+/// Not thread safe, it uses the prepared statements of one connection.
+
+class CDReader {
+public:
+    CDReader(SQLite::Database& sql);
+
+    /// returns nullptr if there is no CD with discid
+    std::unique_ptr<DiskRecord> read(uint32_t discid);
+
+    std::vector<const SQLite::Statement*> statements() const { return { &m_qcd, &m_qtracks }; }
+
+private:
+    SQLite::Statement m_qcd;
+    SQLite::Statement m_qtracks;
+    StringIntMapCache m_genres;
+};
+
+}
+
+#endif /* cdreader_hpp */
@@ -0,0 +1,247 @@
+//
+//  decompressor.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "decompressor.hpp"
+#include "unbzip2.hpp"
+#include "ungzip.hpp"
+#include "unxz.hpp"
+#include "unzstd.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+
+class DecompressorException : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+
+InputFile::InputFile(const std::string& filename)
+: m_name(filename)
+, m_fd(-1)
+, m_lookahead_pos(0)
+, m_window(nullptr)
+, m_window_offset(0)
+, m_window_size(0)
+, m_size(0)
+, m_pos(0)
+{
+    if (!filename.empty() && filename != "-") m_fd = ::open(filename.c_str(), O_RDONLY);
+    else m_fd = STDIN_FILENO;
+    if (m_fd < 0) throw DecompressorException(filename + ": cannot open: " + strerror(errno));
+
+    // map regular files (also when redirected to stdin), if they are read from the start
+    struct stat st;
+    if (::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && ::lseek(m_fd, 0, SEEK_CUR) == 0) {
+        m_size = st.st_size;
+        size_t len = 1;
+        // if this fails, simply continue with read()
+        try { window(0, len); } catch (DecompressorException&) {}
+    }
+}
+
+InputFile::~InputFile()
+{
+    if (m_window) ::munmap(m_window, m_window_size);
+    if (m_fd >= 0 && m_fd != STDIN_FILENO) ::close(m_fd);
+}
+
+const char* InputFile::window(uint64_t offset, size_t& len)
+{
+    if (offset >= m_size) {
+        len = 0;
+        return nullptr;
+    }
+
+    len = static_cast<size_t>(std::min(static_cast<uint64_t>(len), m_size - offset));
+
+    if (!m_window || offset < m_window_offset || offset + len > m_window_offset + m_window_size) {
+
+        if (m_window) ::munmap(m_window, m_window_size);
+        m_window = nullptr;
+
+        // mmap() needs offsets aligned to the page size
+        static const uint64_t pagesize = ::sysconf(_SC_PAGESIZE);
+        m_window_offset = offset - offset % pagesize;
+        m_window_size = static_cast<size_t>(std::min(std::max(static_cast<uint64_t>(MapWindow), offset + len - m_window_offset),
+                                                     m_size - m_window_offset));
+
+        void* window = ::mmap(nullptr, m_window_size, PROT_READ, MAP_PRIVATE, m_fd, static_cast<off_t>(m_window_offset));
+        if (window == MAP_FAILED) throw DecompressorException(m_name + ": cannot map: " + strerror(errno));
+        m_window = static_cast<char*>(window);
+
+        // the kernel can read ahead more aggressively, and drop the pages behind us
+        ::madvise(m_window, m_window_size, MADV_SEQUENTIAL);
+    }
+
+    return m_window + (offset - m_window_offset);
+}
+
+size_t InputFile::map(const char*& data, size_t len)
+{
+    data = window(m_pos, len);
+    m_pos += len;
+    return len;
+}
+
+std::string InputFile::peek(size_t len)
+{
+    if (mapped()) {
+        const char* data = window(0, len);
+        return std::string(data, len);
+    }
+
+    while (m_lookahead.size() < len) {
+        char buf[16];
+        ssize_t rb = ::read(m_fd, buf, std::min(sizeof(buf), len - m_lookahead.size()));
+        if (rb < 0) throw DecompressorException(m_name + ": read error: " + strerror(errno));
+        if (!rb) break;
+        m_lookahead.insert(m_lookahead.end(), buf, buf + rb);
+    }
+    return std::string(m_lookahead.begin(), m_lookahead.begin() + std::min(len, m_lookahead.size()));
+}
+
+ssize_t InputFile::read(void* buf, size_t len)
+{
+    if (mapped()) {
+        const char* data;
+        len = map(data, len);
+        if (len) std::memcpy(buf, data, len);
+        return len;
+    }
+    if (m_lookahead_pos < m_lookahead.size()) {
+        size_t rb = std::min(len, m_lookahead.size() - m_lookahead_pos);
+        std::memcpy(buf, &m_lookahead[m_lookahead_pos], rb);
+        m_lookahead_pos += rb;
+        return rb;
+    }
+    ssize_t rb = ::read(m_fd, buf, len);
+    if (rb < 0) throw DecompressorException(m_name + ": read error: " + strerror(errno));
+    return rb;
+}
+
+bool InputFile::skip(uint64_t len)
+{
+    if (mapped()) {
+        m_pos += len;
+        return true;
+    }
+    // check first if the file can seek at all, before consuming the look-ahead
+    if (::lseek(m_fd, 0, SEEK_CUR) < 0) return false;
+    uint64_t buffered = std::min(len, static_cast<uint64_t>(m_lookahead.size() - m_lookahead_pos));
+    m_lookahead_pos += buffered;
+    return ::lseek(m_fd, static_cast<off_t>(len - buffered), SEEK_CUR) >= 0;
+}
+
+
+Decompressor::Decompressor(std::unique_ptr<InputFile> file, size_t bufsize)
+: m_file(std::move(file))
+, m_buffer(bufsize)
+{
+}
+
+size_t Decompressor::fill()
+{
+    return m_file->read(&m_buffer[0], m_buffer.size());
+}
+
+void Decompressor::skip(uint64_t len)
+{
+    // compressed blocks cannot be entered in the middle (and bzip2 blocks are
+    // not even byte aligned), so decompress through the data without using it
+    std::vector<char> buf(1024 * 1024);
+    while (len) {
+        ssize_t rb = read(&buf[0], std::min(static_cast<uint64_t>(buf.size()), len));
+        if (rb <= 0) throw DecompressorException(m_file->name() + ": unexpected end of file");
+        len -= rb;
+    }
+}
+
+
+namespace {
+
+/// uncompressed data
+class RawInput : public Decompressor {
+public:
+    RawInput(std::unique_ptr<InputFile> file) : Decompressor(std::move(file), 0) {}
+
+    virtual ssize_t read(void* buf, size_t len) { return m_file->read(buf, len); }
+
+    virtual void skip(uint64_t len)
+    {
+        if (!m_file->skip(len)) Decompressor::skip(len);
+    }
+
+    virtual size_t map(const char*& data, size_t len) { return m_file->map(data, len); }
+    virtual bool mapped() const { return m_file->mapped(); }
+};
+
+bool has_magic(const std::string& head, const char* magic, size_t len)
+{
+    return head.size() >= len && head.compare(0, len, magic, len) == 0;
+}
+
+}
+
+std::unique_ptr<Decompressor> Decompressor::open(const std::string& filename)
+{
+    auto file = std::make_unique<InputFile>(filename);
+
+    std::string head = file->peek(6);
+
+    if (has_magic(head, "BZh", 3)) return std::make_unique<UnBZip2>(std::move(file));
+
+    if (has_magic(head, "\x1f\x8b", 2)) {
+#ifdef HAVE_ZLIB
+        return std::make_unique<UnGZip>(std::move(file));
+#else
+        throw DecompressorException(filename + ": gzip support is not compiled in");
+#endif
+    }
+
+    if (has_magic(head, "\xfd" "7zXZ\0", 6)) {
+#ifdef HAVE_LZMA
+        return std::make_unique<UnXZ>(std::move(file));
+#else
+        throw DecompressorException(filename + ": xz support is not compiled in");
+#endif
+    }
+
+    if (has_magic(head, "\x28\xb5\x2f\xfd", 4)) {
+#ifdef HAVE_ZSTD
+        return std::make_unique<UnZstd>(std::move(file));
+#else
+        throw DecompressorException(filename + ": zstd support is not compiled in");
+#endif
+    }
+
+    return std::make_unique<RawInput>(std::move(file));
+}
@@ -0,0 +1,124 @@
+//
+//  decompressor.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef decompressor_hpp_KSDJHVBLKSDJBVHLSKDJHVBKSJDHBVKSJH
+#define decompressor_hpp_KSDJHVBLKSDJBVHLSKDJHVBKSJDHBVKSJH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cinttypes>
+#include <sys/types.h>
+
+
+/// A file or stdin, with a look-ahead on the first bytes to detect the format
+/// of the data also on pipes, which cannot be rewound. Regular files are
+/// memory mapped instead of read, in windows to not exhaust the address space
+/// of 32 bit systems.
+
+class InputFile {
+public:
+    InputFile(const std::string& filename);
+    ~InputFile();
+
+    /// returns up to len bytes from the start of the data, without consuming them.
+    /// Only valid before the first read().
+    std::string peek(size_t len);
+
+    /// returns the count of bytes read, 0 at the end of the file
+    ssize_t read(void* buf, size_t len);
+
+    /// skip len bytes without reading them. Returns false if the file cannot seek.
+    bool skip(uint64_t len);
+
+    /// zero copy read for mapped files: points data to the next len bytes of the
+    /// file and returns their count (less than len at the end of the file). The
+    /// data stays valid until the next call.
+    size_t map(const char*& data, size_t len);
+
+    /// true if the file is memory mapped, and map() can be used
+    bool mapped() const { return m_window != nullptr; }
+
+    const std::string& name() const { return m_name; }
+
+private:
+    enum { MapWindow = 64 * 1024 * 1024 };
+
+    std::string m_name;
+    int m_fd;
+    std::vector<char> m_lookahead;
+    size_t m_lookahead_pos;
+    char* m_window;
+    uint64_t m_window_offset;
+    size_t m_window_size;
+    uint64_t m_size;
+    uint64_t m_pos;
+
+    const char* window(uint64_t offset, size_t& len);
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+};
+
+
+/// Interface for the decompressors of the import files. open() selects the
+/// decompressor by the magic bytes at the start of the data, not by the
+/// file name, and falls back to uncompressed data if none matches.
+
+class Decompressor {
+public:
+    virtual ~Decompressor() {}
+
+    /// returns the count of decompressed bytes read, 0 at the end of the data
+    virtual ssize_t read(void* buf, size_t len) = 0;
+
+    /// skip len bytes of decompressed data. Compressed data has to be
+    /// decompressed for that, uncompressed files are seeked.
+    virtual void skip(uint64_t len);
+
+    /// zero copy read, see InputFile::map(). Only supported if mapped() is true,
+    /// which means uncompressed data in a regular file.
+    virtual size_t map(const char*& data, size_t len) { data = nullptr; return 0; }
+    virtual bool mapped() const { return false; }
+
+    /// filename may be '-' or empty for stdin
+    static std::unique_ptr<Decompressor> open(const std::string& filename);
+
+protected:
+    Decompressor(std::unique_ptr<InputFile> file, size_t bufsize = 256 * 1024);
+
+    /// read the next chunk of compressed data into m_buffer, returns 0 at the end of the file
+    size_t fill();
+
+    std::unique_ptr<InputFile> m_file;
+    std::vector<char> m_buffer;
+
+private:
+    Decompressor(const Decompressor&) = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+};
+
+#endif /* decompressor_hpp */
@@ -36,6 +36,113 @@
 
 using namespace CDDB;
 
+
+std::vector<DecodedStrings::Buffers>& DecodedStrings::pool()
+{
+    static thread_local std::vector<Buffers> buffers;
+    return buffers;
+}
+
+DecodedStrings::DecodedStrings()
+{
+    auto& spare = pool();
+    if (!spare.empty()) {
+        m_chars.swap(spare.back().chars);
+        m_entries.swap(spare.back().entries);
+        spare.pop_back();
+    }
+}
+
+DecodedStrings::DecodedStrings(const DecodedStrings& other)
+: DecodedStrings()
+{
+    *this = other;
+}
+
+DecodedStrings::DecodedStrings(DecodedStrings&& other)
+: m_chars(std::move(other.m_chars))
+, m_entries(std::move(other.m_entries))
+, m_moved_from(other.m_moved_from)
+{
+    other.m_moved_from = true;
+}
+
+DecodedStrings& DecodedStrings::operator=(const DecodedStrings& other)
+{
+    m_chars = other.m_chars;
+    m_entries = other.m_entries;
+    m_moved_from = false;
+    return *this;
+}
+
+DecodedStrings& DecodedStrings::operator=(DecodedStrings&& other)
+{
+    // other gets the buffers of this one, to give them back when it is destroyed
+    m_chars.swap(other.m_chars);
+    m_entries.swap(other.m_entries);
+    std::swap(m_moved_from, other.m_moved_from);
+    return *this;
+}
+
+DecodedStrings::~DecodedStrings()
+{
+    // moved from instances have nothing to give back
+    if (m_moved_from) return;
+    auto& spare = pool();
+    // more than a few are only needed if records are kept around, and those do not need recycling
+    if (spare.size() >= 16) return;
+    clear();
+    spare.emplace_back();
+    spare.back().chars.swap(m_chars);
+    spare.back().entries.swap(m_entries);
+}
+
+void DecodedStrings::clear()
+{
+    m_chars.clear();
+    m_entries.clear();
+}
+
+/// returns true if the (valid) UTF-8 in str ends in the middle of a sequence
+
+static bool truncated_utf8(const std::string& str)
+{
+    std::size_t size = str.size();
+    for (std::size_t back = 1; back <= 4 && back <= size; ++back) {
+        uint8_t ch = static_cast<uint8_t>(str[size - back]);
+        if ((ch & 0xc0) == 0x80) continue;
+        std::size_t len = ch < 0x80 ? 1 : (ch & 0xe0) == 0xc0 ? 2 : (ch & 0xf0) == 0xe0 ? 3 : 4;
+        return len > back;
+    }
+    return false;
+}
+
+bool DecodedStrings::add(const std::string& str)
+{
+    Entry entry;
+    entry.offset = static_cast<uint32_t>(m_chars.size());
+    entry.valid = Unicode::from_utf8(str.data(), str.size(), m_chars);
+    entry.size = static_cast<uint32_t>(m_chars.size() - entry.offset);
+    entry.complete = entry.valid && !truncated_utf8(str);
+    m_entries.push_back(entry);
+    return entry.valid;
+}
+
+DecodedStrings::const_range_t DecodedStrings::operator[](std::size_t index) const
+{
+    const Entry& entry = m_entries[index];
+    const char_t* begin = m_chars.data() + entry.offset;
+    return const_range_t(begin, begin + entry.size);
+}
+
+DecodedStrings::range_t DecodedStrings::at(std::size_t index)
+{
+    const Entry& entry = m_entries[index];
+    char_t* begin = &m_chars[0] + entry.offset;
+    return range_t(begin, begin + entry.size);
+}
+
+
 /// construct a DiskRecord out of explicit parameters
 
 DiskRecord::DiskRecord(uint32_t discid
@@ -65,83 +172,40 @@ DiskRecord::DiskRecord(uint32_t discid
 /// construct a DiskRecord out of the raw cddb file data stream
 
 DiskRecord::DiskRecord(const std::vector<char>& data)
+: DiskRecord(data.data(), data.size())
 {
-    std::string key;
-    std::string value;
-    char lastch = 0;
-    enum state_t { Skip, Start, Key, Limiter, Start2, Value, Comment };
-    state_t state = Start;
+}
 
-    for (auto ch : data) {
+/// construct a DiskRecord out of a raw cddb file in memory (e.g. inside the tar buffer)
 
-        if (ch == '\n' || ch == '\r') {
-            if (state == Value || state == Skip) {
-                add_keyvalue(key, value);
-            } else if (state == Comment) {
-                add_comment(value);
-            }
+DiskRecord::DiskRecord(const char* data, std::size_t size)
+{
+    const char* end = data + size;
 
-            state = Start;
-            key.clear();
-            value.clear();
+    // most records only use linefeeds - only search for carriage returns if there are any
+    const bool has_cr = size && std::memchr(data, '\r', size) != nullptr;
 
-            continue;
-        }
+    // the temporaries of parsing and cleanup are taken from the arena of this
+    // thread, and released when the record is complete
+    Arena::Scope scope;
+
+    // only used for values that need to be modified (multiple spaces)
+    arena_string scratch;
+
+    while (data < end) {
+
+        const char* eol = static_cast<const char*>(std::memchr(data, '\n', end - data));
+        if (!eol) eol = end;
 
-        switch (state) {
-
-            case Skip:
-                break;
-
-            case Start:
-                if (ch == '#') {
-                    state = Comment;
-                }
-                else if (!std::isspace(ch)) {
-                    state = Key;
-                    key = ch;
-                }
-                break;
-
-            case Key:
-                if (std::isspace(ch)) {
-                    state = Limiter;
-                } else if (ch == '=') {
-                    state = Start2;
-                } else {
-                    key += ch;
-                }
-                break;
-
-            case Limiter:
-                if (std::isspace(ch)) break;
-                else if (ch == '=') state = Start2;
-                else state = Skip; // we only expect space or = at this point, everything else is an error
-                break;
-
-            case Start2:
-                if (!std::isspace(ch)) {
-                    state = Value;
-                    value = ch;
-                    lastch = ch;
-                }
-                break;
-
-            case Value:
-                if (lastch != ' ' || ch != ' ') value += ch;
-                lastch = ch;
-                break;
-
-            case Comment:
-                // skip leading spaces
-                if (!value.empty() || !std::isspace(ch)) value += ch;
-                break;
+        if (has_cr) {
+            const char* cr = static_cast<const char*>(std::memchr(data, '\r', eol - data));
+            if (cr) eol = cr;
         }
-    }
 
-    // just in case the last line had no linefeed
-    if (state == Value || state == Skip) {
-        add_keyvalue(key, value);
+        // a last line without linefeed is only evaluated if it is not a comment
+        parse_line(data, eol, eol != end, scratch);
+
+        data = eol + 1;
     }
 
     cleanup();
@@ -150,6 +214,80 @@ DiskRecord::DiskRecord(const std::vector<char>& data)
     m_seconds = convert_frame_starts_in_frame_lengths(m_seconds, m_frames);
 }
 
+static inline bool is_blank(char ch)
+{
+    // the line terminators \r and \n never show up inside a line
+    return ch == ' ' || ch == '\t' || ch == '\v' || ch == '\f';
+}
+
+void DiskRecord::parse_line(const char* p, const char* end, bool terminated, arena_string& scratch)
+{
+    // skip leading spaces
+    while (p != end && is_blank(*p)) ++p;
+    if (p == end) return;
+
+    if (*p == '#') {
+        if (!terminated) return;
+        // a comment - skip the leading spaces of the comment text
+        ++p;
+        while (p != end && is_blank(*p)) ++p;
+        add_comment(StringView(p, end));
+        return;
+    }
+
+    // the first char always belongs to the key, even if it is a =
+    const char* key = p++;
+    while (p != end && !is_blank(*p) && *p != '=') ++p;
+    StringView keyv(key, p);
+
+    while (p != end && is_blank(*p)) ++p;
+
+    // a key without a = is ignored
+    if (p == end) return;
+
+    if (*p != '=') {
+        // we only expect space or = after the key, everything else is an error
+        add_keyvalue(keyv, StringView());
+        return;
+    }
+
+    // skip the = and the leading spaces of the value
+    ++p;
+    while (p != end && is_blank(*p)) ++p;
+
+    // an empty value is ignored
+    if (p == end) return;
+
+    // strip trailing spaces
+    while (end[-1] == ' ') --end;
+
+    StringView value(p, end);
+
+    // check if we have to collapse multiple spaces into one - this is the only
+    // case in which the value is not taken directly from the input buffer
+    const char* space = p;
+    while ((space = static_cast<const char*>(std::memchr(space, ' ', end - space))) != nullptr) {
+        if (space[1] == ' ') break;
+        space += 2;
+        if (space >= end) {
+            space = nullptr;
+            break;
+        }
+    }
+
+    if (space) {
+        scratch.assign(p, space + 1);
+        char lastch = ' ';
+        for (++space; space != end; ++space) {
+            if (lastch != ' ' || *space != ' ') scratch += *space;
+            lastch = *space;
+        }
+        value = StringView(scratch.data(), scratch.size());
+    }
+
+    add_keyvalue(keyv, value);
+}
+
 void DiskRecord::calc_discid() const
 {
     if (m_valid) {
@@ -177,98 +315,108 @@ void DiskRecord::verify_record()
             && m_seconds;
 }
 
-inline uint32_t read_integer_from_string(const std::string& value, size_t label_len)
+inline uint32_t read_integer_from_string(const StringView& value, size_t label_len)
 {
-    return static_cast<uint32_t>(std::strtoul(value.c_str()+label_len, nullptr, 10));
+    // all values are at most 255 chars long, so a stack buffer suffices to get the
+    // terminating 0 that strtoul() requires
+    char buf[256];
+    StringView digits = value.substr(label_len);
+    auto len = std::min(digits.size(), sizeof(buf) - 1);
+    std::memcpy(buf, digits.data(), len);
+    buf[len] = 0;
+    return static_cast<uint32_t>(std::strtoul(buf, nullptr, 10));
 }
 
-void DiskRecord::add_comment(std::string& value)
+/// assign a value to a string, converting it to utf8 if it is not already utf8
+
+template <class String>
+static void assign_utf8(String& target, const StringView& value)
 {
-    try {
+    // check encoding of value, could be either iso8859-1 (including ASCII) or utf8
+    if (Unicode::valid_utf8(value)) {
+        target.assign(value.data(), value.size());
+    } else {
+        // convert to utf8, assuming that the string is in iso8859-1
+        target.clear();
+        Unicode::latin1_to_utf8(value.data(), value.size(), target);
+    }
+}
 
-        if (value.size() > 255) return;
+void DiskRecord::add_comment(StringView value)
+{
+    if (value.size() > 255) return;
 
-        if (!m_read_tracks) {
+    if (!m_read_tracks) {
 
-            if (CDDB::begins_with(value, "Track frame offsets:")) m_read_tracks = true;
-            else if (CDDB::begins_with(value, "Disc length: ")) m_seconds = read_integer_from_string(value, std::strlen("Disc length: "));
-            else if (CDDB::begins_with(value, "Revision: ")) m_revision = read_integer_from_string(value, std::strlen("Revision: "));
+        if (CDDB::begins_with(value, "Track frame offsets:")) m_read_tracks = true;
+        else if (CDDB::begins_with(value, "Disc length: ")) m_seconds = read_integer_from_string(value, std::strlen("Disc length: "));
+        else if (CDDB::begins_with(value, "Revision: ")) m_revision = read_integer_from_string(value, std::strlen("Revision: "));
 
-        } else {
+    } else {
 
-            trim(value);
-            if (value.empty()) m_read_tracks = false;
-            else if (CDDB::begins_with(value, "Disc length: ")) {
-                // this is a record that misses an empty line between the track listing and the disc length
-                m_read_tracks = false;
-                m_seconds = read_integer_from_string(value, std::strlen("Disc length: "));
-            }
-            else {
-                uint32_t i = read_integer_from_string(value, 0);
-                if (!i) m_read_tracks = false;
-                else m_frames.emplace_back(i);
-            }
+        while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+        while (!value.empty() && value.back() == ' ') value.remove_suffix(1);
+
+        if (value.empty()) m_read_tracks = false;
+        else if (CDDB::begins_with(value, "Disc length: ")) {
+            // this is a record that misses an empty line between the track listing and the disc length
+            m_read_tracks = false;
+            m_seconds = read_integer_from_string(value, std::strlen("Disc length: "));
+        }
+        else {
+            uint32_t i = read_integer_from_string(value, 0);
+            if (!i) m_read_tracks = false;
+            else m_frames.emplace_back(i);
         }
-            
-    } catch (std::out_of_range& e) {
-        // continue if value out of range - treat it as if it had not been there
     }
 }
 
-void DiskRecord::add_keyvalue(const std::string& key, std::string& value)
+void DiskRecord::add_keyvalue(const StringView& key, const StringView& value)
 {
-    try {
-        // any non-comment certainly ends reading the track frame list
-        m_read_tracks = false;
-
-        trim_right(value);
+    // any non-comment certainly ends reading the track frame list
+    m_read_tracks = false;
 
-        if (key.empty() || value.empty()) return;
-        if (key.size() > 15 || value.size() > 255) return;
+    if (key.empty() || value.empty()) return;
+    if (key.size() > 15 || value.size() > 255) return;
 
-        // check encoding of value, could be either iso8859-1 (including ASCII) or utf8
-        if (!Unicode::valid_utf8(value)) {
-            std::string utfs;
-            // convert to utf8, assuming that the string is in iso8859-1
-            Unicode::to_utf8(value, utfs);
-            value.swap(utfs);
-        }
+    // only the values of the keys we keep get copied out of the input buffer
 
-        if (key == "DISCID") {
-            // we do not process the legacy discid anymore
-        }
-        else if (key == "DYEAR" ) m_year    = std::stoul(value);
-        else if (key == "DGENRE") m_genre   = value;
-        else if (key == "DTITLE") {
-            auto p = value.find(" / ");
-            if (p != std::string::npos) {
-                m_artist  = value.substr(0, p);
-                m_title   = value.substr(p+3, value.length() - p+3);
-            } else {
-                // title and artist are assumed to be the same if there is no /
-                m_artist  = value;
-                m_title   = value;
-            }
+    if (key == "DISCID") {
+        // we do not process the legacy discid anymore
+    }
+    else if (key == "DYEAR" ) m_year = read_integer_from_string(value, 0);
+    else if (key == "DGENRE") assign_utf8(m_genre, value);
+    else if (key == "DTITLE") {
+        arena_string title;
+        assign_utf8(title, value);
+        auto p = title.find(" / ");
+        if (p != arena_string::npos) {
+            m_artist.assign(title.data(), p);
+            m_title.assign(title.data() + p + 3, title.size() - p - 3);
+        } else {
+            // title and artist are assumed to be the same if there is no /
+            m_artist.assign(title.data(), title.size());
+            m_title = m_artist;
         }
-        else {
-            if (CDDB::begins_with(key, "TTITLE")) {
-                uint32_t lv = read_integer_from_string(key, std::strlen("TTITLE"));
-                // some TTITLE lists start at 1, not at 0..
-                if (m_songs.empty()) m_list_base = lv;
-                if (m_songs.size() != lv - m_list_base) return;
-                m_songs.emplace_back(value);
-            }
+    }
+    else if (CDDB::begins_with(key, "TTITLE")) {
+        uint32_t lv = read_integer_from_string(key, std::strlen("TTITLE"));
+        // some TTITLE lists start at 1, not at 0..
+        if (m_songs.empty()) {
+            m_list_base = lv;
+            // the frame offsets come first, and there is one song per frame
+            m_songs.reserve(m_frames.size());
         }
-        
-    } catch (std::out_of_range& e) {
-        // continue if value out of range - treat it as if it had not been there
+        if (m_songs.size() != lv - m_list_base) return;
+        m_songs.emplace_back();
+        assign_utf8(m_songs.back(), value);
     }
 }
 
-inline bool DiskRecord::mostly_uppercase(const std::wstring str)
+inline bool DiskRecord::mostly_uppercase(DecodedStrings::const_range_t str)
 {
-    std::wstring::size_type upperalpha = 0;
-    std::wstring::size_type nonupperalpha = 0;
+    std::size_t upperalpha = 0;
+    std::size_t nonupperalpha = 0;
 
     for (auto ch : str) {
         if (std::iswalpha(ch)) {
@@ -282,18 +430,38 @@ inline bool DiskRecord::mostly_uppercase(const std::wstring str)
     return nonupperalpha < upperalpha;
 }
 
-void DiskRecord::convert_to_titlecase(std::string& value, Entropy<std::wstring::value_type>* entropy)
+void DiskRecord::convert_to_titlecase(std::size_t index, std::string& value, Entropy<std::wstring::value_type>* entropy)
 {
-    std::wstring wide;
-    if (Unicode::from_utf8(value, wide)) {
-        if (mostly_uppercase(wide)) {
-            if (to_title_case(wide, false) > 0) {
-                value.erase();
-                Unicode::to_utf8(wide, value);
-            }
+    if (!m_decoded.valid(index)) return;
+
+    auto wide = m_decoded.at(index);
+    bool recoded = false;
+
+    if (mostly_uppercase(wide)) {
+        if (to_title_case(wide, false) > 0) {
+            value.erase();
+            Unicode::to_utf8(wide.begin(), wide.size(), value);
+            recoded = true;
         }
-        if (entropy) entropy->add(wide);
     }
+
+    if (entropy) entropy->add(wide);
+
+    if (recoded) {
+        // to_utf8() writes code points beyond the Unicode range as '?' - keep
+        // the decoded string equal to what decoding the new value would give
+        for (auto& ch : wide) if (Unicode::codepoint_cast(ch) >= 0x110000) ch = '?';
+        m_decoded.set_complete(index);
+    }
+}
+
+void DiskRecord::decode() const
+{
+    m_decoded.clear();
+    m_decoded.add(m_artist);
+    m_decoded.add(m_title);
+    m_decoded.add(m_genre);
+    for (const auto& song : m_songs) m_decoded.add(song);
 }
 
 void DiskRecord::calc_hash() const
@@ -307,13 +475,20 @@ void DiskRecord::calc_hash() const
     m_hash_ready = true;
 }
 
+template <class String, class Wide>
+String normalize_(const Wide& wide);
+
 void DiskRecord::calc_normalized_hash() const
 {
     // calculate a normalized hash
+    Arena::Scope scope;
+    const DecodedStrings& wide = decoded();
     CDDB::FNVHash32 hash;
-    hash.add(normalize(m_artist));
-    hash.add(normalize(m_title));
-    for (auto s : m_songs) hash.add(normalize(s));
+    for (std::size_t ct = 0; ct < wide.size(); ++ct) {
+        if (ct == Genre) continue;
+        arena_string norm = normalize_<arena_string>(wide[ct]);
+        hash.add(norm.data(), norm.size());
+    }
     m_normalized_hash = hash.result();
     m_normalized_hash_ready = true;
 }
@@ -337,15 +512,15 @@ void DiskRecord::calc_bad_encoding(const Entropy<std::wstring::value_type>& entr
 
     std::size_t ct = 0;
     // these are illegal unicode / ISO8859-1 values
-    for (int ch = 0; ch < 0x20; ++ch) if (entropy.has_value(ch)) ++ct;
+    ct += entropy.count_values(0, 0x20);
     // these are illegal unicode / ISO8859-1 values
-    for (int ch = 0x7f; ch < 0xa0; ++ch) if (entropy.has_value(ch)) ++ct;
+    ct += entropy.count_values(0x7f, 0xa0);
     // these are _very_ uncommon unicode / ISO8859-1 values
-    for (int ch = 0xa0; ch < 0xc0; ++ch) if (entropy.has_value(ch)) ++ct;
+    ct += entropy.count_values(0xa0, 0xc0);
     if (ct > 4) return;
     // not deleting ct here on purpose - let it add up with the next character class
     // these are unicode / ISO8859-1 values that should not make the majority of a string
-    for (int ch = 0xc0; ch < 0x100; ++ch) if (entropy.has_value(ch)) ++ct;
+    ct += entropy.count_values(0xc0, 0x100);
     if (ct > entropy.size() / 3) return;
 
     m_bad_encoding = false;
@@ -355,17 +530,10 @@ void DiskRecord::calc_entropy() const
 {
     if (m_entropy) return;
     Entropy<std::wstring::value_type> entropy;
-    std::wstring wide;
-    Unicode::from_utf8(m_title, wide);
-    entropy += wide;
-    wide.clear();
-    Unicode::from_utf8(m_artist, wide);
-    entropy += wide;
-    for (auto& s : m_songs) {
-        wide.clear();
-        Unicode::from_utf8(s, wide);
-        entropy += wide;
-    }
+    const DecodedStrings& wide = decoded();
+    entropy += wide[Title];
+    entropy += wide[Artist];
+    for (std::size_t ct = 0; ct < m_songs.size(); ++ct) entropy += wide[Songs + ct];
 
     // store entropy
     m_entropy = entropy.size();
@@ -382,9 +550,11 @@ void DiskRecord::cleanup()
     // get rid of common reasons for duplicate entries:
 
     // 1) Artist named in front of the track titles again
-    std::string begin = m_artist + " / ";
+    const std::size_t prefix = m_artist.size() + 3;
     for (auto& song : m_songs) {
-        if (begins_with(song, begin)) song.erase(0, begin.size());
+        if (song.size() >= prefix && song.compare(0, m_artist.size(), m_artist) == 0 && song.compare(m_artist.size(), 3, " / ") == 0) {
+            song.erase(0, prefix);
+        }
     }
 
     // 2) multiple spaces used instead of one, leading and trailing spaces
@@ -396,13 +566,14 @@ void DiskRecord::cleanup()
     }
 
     // 3) uppercase used instead of mixed case
-    // and calc entropy as we have to convert to wide string in the process anyway
+    // and calc entropy on the same decode of the strings
+    decode();
     Entropy<std::wstring::value_type> entropy;
-    convert_to_titlecase(m_artist, &entropy);
-    convert_to_titlecase(m_title, &entropy);
-    convert_to_titlecase(m_genre);
-    for (auto& song : m_songs) {
-        convert_to_titlecase(song, &entropy);
+    convert_to_titlecase(Artist, m_artist, &entropy);
+    convert_to_titlecase(Title, m_title, &entropy);
+    convert_to_titlecase(Genre, m_genre);
+    for (std::size_t ct = 0; ct < m_songs.size(); ++ct) {
+        convert_to_titlecase(Songs + ct, m_songs[ct], &entropy);
     }
 
     // store entropy
@@ -489,11 +660,9 @@ static inline void normalize_accented_chars(std::wstring::value_type& ch)
     }
 }
 
-template <class String>
-String normalize_(const std::string& str)
+template <class String, class Wide>
+String normalize_(const Wide& wide)
 {
-    std::wstring wide;
-    Unicode::from_utf8(str, wide);
     String norm;
     for (auto ch : wide) {
         if (ch < '0') continue;
@@ -513,12 +682,34 @@ String normalize_(const std::string& str)
 
 std::string DiskRecord::normalize(const std::string& str)
 {
-    return normalize_<std::string>(str);
+    std::wstring wide;
+    Unicode::from_utf8(str, wide);
+    return normalize_<std::string>(wide);
 }
 
 std::wstring DiskRecord::wnormalize(const std::string& str)
 {
-    return normalize_<std::wstring>(str);
+    std::wstring wide;
+    Unicode::from_utf8(str, wide);
+    return normalize_<std::wstring>(wide);
+}
+
+std::wstring DiskRecord::wnormalize_entry(std::size_t index) const
+{
+    return normalize_<std::wstring>(decoded()[index]);
+}
+
+std::wstring DiskRecord::wnormalize_artist_title() const
+{
+    const DecodedStrings& wide = decoded();
+
+    // decoding artist + title gives the concatenation of their decodes, unless
+    // the artist ends with a truncated sequence
+    if (wide.complete(Artist)) return normalize_<std::wstring>(wide[Artist]) + normalize_<std::wstring>(wide[Title]);
+    // decoding stops at invalid UTF-8
+    if (!wide.valid(Artist)) return normalize_<std::wstring>(wide[Artist]);
+
+    return wnormalize(m_artist + m_title);
 }
 
 uint16_t DiskRecord::compare(const std::wstring& left, const std::wstring& right)
@@ -539,6 +730,21 @@ uint16_t DiskRecord::compare_normalized(const std::string& left, const std::stri
     return compare(wnormalize(left), wnormalize(right));
 }
 
+uint16_t DiskRecord::compare_normalized_artist(const DiskRecord& other) const
+{
+    return compare(wnormalize_entry(Artist), other.wnormalize_entry(Artist));
+}
+
+uint16_t DiskRecord::compare_normalized_title(const DiskRecord& other) const
+{
+    return compare(wnormalize_entry(Title), other.wnormalize_entry(Title));
+}
+
+uint16_t DiskRecord::compare_normalized_artist_title(const DiskRecord& other) const
+{
+    return compare(wnormalize_artist_title(), other.wnormalize_artist_title());
+}
+
 std::string DiskRecord::cddb_file() const
 {
     frame_t frames = m_frames;
@@ -579,25 +785,29 @@ bool DiskRecord::equal_strings(const DiskRecord& other) const
     && songs() == other.songs();
 }
 
-bool compare_lower(const std::string& left, const std::string& right)
+static inline std::wstring::value_type to_lower(std::wstring::value_type ch)
+{
+    return std::iswupper(ch) ? std::towlower(ch) : ch;
+}
+
+static bool compare_lower(DecodedStrings::const_range_t left, DecodedStrings::const_range_t right)
 {
-    std::wstring wl;
-    std::wstring wr;
-    Unicode::from_utf8(left, wl);
-    Unicode::from_utf8(right, wr);
-    for (auto& ch : wl) if (std::iswupper(ch)) ch = std::towlower(ch);
-    for (auto& ch : wr) if (std::iswupper(ch)) ch = std::towlower(ch);
-    return wl == wr;
+    if (left.size() != right.size()) return false;
+    for (auto l = left.begin(), r = right.begin(); l != left.end(); ++l, ++r) {
+        if (*l != *r && to_lower(*l) != to_lower(*r)) return false;
+    }
+    return true;
 }
 
 bool DiskRecord::equal_lowercase_strings(const DiskRecord& other) const
 {
     if (songs().size() != other.songs().size()) return false;
-    if (!compare_lower(artist(), other.artist())) return false;
-    if (!compare_lower(title(), other.title())) return false;
+    const DecodedStrings& left = decoded();
+    const DecodedStrings& right = other.decoded();
+    if (!compare_lower(left[Artist], right[Artist])) return false;
+    if (!compare_lower(left[Title], right[Title])) return false;
     for (std::size_t ct = 0; ct < songs().size(); ++ct) {
-        if (!compare_lower(songs()[ct], other.songs()[ct])) return false;
+        if (!compare_lower(left[Songs + ct], right[Songs + ct])) return false;
     }
     return true;
 }
-
@@ -31,10 +31,84 @@
 #include <string>
 #include <cinttypes>
 #include "cddbdefines.hpp"
+#include "stringview.hpp"
+#include "arena.hpp"
 
 
 namespace CDDB {
 
+/// The strings of a record, decoded from UTF-8 into one buffer of code points. The
+/// character based analyses of a record (title casing, entropy, normalization and
+/// comparison) all run on this single decode. The buffers are recycled per thread.
+
+class DecodedStrings {
+public:
+    typedef std::wstring::value_type char_t;
+
+    template<class Ch>
+    class Range {
+    public:
+        Range(Ch* begin, Ch* end) : m_begin(begin), m_end(end) {}
+        template<class Other>
+        Range(const Range<Other>& other) : m_begin(other.begin()), m_end(other.end()) {}
+        Ch* begin() const { return m_begin; }
+        Ch* end() const { return m_end; }
+        std::size_t size() const { return m_end - m_begin; }
+        bool empty() const { return m_begin == m_end; }
+    private:
+        Ch* m_begin;
+        Ch* m_end;
+    };
+
+    typedef Range<const char_t> const_range_t;
+    typedef Range<char_t> range_t;
+
+    DecodedStrings();
+    DecodedStrings(const DecodedStrings& other);
+    DecodedStrings(DecodedStrings&& other);
+    DecodedStrings& operator=(const DecodedStrings& other);
+    DecodedStrings& operator=(DecodedStrings&& other);
+    ~DecodedStrings();
+
+    void clear();
+    /// decodes str and adds it as the next entry. On invalid UTF-8 the valid
+    /// prefix is kept (like Unicode::from_utf8() does), and false is returned.
+    bool add(const std::string& str);
+
+    std::size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+    const_range_t operator[](std::size_t index) const;
+    range_t at(std::size_t index);
+    /// false if the UTF-8 of this entry was invalid
+    bool valid(std::size_t index) const { return m_entries[index].valid; }
+    /// true if this entry can be followed by another one without changing the
+    /// result of decoding the concatenated UTF-8 (valid and not truncated)
+    bool complete(std::size_t index) const { return m_entries[index].complete; }
+    /// mark an entry that was re-encoded from its decoded code points as complete
+    void set_complete(std::size_t index) { m_entries[index].valid = m_entries[index].complete = true; }
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t size;
+        bool valid;
+        bool complete;
+    };
+
+    struct Buffers {
+        std::wstring chars;
+        std::vector<Entry> entries;
+    };
+
+    /// the buffers of destroyed instances, per thread
+    static std::vector<Buffers>& pool();
+
+    std::wstring m_chars;
+    std::vector<Entry> m_entries;
+    // the buffers were moved to another instance
+    bool m_moved_from = false;
+};
+
 class DiskRecord {
 public:
     typedef std::vector<std::string> list_t;
@@ -42,6 +116,8 @@ public:
     typedef std::vector<uint32_t> frame_t;
 
     DiskRecord(const std::vector<char>& data);
+    DiskRecord(const char* data, std::size_t size);
+    DiskRecord(const StringView& data) : DiskRecord(data.data(), data.size()) {}
     DiskRecord(uint32_t discid
                , std::string&& artist
                , std::string&& title
@@ -70,6 +146,10 @@ public:
     std::size_t charcount() const { if (!m_entropy) calc_entropy(); return m_charcount; }
     std::size_t charcount_upper() const { if (!m_entropy) calc_entropy(); return m_uppercasecount; }
     bool bad_encoding() const { if (!m_entropy) calc_entropy(); return m_bad_encoding; }
+    /// restore the counts a record had when it was parsed, on one that is rebuilt from
+    /// its strings (the uppercase count is a by-product of the title case conversion)
+    void set_counts(std::size_t entropy, std::size_t charcount, std::size_t uppercount)
+    { m_entropy = entropy; m_charcount = charcount; m_uppercasecount = uppercount; }
     std::string cddb_file() const;
 
     static std::string normalize(const std::string& str);
@@ -78,12 +158,27 @@ public:
     static uint16_t compare(const std::string& left, const std::string& right);
     static uint16_t compare_normalized(const std::string& left, const std::string& right);
 
+    /// compare_normalized() of this and another record's artist, title, and artist + title,
+    /// computed on the already decoded strings
+    uint16_t compare_normalized_artist(const DiskRecord& other) const;
+    uint16_t compare_normalized_title(const DiskRecord& other) const;
+    uint16_t compare_normalized_artist_title(const DiskRecord& other) const;
+
     bool equal_strings(const DiskRecord& other) const;
     bool equal_lowercase_strings(const DiskRecord& other) const;
 
 private:
-    void add_keyvalue(const std::string& key, std::string& value);
-    void add_comment(std::string& value);
+    // the entries of m_decoded
+    enum { Artist = 0, Title = 1, Genre = 2, Songs = 3 };
+
+    const DecodedStrings& decoded() const { if (m_decoded.empty()) decode(); return m_decoded; }
+    void decode() const;
+    std::wstring wnormalize_entry(std::size_t index) const;
+    std::wstring wnormalize_artist_title() const;
+
+    void parse_line(const char* begin, const char* end, bool terminated, arena_string& scratch);
+    void add_keyvalue(const StringView& key, const StringView& value);
+    void add_comment(StringView value);
     void cleanup();
     void calc_entropy() const;
     void calc_hash() const;
@@ -92,8 +187,8 @@ private:
     void calc_fuzzy_discid() const;
     void calc_bad_encoding(const Entropy<std::wstring::value_type>& entropy) const;
     void verify_record();
-    bool mostly_uppercase(const std::wstring str);
-    void convert_to_titlecase(std::string& value, Entropy<std::wstring::value_type>* entropy = nullptr);
+    bool mostly_uppercase(DecodedStrings::const_range_t str);
+    void convert_to_titlecase(std::size_t index, std::string& value, Entropy<std::wstring::value_type>* entropy = nullptr);
 
     mutable discid_t m_discid = 0;
     mutable discid_t m_fuzzy_discid = 0;
@@ -111,6 +206,7 @@ private:
     mutable std::size_t m_charcount = 0;
     mutable std::size_t m_uppercasecount = 0;
     mutable bool m_bad_encoding = false;
+    mutable DecodedStrings m_decoded;
 
     mutable bool m_hash_ready = false;
     mutable bool m_normalized_hash_ready = false;
@@ -29,7 +29,8 @@
 
 
 #include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
+#include <type_traits>
 #include <cinttypes>
 #include <string>
 #include <cstring>
@@ -512,7 +513,11 @@ public:
     }
 
     void add(const std::string& s) {
-        for (auto ch : s) add(ch);
+        add(s.data(), s.size());
+    }
+
+    void add(const char* p, std::size_t size) {
+        for (const char* end = p + size; p != end; ++p) add(*p);
     }
 
     void add(uint8_t value) {
@@ -529,12 +534,17 @@ private:
 };
 
 
+/// Counts the distinct values in a sequence of chars. Values below 256 (ASCII
+/// and ISO-8859-1, by far the most frequent ones) are kept in a bitmap, higher
+/// ones in a small sorted vector.
+
 template<class Element>
 class Entropy {
 public:
     void clear()
     {
-        m_elements.clear();
+        for (auto& word : m_bitmap) word = 0;
+        m_overflow.clear();
         m_count = 0;
     }
 
@@ -564,7 +574,13 @@ public:
 
     void add(Element e)
     {
-        m_elements.insert(e);
+        value_t v = static_cast<value_t>(e);
+        if (v < 256) {
+            m_bitmap[v >> 6] |= uint64_t(1) << (v & 63);
+        } else {
+            auto it = std::lower_bound(m_overflow.begin(), m_overflow.end(), v);
+            if (it == m_overflow.end() || *it != v) m_overflow.insert(it, v);
+        }
         ++m_count;
     }
 
@@ -576,7 +592,11 @@ public:
 
     std::size_t size() const
     {
-        return m_elements.size();
+        return __builtin_popcountll(m_bitmap[0])
+             + __builtin_popcountll(m_bitmap[1])
+             + __builtin_popcountll(m_bitmap[2])
+             + __builtin_popcountll(m_bitmap[3])
+             + m_overflow.size();
     }
 
     std::size_t count() const
@@ -596,22 +616,46 @@ public:
 
     bool has_value(Element e) const
     {
-        return m_elements.find(e) != m_elements.end();
+        value_t v = static_cast<value_t>(e);
+        if (v < 256) return (m_bitmap[v >> 6] >> (v & 63)) & 1;
+        return std::binary_search(m_overflow.begin(), m_overflow.end(), v);
+    }
+
+    /// the count of distinct values in [first, last), for values below 256
+    std::size_t count_values(uint32_t first, uint32_t last) const
+    {
+        std::size_t ct = 0;
+        if (last > 256) last = 256;
+        while (first < last) {
+            // the bits of [first, min(last, end of word)) in the word of first
+            uint32_t end = std::min((first | 63) + 1, last);
+            uint32_t bits = end - first;
+            uint64_t mask = (bits == 64) ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1) << (first & 63);
+            ct += __builtin_popcountll(m_bitmap[first >> 6] & mask);
+            first = end;
+        }
+        return ct;
     }
     
 private:
-    typedef std::unordered_set<Element> elements_t;
-    elements_t m_elements;
+    // negative values (of signed char types) end up in the overflow
+    typedef typename std::make_unsigned<Element>::type value_t;
+
+    uint64_t m_bitmap[4] = { 0, 0, 0, 0 };
+    std::vector<value_t> m_overflow;
     std::size_t m_count = 0;
 };
 
 
+/// Similarity of strings by their n-grams. Each n-gram is packed into an integer,
+/// and the n-grams of a string are kept sorted, so that the common n-grams of two
+/// strings can be counted with a linear merge.
+
 template <uint16_t nglen, bool added_spaces>
 class NGrams {
 public:
     NGrams(const std::wstring& str = L"")
     {
-        if (nglen < 2) throw std::runtime_error("NGram minimum len is 2");
         init(str);
     }
 
@@ -638,36 +682,40 @@ public:
             m_count = str.size() - (nglen-1);
         }
 
+        m_ngrams.reserve(m_count);
+
         if (added_spaces) add_char(' ');
         for (auto ch : str) add_char(ch);
         if (added_spaces) add_char(' ');
+
+        std::sort(m_ngrams.begin(), m_ngrams.end());
+
         return m_ngrams.size();
     }
 
-    uint16_t compare(const NGrams& other)
+    uint16_t compare(const NGrams& other) const
     {
         if (!m_count) return 0;
 
-        uint16_t found = 0;
-        std::vector<bool> used;
-        used.insert(used.begin(), m_ngrams.size(), false);
-
-        for (auto& o : other.m_ngrams) {
-            auto u = used.begin();
-            for (auto& g : m_ngrams) {
-                if (!*u && o == g) {
-                    ++found;
-                    *u = true;
-                    break;
-                }
-                ++u;
+        // both sides are sorted - count the n-grams they have in common,
+        // each one of this side matching at most one of the other side
+        std::size_t found = 0;
+        auto l = m_ngrams.begin();
+        auto r = other.m_ngrams.begin();
+        while (l != m_ngrams.end() && r != other.m_ngrams.end()) {
+            if (*l < *r) ++l;
+            else if (*r < *l) ++r;
+            else {
+                ++found;
+                ++l;
+                ++r;
             }
         }
 
-        return found * 100 / m_count;
+        return static_cast<uint16_t>(found * 100 / m_count);
     }
 
-    uint16_t compare(const std::wstring& str)
+    uint16_t compare(const std::wstring& str) const
     {
         NGrams<nglen, added_spaces> other(str);
         return compare(other);
@@ -680,18 +728,27 @@ public:
     }
 
 private:
-    typedef std::string ngram_t;
+    // An n-gram is packed as a leading 1 followed by one byte per char. The chars
+    // are truncated to 8 bits, as they always have been when n-grams were strings
+    // of narrow chars. The last n-grams of a string collect up to 2 * nglen - 1
+    // chars (see add_char()), which still has to fit into 64 bits.
+    typedef uint64_t ngram_t;
     typedef std::vector<ngram_t> ngrams_t;
 
+    static_assert(nglen >= 2 && nglen <= 4, "NGram len has to be in the range 2..4");
+
     void add_char(std::wstring::value_type ch)
     {
         auto size = m_ngrams.size();
         if (size < m_count) {
-            m_ngrams.emplace_back("");
+            m_ngrams.emplace_back(1);
             ++size;
         }
+        // once all n-grams exist, the last ones keep collecting the remaining
+        // chars - the existing scores depend on this
         for (uint16_t ct = 0; ct < nglen && ct < size; ++ct) {
-            m_ngrams[size - ct - 1] += ch;
+            ngram_t& ngram = m_ngrams[size - ct - 1];
+            ngram = (ngram << 8) | static_cast<uint8_t>(ch);
         }
     }
     
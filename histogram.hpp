@@ -0,0 +1,145 @@
+//
+//  histogram.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef histogram_hpp_QPWOEIRUTZVMBNXKDJFHGALSKDJQWPOEIR
+#define histogram_hpp_QPWOEIRUTZVMBNXKDJFHGALSKDJQWPOEIR
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "format.hpp"
+
+
+namespace CDDB {
+
+/// A latency histogram in the manner of HdrHistogram: values are counted in
+/// buckets that are linear within each power of two, so the relative error of
+/// a reported value is below 1/SubBuckets over the whole range, at a fixed
+/// size and O(1) cost per value. Values above MaxValue are counted as MaxValue.
+
+class Histogram {
+public:
+    enum : uint32_t { SubBits = 5, SubBuckets = 1 << SubBits, MaxBits = 40 };
+    static constexpr uint64_t MaxValue = (uint64_t(1) << MaxBits) - 1;
+    static constexpr uint32_t Buckets = (MaxBits - SubBits + 1) * SubBuckets;
+
+    Histogram() : m_counts(Buckets) {}
+
+    void record(uint64_t value, uint64_t count = 1)
+    {
+        value = std::min(value, MaxValue);
+        m_counts[index(value)] += count;
+        m_total += count;
+        m_sum += value * count;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const Histogram& other)
+    {
+        for (uint32_t ct = 0; ct < Buckets; ++ct) m_counts[ct] += other.m_counts[ct];
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    void clear()
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_total = m_sum = m_max = 0;
+        m_min = MaxValue;
+    }
+
+    uint64_t count() const { return m_total; }
+    uint64_t min() const { return m_total ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_total ? double(m_sum) / m_total : 0; }
+
+    /// the highest value equivalent to the given percentile (0..100)
+    uint64_t percentile(double percentile) const
+    {
+        if (!m_total) return 0;
+        uint64_t rank = static_cast<uint64_t>(percentile / 100 * m_total + 0.5);
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (uint32_t ct = 0; ct < Buckets; ++ct) {
+            seen += m_counts[ct];
+            if (seen >= rank) return std::min(highest(ct), m_max);
+        }
+        return m_max;
+    }
+
+    /// number of values in a bucket, and the range of values it counts
+    uint64_t bucket_count(uint32_t bucket) const { return m_counts[bucket]; }
+    static uint64_t lowest(uint32_t bucket)
+    {
+        if (bucket < SubBuckets) return bucket;
+        uint32_t shift = bucket / SubBuckets - 1;
+        return uint64_t(SubBuckets + bucket % SubBuckets) << shift;
+    }
+    static uint64_t highest(uint32_t bucket)
+    {
+        uint32_t shift = bucket < SubBuckets ? 0 : bucket / SubBuckets - 1;
+        return lowest(bucket) + (uint64_t(1) << shift) - 1;
+    }
+
+    /// the distribution as a table in the format of HdrHistogram, with the values
+    /// divided by unit (1000 prints microseconds as milliseconds)
+    std::string distribution(double unit = 1000, const std::string& unit_name = "ms") const
+    {
+        std::string table = fmt::format("{0:>12} {1:>12} {2:>12} {3:>16}\n", "Value(" + unit_name + ")", "Percentile", "TotalCount", "1/(1-Percentile)");
+        uint64_t seen = 0;
+        for (uint32_t bucket = 0; bucket < Buckets; ++bucket) {
+            if (!m_counts[bucket]) continue;
+            seen += m_counts[bucket];
+            double fraction = double(seen) / m_total;
+            std::string inverse = seen < m_total ? fmt::format("{0:.2f}", 1 / (1 - fraction)) : "inf";
+            table += fmt::format("{0:>12.3f} {1:>12.6f} {2:>12} {3:>16}\n", std::min(highest(bucket), m_max) / unit, fraction, seen, inverse);
+        }
+        return table;
+    }
+
+    static uint32_t index(uint64_t value)
+    {
+        if (value < SubBuckets) return static_cast<uint32_t>(value);
+        uint32_t msb = 63 - __builtin_clzll(value);
+        uint32_t shift = msb - SubBits;
+        return (shift + 1) * SubBuckets + static_cast<uint32_t>((value >> shift) - SubBuckets);
+    }
+
+private:
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = MaxValue;
+    uint64_t m_max = 0;
+};
+
+}
+
+#endif /* histogram_hpp */
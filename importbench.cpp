@@ -0,0 +1,197 @@
+//
+//  importbench.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "importbench.hpp"
+#include "decompressor.hpp"
+#include "untar.hpp"
+#include "diskrecord.hpp"
+#include "cddbupdater.hpp"
+#include "cddbexception.hpp"
+#include "helper.hpp"
+#include "arena.hpp"
+#include "format.hpp"
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
+
+
+using namespace CDDB;
+
+
+static const char* stage_names[] = { "", "decompress", "untar", "parse", "dedup", "sql" };
+
+ImportBenchmark::Stage ImportBenchmark::stage(const std::string& name)
+{
+    for (int stage = Decompress; stage <= SQL; ++stage) {
+        if (name == stage_names[stage]) return static_cast<Stage>(stage);
+    }
+    throw CDDBException(fmt::format("unknown import stage '{0}', use decompress, untar, parse, dedup or sql", name));
+}
+
+ImportBenchmark::ImportBenchmark(const std::string& importfile, const std::string& database)
+: m_importfile(importfile)
+, m_database(database + ".bench")
+{
+    if (importfile.empty() || importfile == "-") throw CDDBException("the import benchmark needs an import file, it reads it several times");
+}
+
+ImportBenchmark::result_t ImportBenchmark::decompress()
+{
+    result_t result;
+    Duration duration;
+
+    std::unique_ptr<Decompressor> input = Decompressor::open(m_importfile);
+    std::vector<char> buffer(256 * 1024);
+    ssize_t rb;
+    while ((rb = input->read(buffer.data(), buffer.size())) > 0) result.bytes += rb;
+
+    duration.lap();
+    result.nanoseconds = duration.get();
+    return result;
+}
+
+ImportBenchmark::result_t ImportBenchmark::untar()
+{
+    result_t result;
+    Duration duration;
+
+    UnTar tar(m_importfile);
+    StringView data;
+    while (tar.entry(data, TarHeader::File, true) != TarHeader::Unknown) ++result.records;
+    result.bytes = tar.offset();
+
+    duration.lap();
+    result.nanoseconds = duration.get();
+    return result;
+}
+
+ImportBenchmark::result_t ImportBenchmark::parse(bool dedup)
+{
+    result_t result;
+    Duration duration;
+
+    uint64_t invalid = 0;
+    std::unordered_set<uint32_t> hashes;
+    std::unordered_map<uint32_t, uint32_t> discids;
+    uint64_t hash_duplicates = 0;
+    uint64_t discid_collisions = 0;
+
+    UnTar tar(m_importfile);
+    StringView data;
+    while (tar.entry(data, TarHeader::File, true) != TarHeader::Unknown) {
+        ++result.records;
+        DiskRecord rec(data);
+        if (!rec.valid()) {
+            ++invalid;
+            continue;
+        }
+        if (!dedup) continue;
+        // the same decisions as the updater takes first, without the SQL
+        if (!hashes.insert(rec.normalized_hash()).second) ++hash_duplicates;
+        if (!discids.emplace(rec.discid(), rec.normalized_hash()).second) ++discid_collisions;
+        rec.fuzzy_discid();
+    }
+    result.bytes = tar.offset();
+
+    duration.lap();
+    result.nanoseconds = duration.get();
+
+    result.remark = fmt::format("{0} invalid", invalid);
+    if (dedup) result.remark += fmt::format(", {0} hash duplicates, {1} discid collisions", hash_duplicates, discid_collisions);
+    return result;
+}
+
+ImportBenchmark::result_t ImportBenchmark::sql()
+{
+    result_t result;
+
+    ::unlink(m_database.c_str());
+
+    {
+        CDDBSQLUpdater updater(m_database);
+        updater.set_checkpoint_interval(0);
+
+        Duration duration;
+        updater.import(m_importfile, true);
+        duration.lap();
+        result.nanoseconds = duration.get();
+    }
+
+    ::unlink(m_database.c_str());
+
+    return result;
+}
+
+void ImportBenchmark::run(Stage last)
+{
+    std::vector<result_t> results;
+
+    for (int stage = Decompress; stage <= last; ++stage) {
+        std::cout << fmt::format("running stage {0}", stage_names[stage]) << std::endl;
+        switch (stage) {
+            case Decompress: results.push_back(decompress()); break;
+            case Untar:      results.push_back(untar()); break;
+            case Parse:      results.push_back(parse(false)); break;
+            case Dedup:      results.push_back(parse(true)); break;
+            case SQL:        results.push_back(sql()); break;
+        }
+    }
+
+    // the import does not return its counts, they are the same as in the earlier stages
+    uint64_t bytes = results.front().bytes;
+    uint64_t records = results.size() > 1 ? results[1].records : 0;
+
+    std::cout << std::endl;
+    std::cout << fmt::format("{0} - {1} MB uncompressed, {2} records", m_importfile, bytes / (1024 * 1024), records) << std::endl;
+    std::cout << fmt::format("{0:<12} {1:>12} {2:>12} {3:>12} {4:>12}", "stage", "time", "MB/s", "records/s", "stage adds") << std::endl;
+
+    uint64_t previous = 0;
+    for (std::size_t ct = 0; ct < results.size(); ++ct) {
+        const result_t& result = results[ct];
+        uint64_t nanoseconds = std::max<uint64_t>(1, result.nanoseconds);
+        std::string rps = records ? std::to_string(records * 1000000000 / nanoseconds) : "-";
+        uint64_t adds = result.nanoseconds > previous ? result.nanoseconds - previous : 0;
+        std::cout << fmt::format("{0:<12} {1:>12} {2:>12.1f} {3:>12} {4:>12}",
+                                 stage_names[ct + 1],
+                                 Duration::to_string(result.nanoseconds, Duration::Precision::Milliseconds),
+                                 static_cast<double>(bytes) * 1000 / nanoseconds / 1.048576,
+                                 rps,
+                                 Duration::to_string(adds, Duration::Precision::Milliseconds));
+        if (!result.remark.empty()) std::cout << "  (" << result.remark << ")";
+        std::cout << std::endl;
+        previous = result.nanoseconds;
+    }
+
+    // the stages parse in this thread, except for the import with worker threads
+    if (Arena* arena = Arena::local()) {
+        std::cout << fmt::format("arena: {0} allocations from {1} heap blocks", arena->allocations(), arena->blocks()) << std::endl;
+    } else {
+        std::cout << "arena: disabled" << std::endl;
+    }
+}
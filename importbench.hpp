@@ -0,0 +1,83 @@
+//
+//  importbench.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef importbench_hpp_QPWOEIRUTYALSKDJFHGZMXNCBVQPWOEIRUT
+#define importbench_hpp_QPWOEIRUTYALSKDJFHGZMXNCBVQPWOEIRUT
+
+#include <cinttypes>
+#include <string>
+
+
+namespace CDDB {
+
+/// Measures where the time of an import goes. The pipeline is run once per
+/// stage, each time up to that stage only: the last stage writes a complete
+/// database, but into a scratch file next to the database, which is removed.
+
+class ImportBenchmark {
+public:
+    enum Stage {
+        // decompress only
+        Decompress = 1,
+        // plus splitting the tar stream into files
+        Untar,
+        // plus parsing and cleaning up the xmcd records
+        Parse,
+        // plus computing the hashes and discids, and finding duplicates in memory
+        Dedup,
+        // the complete import
+        SQL
+    };
+
+    ImportBenchmark(const std::string& importfile, const std::string& database);
+
+    /// runs the stages up to last, and prints their throughput
+    void run(Stage last = SQL);
+
+    /// the stage for a name as on the command line, throws if unknown
+    static Stage stage(const std::string& name);
+
+private:
+    struct result_t {
+        uint64_t bytes = 0;
+        uint64_t records = 0;
+        uint64_t nanoseconds = 0;
+        std::string remark;
+    };
+
+    result_t decompress();
+    result_t untar();
+    result_t parse(bool dedup);
+    result_t sql();
+
+    std::string m_importfile;
+    std::string m_database;
+};
+
+}
+
+#endif /* importbench_hpp */
@@ -26,8 +26,13 @@
 
 #include <iostream>
 #include <unistd.h>
+#include <getopt.h>
 #include "cddbupdater.hpp"
 #include "cddbserver.hpp"
+#include "importbench.hpp"
+#include "arena.hpp"
+#include "trace.hpp"
+#include "cddbexception.hpp"
 #include "format.hpp"
 #include "helper.hpp"
 
@@ -42,17 +47,57 @@ int main(int argc, char *argv[]) {
 
         std::string database = "cddb.sqlite";
         std::string importfile;
-        std::string updatefile;
+        std::vector<std::string> updatefiles;
         uint16_t port = 8880;
         bool expect_http = true;
         bool print_protocol = false;
+        std::string capturefile;
+        std::string accesslog;
+        std::string slowlog;
+        uint32_t slow_threshold = 10;
+        bool prefetch = false;
+        std::string tracefile;
         uint16_t max_diff = 4;
+        uint64_t checkpoint_interval = 100000;
+        bool resume = false;
+        bool restart = false;
+        bool serve = true;
+        uint32_t threads = 1;
+        bool staged = false;
+        bool bench_import = false;
+        CDDB::ImportBenchmark::Stage bench_stage = CDDB::ImportBenchmark::SQL;
 
         {
+            static const struct option long_options[] = {
+                { "resume", no_argument, nullptr, 'r' },
+                { "restart", no_argument, nullptr, 'R' },
+                { "no-server", no_argument, nullptr, 'N' },
+                { "staged", no_argument, nullptr, 's' },
+                { "bench-import", optional_argument, nullptr, 'b' },
+                { "no-arena", no_argument, nullptr, 'n' },
+                { "capture", required_argument, nullptr, 'C' },
+                { "access-log", required_argument, nullptr, 'a' },
+                { "slow-log", required_argument, nullptr, 'L' },
+                { "slow-threshold", required_argument, nullptr, 'T' },
+                { "prefetch", no_argument, nullptr, 'P' },
+                { "trace", required_argument, nullptr, 't' },
+                { nullptr, 0, nullptr, 0 }
+            };
+
             int opt;
 
-            while ((opt = ::getopt(argc, argv, "cd:f:i:hp:u:v")) != -1) {
+            while ((opt = ::getopt_long(argc, argv, "cd:f:i:hj:k:p:u:v", long_options, nullptr)) != -1) {
                 switch (opt) {
+                    case 'a':
+                        accesslog = optarg;
+                        break;
+                    case 'b':
+                        bench_import = true;
+                        if (optarg) bench_stage = CDDB::ImportBenchmark::stage(optarg);
+                        break;
+                    case 'C':
+                        capturefile = optarg;
+                        break;
                     case 'c':
                         expect_http = false;
                         break;
@@ -70,19 +115,73 @@ int main(int argc, char *argv[]) {
                         std::cout << " -d file  : database file (default 'cddb.sqlite')" << std::endl;
                         std::cout << " -f sec   : difference in seconds to allow for relaxed track matching (1..8)" << std::endl;
                         std::cout << " -i file  : import from file ('-' for stdin)" << std::endl;
+                        std::cout << " -j count : import with count threads into an empty database (no checkpoints)," << std::endl;
+                        std::cout << "            or read ahead count archives of an update" << std::endl;
+                        std::cout << " -k count : commit an import every count records to be able to resume it (default 100000, 0 = never)" << std::endl;
                         std::cout << " -p port  : CDDB port to use (default 8880)" << std::endl;
-                        std::cout << " -u file  : update from file ('-' for stdin)" << std::endl;
-                        std::cout << " -v       : print protocol log on stderr" << std::endl;
+                        std::cout << " -u file  : update from file ('-' for stdin) or all files in a directory, repeat for" << std::endl;
+                        std::cout << "            several archives, which are applied in the given order" << std::endl;
+                        std::cout << " -v       : print protocol log on stderr (written by a background thread, lines may be dropped under load)" << std::endl;
+                        std::cout << " --resume : continue an interrupted import or update at its last checkpoint" << std::endl;
+                        std::cout << " --restart : empty the database before the -i import, to start an interrupted import over" << std::endl;
+                        std::cout << " --staged : import into an empty database by staging all records first (no checkpoints)" << std::endl;
+                        std::cout << " --bench-import[=stage] : measure the import of the -i file up to stage decompress, untar," << std::endl;
+                        std::cout << "            parse, dedup or sql (default), without touching the database, and exit" << std::endl;
+                        std::cout << " --capture file : record connections and requests with timestamps into file, for cppcddb-replay" << std::endl;
+                        std::cout << " --access-log file : append client, command, reply code and latency of every request to file ('-' for stderr)" << std::endl;
+                        std::cout << " --slow-log file : append the requests slower than the threshold to file ('-' for stderr), with" << std::endl;
+                        std::cout << "            candidates, rows read and the time of each stage" << std::endl;
+                        std::cout << " --slow-threshold ms : the threshold of the slow log (default 10)" << std::endl;
+                        std::cout << " --prefetch : read the CD of an exact query result ahead on a worker thread, for the" << std::endl;
+                        std::cout << "            cddb read that usually follows (one more database connection)" << std::endl;
+                        std::cout << " --trace file : write the trace spans of an import or update into file, as Chrome" << std::endl;
+                        std::cout << "            trace events (needs a build with TRACE=1, the server returns them on GET /trace)" << std::endl;
+                        std::cout << " --no-server : exit after the import or update instead of starting the server" << std::endl;
+                        std::cout << " --no-arena : allocate the temporaries of record parsing from the heap (for comparisons)" << std::endl;
                         std::cout << std::endl;
                         exit(0);
                     case 'i':
                         importfile = optarg;
                         break;
+                    case 'j':
+                        threads = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 'k':
+                        checkpoint_interval = ::strtoull(optarg, nullptr, 10);
+                        break;
+                    case 'L':
+                        slowlog = optarg;
+                        break;
+                    case 'N':
+                        serve = false;
+                        break;
+                    case 'n':
+                        CDDB::Arena::set_enabled(false);
+                        break;
+                    case 'P':
+                        prefetch = true;
+                        break;
                     case 'p':
                         port = ::strtoul(optarg, nullptr, 10);
                         break;
+                    case 'r':
+                        resume = true;
+                        break;
+                    case 'R':
+                        restart = true;
+                        break;
+                    case 's':
+                        staged = true;
+                        break;
+                    case 'T':
+                        slow_threshold = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 't':
+                        if (!CDDB::Trace::enabled) throw CDDB::CDDBException("--trace needs a build with TRACE=1");
+                        tracefile = optarg;
+                        break;
                     case 'u':
-                        updatefile = optarg;
+                        updatefiles.push_back(optarg);
                         break;
                     case 'v':
                         print_protocol = true;
@@ -91,29 +190,58 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        if (restart && (importfile.empty() || resume)) {
+            throw CDDB::CDDBException("--restart needs an import with -i and cannot be combined with --resume");
+        }
+
+        if (bench_import) {
+
+            CDDB::ImportBenchmark benchmark(importfile, database);
+            benchmark.run(bench_stage);
+
+            return 0;
+        }
+
         if (!importfile.empty()) {
 
             // create the CDDB updater object
             CDDB::CDDBSQLUpdater cddbupdater(database);
 
+            cddbupdater.set_checkpoint_interval(checkpoint_interval);
+
+            if (restart) cddbupdater.restart();
+
             // check if we shall import some data
-            cddbupdater.import(importfile, true);
+            if (staged || (threads > 1 && !resume)) cddbupdater.import_staged(importfile, threads);
+            else cddbupdater.import(importfile, true, resume);
 
         }
 
-        if (!updatefile.empty()) {
+        if (!updatefiles.empty()) {
 
             // create the CDDB updater object
             CDDB::CDDBSQLUpdater cddbupdater(database);
 
             // check if there are update data to an existing database
             // (import and update only differ by the latter keeping the indexes up during import)
-            cddbupdater.import(updatefile, false);
+            cddbupdater.set_checkpoint_interval(checkpoint_interval);
+
+            std::vector<std::string> files = CDDB::CDDBSQLUpdater::update_files(updatefiles);
+            if (files.size() == 1) cddbupdater.import(files.front(), false, resume);
+            else if (!files.empty()) cddbupdater.update(files, threads, resume);
 
         }
 
+        if (!tracefile.empty() && (!importfile.empty() || !updatefiles.empty())) CDDB::Trace::write(tracefile);
+
+        if (!serve) return 0;
+
         // construct a cddb server
         CDDB::CDDBSQLServer cddbserver(database, port, expect_http, print_protocol, max_diff);
+        if (!capturefile.empty()) cddbserver.capture_protocol(capturefile);
+        if (!accesslog.empty()) cddbserver.access_log(accesslog);
+        if (!slowlog.empty()) cddbserver.slow_log(slowlog, slow_threshold);
+        if (prefetch) cddbserver.enable_prefetch();
 
         // and run it with 30 seconds IO timeout, in blocking mode
         cddbserver.start(30, true);
@@ -0,0 +1,234 @@
+//
+//  metrics.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <mutex>
+#include <vector>
+#include <memory>
+#include "metrics.hpp"
+#include "format.hpp"
+
+
+using namespace CDDB;
+
+
+namespace {
+
+struct CounterInfo {
+    const char* name;
+    const char* labels;
+    const char* help;
+};
+
+// series of the same name have to follow each other
+const CounterInfo counter_info[Metrics::Counters] = {
+    { "cddb_connections_total", "", "Connections accepted." },
+    { "cddb_connections_closed_total", "", "Connections closed." },
+    { "cddb_commands_total", "command=\"hello\"", "CDDB commands by type." },
+    { "cddb_commands_total", "command=\"proto\"", nullptr },
+    { "cddb_commands_total", "command=\"query\"", nullptr },
+    { "cddb_commands_total", "command=\"read\"", nullptr },
+    { "cddb_commands_total", "command=\"lscat\"", nullptr },
+    { "cddb_commands_total", "command=\"stat\"", nullptr },
+    { "cddb_commands_total", "command=\"ver\"", nullptr },
+    { "cddb_commands_total", "command=\"quit\"", nullptr },
+    { "cddb_commands_total", "command=\"other\"", nullptr },
+    { "cddb_http_requests_total", "", "CDDB requests over HTTP." },
+    { "cddb_metrics_requests_total", "", "Requests of the metrics." },
+    { "cddb_queries_total", "result=\"exact\"", "Queries by result." },
+    { "cddb_queries_total", "result=\"exact_multiple\"", nullptr },
+    { "cddb_queries_total", "result=\"fuzzy\"", nullptr },
+    { "cddb_queries_total", "result=\"miss\"", nullptr },
+    { "cddb_reads_total", "result=\"found\"", "Reads by result." },
+    { "cddb_reads_total", "result=\"missing\"", nullptr },
+    { "cddb_log_dropped_total", "", "Log records dropped because the log could not keep up." },
+    { "cddb_prefetch_issued_total", "", "Reads rendered ahead after a query." },
+    { "cddb_prefetch_hits_total", "", "Reads answered from a prefetch." },
+    { "cddb_prefetch_wasted_total", "", "Prefetches that were not read." },
+    { "cddb_coalesced_total", "command=\"query\"", "Requests answered by the same request of another client." },
+    { "cddb_coalesced_total", "command=\"read\"", nullptr },
+};
+
+struct DistributionInfo {
+    const char* name;
+    const char* labels;
+    const char* help;
+    // divisor for the Prometheus unit, 1000000 for microseconds in seconds
+    double unit;
+};
+
+const DistributionInfo distribution_info[Metrics::Distributions] = {
+    { "cddb_request_duration_seconds", "command=\"query\"", "Time to answer a CDDB command.", 1000000 },
+    { "cddb_request_duration_seconds", "command=\"read\"", nullptr, 1000000 },
+    { "cddb_request_duration_seconds", "command=\"other\"", nullptr, 1000000 },
+    { "cddb_sqlite_duration_seconds", "", "Time in SQLite per query or read.", 1000000 },
+    { "cddb_format_duration_seconds", "", "Time to format the reply of a query or read.", 1000000 },
+    { "cddb_query_candidates", "", "CDs compared with the TOC of a query.", 1 },
+};
+
+/// a number with up to 6 decimals, enough for microseconds in seconds
+std::string number(double value)
+{
+    std::string str = fmt::format("{0:.6f}", value);
+    str.erase(str.find_last_not_of('0') + 1);
+    if (str.back() == '.') str.pop_back();
+    return str;
+}
+
+std::string labels(const char* labels, const std::string& more = std::string())
+{
+    std::string all = labels;
+    if (!more.empty()) {
+        if (!all.empty()) all += ',';
+        all += more;
+    }
+    return all.empty() ? all : "{" + all + "}";
+}
+
+}
+
+
+struct Metrics::Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<Shard*> unused;
+
+    static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+};
+
+/// returns the shard of a thread to the registry when the thread ends
+struct Metrics::ShardHolder {
+    Shard* shard = nullptr;
+
+    ~ShardHolder()
+    {
+        if (!shard) return;
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.unused.push_back(shard);
+    }
+};
+
+Metrics::Shard::Shard()
+{
+    for (auto& counter : counters) counter.store(0, std::memory_order_relaxed);
+    for (auto& distribution : distributions) {
+        for (auto& bucket : distribution.buckets) bucket.store(0, std::memory_order_relaxed);
+        distribution.count.store(0, std::memory_order_relaxed);
+        distribution.sum.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Metrics::Shard::record(Distribution distribution, uint64_t value)
+{
+    // the smallest n with value <= 2^n
+    uint32_t bucket = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+    if (bucket >= Buckets) bucket = Buckets - 1;
+    Histogram& histogram = distributions[distribution];
+    increment(histogram.buckets[bucket], 1);
+    increment(histogram.count, 1);
+    increment(histogram.sum, value);
+}
+
+Metrics::Shard& Metrics::local()
+{
+    static thread_local ShardHolder holder;
+
+    if (!holder.shard) {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (!registry.unused.empty()) {
+            holder.shard = registry.unused.back();
+            registry.unused.pop_back();
+        } else {
+            registry.shards.push_back(std::make_unique<Shard>());
+            holder.shard = registry.shards.back().get();
+        }
+    }
+
+    return *holder.shard;
+}
+
+Metrics::Snapshot Metrics::collect()
+{
+    Snapshot snapshot;
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for (const auto& shard : registry.shards) {
+        for (uint32_t ct = 0; ct < Counters; ++ct) {
+            snapshot.counters[ct] += shard->counters[ct].load(std::memory_order_relaxed);
+        }
+        for (uint32_t ct = 0; ct < Distributions; ++ct) {
+            const auto& from = shard->distributions[ct];
+            auto& to = snapshot.distributions[ct];
+            for (uint32_t bucket = 0; bucket < Buckets; ++bucket) to.buckets[bucket] += from.buckets[bucket].load(std::memory_order_relaxed);
+            to.count += from.count.load(std::memory_order_relaxed);
+            to.sum += from.sum.load(std::memory_order_relaxed);
+        }
+    }
+
+    return snapshot;
+}
+
+std::string Metrics::prometheus(const char* name, const char* type, const char* help, uint64_t value)
+{
+    return fmt::format("# HELP {0} {1}\n# TYPE {0} {2}\n{0} {3}\n", name, help, type, value);
+}
+
+std::string Metrics::prometheus(const Snapshot& snapshot)
+{
+    std::string text;
+
+    for (uint32_t ct = 0; ct < Counters; ++ct) {
+        const auto& info = counter_info[ct];
+        if (info.help) text += fmt::format("# HELP {0} {1}\n# TYPE {0} counter\n", info.name, info.help);
+        text += fmt::format("{0}{1} {2}\n", info.name, labels(info.labels), snapshot.counters[ct]);
+    }
+
+    text += prometheus("cddb_connections", "gauge", "Open connections.", snapshot.connections());
+
+    for (uint32_t ct = 0; ct < Distributions; ++ct) {
+        const auto& info = distribution_info[ct];
+        const auto& histogram = snapshot.distributions[ct];
+        if (info.help) text += fmt::format("# HELP {0} {1}\n# TYPE {0} histogram\n", info.name, info.help);
+        // Prometheus buckets are cumulative
+        uint64_t cumulated = 0;
+        for (uint32_t bucket = 0; bucket < Buckets - 1; ++bucket) {
+            cumulated += histogram.buckets[bucket];
+            text += fmt::format("{0}_bucket{1} {2}\n", info.name,
+                                labels(info.labels, "le=\"" + number((uint64_t(1) << bucket) / info.unit) + "\""), cumulated);
+        }
+        text += fmt::format("{0}_bucket{1} {2}\n", info.name, labels(info.labels, "le=\"+Inf\""), histogram.count);
+        text += fmt::format("{0}_sum{1} {2}\n", info.name, labels(info.labels), number(histogram.sum / info.unit));
+        text += fmt::format("{0}_count{1} {2}\n", info.name, labels(info.labels), histogram.count);
+    }
+
+    return text;
+}
@@ -0,0 +1,161 @@
+//
+//  metrics.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef metrics_hpp_ZXCVBNMASDFGHJKLQWERTYUIOPLKJHGFDSA
+#define metrics_hpp_ZXCVBNMASDFGHJKLQWERTYUIOPLKJHGFDSA
+
+#include <cinttypes>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+
+namespace CDDB {
+
+/// Counters and histograms of the server. Every thread counts into its own
+/// shard, with relaxed atomic stores that no other thread writes, so counting
+/// takes no lock and shares no cache line. collect() sums the shards. The
+/// shards of finished threads are handed to the next thread, as the server
+/// runs a thread per connection.
+
+class Metrics {
+public:
+    enum Counter {
+        ConnectionsOpened = 0,
+        ConnectionsClosed,
+        CommandHello,
+        CommandProto,
+        CommandQuery,
+        CommandRead,
+        CommandLscat,
+        CommandStat,
+        CommandVer,
+        CommandQuit,
+        CommandOther,
+        HttpRequests,
+        MetricsRequests,
+        QueryExact,
+        QueryExactMultiple,
+        QueryFuzzy,
+        QueryMiss,
+        ReadFound,
+        ReadMissing,
+        LogRecordsDropped,
+        PrefetchIssued,
+        PrefetchHits,
+        PrefetchWasted,
+        QueriesCoalesced,
+        ReadsCoalesced,
+        Counters
+    };
+
+    /// latencies are in microseconds
+    enum Distribution {
+        LatencyQuery = 0,
+        LatencyRead,
+        LatencyOther,
+        SQLiteTime,
+        FormatTime,
+        QueryCandidates,
+        Distributions
+    };
+
+    /// bucket n counts the values up to 2^n, the last one all larger values
+    enum : uint32_t { Buckets = 28 };
+
+    struct Snapshot {
+        struct Histogram {
+            uint64_t buckets[Buckets] = {};
+            uint64_t count = 0;
+            uint64_t sum = 0;
+        };
+        uint64_t counters[Counters] = {};
+        Histogram distributions[Distributions];
+
+        uint64_t connections() const { return counters[ConnectionsOpened] - counters[ConnectionsClosed]; }
+    };
+
+    static void add(Counter counter, uint64_t value = 1) { local().add(counter, value); }
+    static void record(Distribution distribution, uint64_t value) { local().record(distribution, value); }
+
+    static Snapshot collect();
+    /// the snapshot in the Prometheus text format
+    static std::string prometheus(const Snapshot& snapshot);
+    /// one more metric without labels in the Prometheus text format
+    static std::string prometheus(const char* name, const char* type, const char* help, uint64_t value);
+
+    /// records the microseconds from construction to stop() or destruction
+    class Timer {
+    public:
+        Timer(Distribution distribution)
+        : m_distribution(distribution)
+        , m_start(std::chrono::steady_clock::now()) {}
+        ~Timer() { stop(); }
+
+        void stop()
+        {
+            if (m_stopped) return;
+            m_stopped = true;
+            record(m_distribution, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count());
+        }
+
+    private:
+        Distribution m_distribution;
+        std::chrono::steady_clock::time_point m_start;
+        bool m_stopped = false;
+    };
+
+private:
+    struct Shard {
+        struct Histogram {
+            std::atomic<uint64_t> buckets[Buckets];
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> sum;
+        };
+        std::atomic<uint64_t> counters[Counters];
+        Histogram distributions[Distributions];
+
+        Shard();
+
+        // only the owning thread writes, so a load and a store suffice
+        static void increment(std::atomic<uint64_t>& value, uint64_t add)
+        {
+            value.store(value.load(std::memory_order_relaxed) + add, std::memory_order_relaxed);
+        }
+
+        void add(Counter counter, uint64_t value) { increment(counters[counter], value); }
+        void record(Distribution distribution, uint64_t value);
+    };
+
+    struct Registry;
+    struct ShardHolder;
+
+    static Shard& local();
+};
+
+}
+
+#endif /* metrics_hpp */
@@ -0,0 +1,151 @@
+//
+//  prefetch.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "prefetch.hpp"
+#include "metrics.hpp"
+#include <iostream>
+
+
+using namespace CDDB;
+
+
+Prefetcher::Slot::~Slot()
+{
+    if (m_state == Queued || m_state == Done) Metrics::add(Metrics::PrefetchWasted);
+}
+
+Prefetcher::Prefetcher(const std::string& dbname, std::size_t capacity)
+: m_sql(dbname, SQLITE_OPEN_READONLY, 1000) // set busy timeout to 1000ms
+, m_reader(m_sql)
+, m_capacity(capacity)
+, m_worker(&Prefetcher::work, this)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_not_empty.notify_one();
+    m_worker.join();
+}
+
+void Prefetcher::prefetch(const std::shared_ptr<Slot>& slot, uint32_t discid)
+{
+    bool queued;
+    {
+        std::lock_guard<std::mutex> lock(slot->m_mutex);
+        if (slot->m_state != Slot::Idle) Metrics::add(Metrics::PrefetchWasted);
+        // a slot that is still queued is not queued twice, and a running
+        // read is discarded by the worker when it sees the new state
+        queued = slot->m_state == Slot::Queued;
+        slot->m_state = Slot::Queued;
+        slot->m_discid = discid;
+        slot->m_file.clear();
+    }
+
+    if (!queued) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_capacity) {
+            lock.unlock();
+            std::lock_guard<std::mutex> slotlock(slot->m_mutex);
+            slot->m_state = Slot::Idle;
+            return;
+        }
+        m_queue.push_back(slot);
+    }
+    m_not_empty.notify_one();
+
+    Metrics::add(Metrics::PrefetchIssued);
+}
+
+bool Prefetcher::take(Slot& slot, uint32_t discid, std::string& file)
+{
+    std::unique_lock<std::mutex> lock(slot.m_mutex);
+    slot.m_done.wait(lock, [&slot, discid]{ return slot.m_state != Slot::Running || slot.m_discid != discid; });
+
+    if (slot.m_state == Slot::Done && slot.m_discid == discid) {
+        file = std::move(slot.m_file);
+        slot.m_state = Slot::Idle;
+        Metrics::add(Metrics::PrefetchHits);
+        return true;
+    }
+
+    if (slot.m_state != Slot::Idle) Metrics::add(Metrics::PrefetchWasted);
+    slot.m_state = Slot::Idle;
+    return false;
+}
+
+void Prefetcher::work()
+{
+    for (;;) {
+        std::shared_ptr<Slot> slot;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [this]{ return m_quit || !m_queue.empty(); });
+            if (m_quit) return;
+            slot = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        uint32_t discid;
+        {
+            std::lock_guard<std::mutex> lock(slot->m_mutex);
+            // cancelled by a read of another discid
+            if (slot->m_state != Slot::Queued) continue;
+            slot->m_state = Slot::Running;
+            discid = slot->m_discid;
+        }
+
+        std::string file;
+        bool failed = false;
+        try {
+            auto rec = m_reader.read(discid);
+            if (rec) file = rec->cddb_file();
+        } catch (std::exception& e) {
+            // e.g. busy while an update writes, the session then reads by itself
+            std::cerr << "prefetch exception: " << e.what() << std::endl;
+            failed = true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(slot->m_mutex);
+            // else a new prefetch or a read of another discid came in meanwhile
+            if (slot->m_state == Slot::Running && slot->m_discid == discid) {
+                if (failed) {
+                    slot->m_state = Slot::Idle;
+                } else {
+                    slot->m_file = std::move(file);
+                    slot->m_state = Slot::Done;
+                }
+            }
+        }
+        slot->m_done.notify_all();
+    }
+}
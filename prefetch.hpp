@@ -0,0 +1,95 @@
+//
+//  prefetch.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef prefetch_hpp_ZUHBVGZTFCXDRESYXNJUHBGVFTZRCDXESYN
+#define prefetch_hpp_ZUHBVGZTFCXDRESYXNJUHBGVFTZRCDXESYN
+
+#include <cinttypes>
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "sqlitecpp/SQLiteCpp.h"
+#include "cdreader.hpp"
+
+
+namespace CDDB {
+
+/// Renders the cddb read of a query result ahead of time. Clients follow a
+/// query that found a CD with a read of it, so after such a query the session
+/// hands the discid to the worker thread, which reads the CD on a connection
+/// of its own and leaves the file in the slot of the session. The read takes
+/// it from there, and only falls back to the database if the slot holds
+/// another discid. A full queue skips the prefetch rather than waiting.
+
+class Prefetcher {
+public:
+    /// the prefetch of one session
+    class Slot {
+    public:
+        ~Slot();
+    private:
+        friend class Prefetcher;
+        enum State { Idle, Queued, Running, Done };
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+        State m_state = Idle;
+        uint32_t m_discid = 0;
+        std::string m_file;
+    };
+
+    Prefetcher(const std::string& dbname, std::size_t capacity = 256);
+    ~Prefetcher();
+
+    /// queue the read of discid into slot, what the slot held before is discarded
+    void prefetch(const std::shared_ptr<Slot>& slot, uint32_t discid);
+    /// moves the file of discid out of slot, waiting if the worker is reading it.
+    /// Returns false if the slot does not hold discid (a queued read is then
+    /// cancelled), file is then unchanged.
+    bool take(Slot& slot, uint32_t discid, std::string& file);
+
+private:
+    SQLite::Database m_sql;
+    CDReader m_reader;
+    std::size_t m_capacity;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::deque<std::shared_ptr<Slot>> m_queue;
+    bool m_quit = false;
+    std::thread m_worker;
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    void work();
+};
+
+}
+
+#endif /* prefetch_hpp */
@@ -0,0 +1,88 @@
+//
+//  singleflight.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef singleflight_hpp_KDJFHGLSKDJFHGLSKDJHFGLKSJDHFGLKSJ
+#define singleflight_hpp_KDJFHGLSKDJFHGLSKDJHFGLKSJDHFGLKSJ
+
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+
+
+namespace CDDB {
+
+/// Coalesces concurrent computations of the same key. The first caller of
+/// run() for a key computes the value, callers that come while it is still
+/// computing wait for it and get a copy of its value, or its exception. The
+/// key is forgotten when the value is ready, so nothing is cached.
+
+template <class Key, class Value, class Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    /// shared is set if the value was computed by another caller
+    template <class Function>
+    Value run(const Key& key, Function function, bool& shared)
+    {
+        std::promise<Value> promise;
+        std::shared_future<Value> flight;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_flights.find(key);
+            if (it != m_flights.end()) flight = it->second;
+            else m_flights.emplace(key, promise.get_future().share());
+        }
+
+        shared = flight.valid();
+        if (shared) return flight.get();
+
+        try {
+            Value value = function();
+            promise.set_value(value);
+            forget(key);
+            return value;
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            forget(key);
+            throw;
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    std::unordered_map<Key, std::shared_future<Value>, Hash> m_flights;
+
+    void forget(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flights.erase(key);
+    }
+};
+
+}
+
+#endif /* singleflight_hpp */
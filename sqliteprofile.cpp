@@ -0,0 +1,150 @@
+//
+//  sqliteprofile.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include "sqliteprofile.hpp"
+#include "helper.hpp"
+#include "format.hpp"
+
+
+using namespace CDDB;
+
+
+namespace {
+
+/// multi row inserts are named by their first row and the row count
+std::string statement_name(const char* sql)
+{
+    std::string name(sql);
+    auto values = name.find(" VALUES (");
+    if (values == std::string::npos) return name;
+    auto first = name.find(')', values);
+    std::size_t rows = 1;
+    for (auto pos = name.find("),(", first); pos != std::string::npos; pos = name.find("),(", pos + 3)) ++rows;
+    if (rows == 1) return name;
+    return fmt::format("{0}, ... ({1} rows)", name.substr(0, first + 1), rows);
+}
+
+}
+
+void SQLiteProfile::sample(const std::string& operation)
+{
+    sqlite3* db = m_sql.getHandle();
+
+    for (sqlite3_stmt* stmt = sqlite3_next_stmt(db, nullptr); stmt; stmt = sqlite3_next_stmt(db, stmt)) {
+        // the counters are 32 bit in SQLite, sample often enough to not let them wrap
+        uint32_t vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+        uint32_t runs = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_RUN, 1);
+        // statements that did not run since the last sample have nothing to add
+        if (!vm_steps && !runs) continue;
+        Statement& statement = m_statements[statement_name(sqlite3_sql(stmt))];
+        statement.runs += runs;
+        statement.vm_steps += vm_steps;
+        statement.fullscan_steps += static_cast<uint32_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1));
+        statement.sorts += static_cast<uint32_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1));
+        statement.autoindex_rows += static_cast<uint32_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1));
+    }
+
+    int hits = 0;
+    int misses = 0;
+    int highwater = 0;
+    sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 1);
+    sqlite3_db_status(db, SQLITE_DBSTATUS_CACHE_MISS, &misses, &highwater, 1);
+    if (hits || misses) {
+        Cache& cache = m_operations[operation];
+        cache.hits += static_cast<uint32_t>(hits);
+        cache.misses += static_cast<uint32_t>(misses);
+    }
+}
+
+namespace {
+
+std::string label(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (auto ch : value) {
+        if (ch == '\\' || ch == '"') escaped += '\\';
+        if (ch == '\n') escaped += "\\n";
+        else escaped += ch;
+    }
+    return escaped;
+}
+
+template <class Map, class Value>
+std::string metric(const Map& map, const char* name, const char* help, const char* key, Value value)
+{
+    std::string text = fmt::format("# HELP {0} {1}\n# TYPE {0} counter\n", name, help);
+    for (const auto& it : map) text += fmt::format("{0}{{{1}=\"{2}\"}} {3}\n", name, key, label(it.first), it.second.*value);
+    return text;
+}
+
+}
+
+std::string SQLiteProfile::prometheus() const
+{
+    std::string text;
+    text += metric(m_statements, "cddb_sqlite_statement_runs_total", "Runs of a prepared statement.", "statement", &Statement::runs);
+    text += metric(m_statements, "cddb_sqlite_statement_vm_steps_total", "Virtual machine steps of a prepared statement.", "statement", &Statement::vm_steps);
+    text += metric(m_statements, "cddb_sqlite_statement_fullscan_steps_total", "Steps of a prepared statement in full table scans.", "statement", &Statement::fullscan_steps);
+    text += metric(m_statements, "cddb_sqlite_statement_sorts_total", "Sort operations of a prepared statement.", "statement", &Statement::sorts);
+    text += metric(m_statements, "cddb_sqlite_statement_autoindex_rows_total", "Rows inserted into automatic indexes by a prepared statement.", "statement", &Statement::autoindex_rows);
+    text += metric(m_operations, "cddb_sqlite_cache_hits_total", "Pages found in the SQLite page cache.", "operation", &Cache::hits);
+    text += metric(m_operations, "cddb_sqlite_cache_misses_total", "Pages read into the SQLite page cache.", "operation", &Cache::misses);
+    return text;
+}
+
+std::string SQLiteProfile::report() const
+{
+    std::string report = "SQLite statements (runs, VM steps, full scan steps, sorts, automatic index rows):\n";
+    for (const auto& it : m_statements) {
+        const Statement& s = it.second;
+        report += fmt::format("    {0} {1} {2} {3} {4}: {5}\n", s.runs, s.vm_steps, s.fullscan_steps, s.sorts, s.autoindex_rows, it.first);
+    }
+    for (const auto& it : m_operations) {
+        report += fmt::format("SQLite page cache of {0}: {1} hits, {2} misses\n", it.first, it.second.hits, it.second.misses);
+    }
+    return report;
+}
+
+std::vector<std::string> SQLiteProfile::check_plans(const std::vector<const SQLite::Statement*>& statements) const
+{
+    std::vector<std::string> warnings;
+
+    for (const auto* statement : statements) {
+        SQLite::Statement plan(m_sql, "EXPLAIN QUERY PLAN " + statement->getQuery());
+        while (plan.executeStep()) {
+            // the last column describes the step, like "SEARCH DISCID USING INDEX discid_id_idx (discid=?)"
+            std::string detail = plan.getColumn(plan.getColumnCount() - 1).getText();
+            bool scan = begins_with(detail, "SCAN ") && detail.find(" USING ") == std::string::npos && detail != "SCAN CONSTANT ROW";
+            if (scan || detail.find("AUTOMATIC") != std::string::npos) {
+                warnings.push_back(fmt::format("no index used: {0} in \"{1}\"", detail, statement->getQuery()));
+            }
+        }
+    }
+
+    return warnings;
+}
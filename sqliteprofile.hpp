@@ -0,0 +1,86 @@
+//
+//  sqliteprofile.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef sqliteprofile_hpp_QMWNEBRVTCYXUZIOPALSKDJFHGQMWNEBRV
+#define sqliteprofile_hpp_QMWNEBRVTCYXUZIOPALSKDJFHGQMWNEBRV
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <map>
+#include "sqlitecpp/SQLiteCpp.h"
+
+
+namespace CDDB {
+
+/// Profiling counters of the statements of a SQLite connection. sample()
+/// adds the counters of all statements currently prepared on the connection,
+/// keyed by their SQL, and the page cache hits and misses since the last
+/// sample, keyed by the operation that caused them. Both are reset in SQLite,
+/// so that statements which are prepared for a single request are counted as
+/// well if the sample is taken before they are finalized. The class is not
+/// thread safe, call it under the lock that protects the connection.
+
+class SQLiteProfile {
+public:
+    struct Statement {
+        uint64_t runs = 0;
+        uint64_t vm_steps = 0;
+        uint64_t fullscan_steps = 0;
+        uint64_t sorts = 0;
+        uint64_t autoindex_rows = 0;
+    };
+    struct Cache {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    SQLiteProfile(SQLite::Database& sql) : m_sql(sql) {}
+
+    void sample(const std::string& operation);
+
+    const std::map<std::string, Statement>& statements() const { return m_statements; }
+    const std::map<std::string, Cache>& operations() const { return m_operations; }
+
+    /// the counters in the Prometheus text format
+    std::string prometheus() const;
+    /// the counters as a table for the import report
+    std::string report() const;
+
+    /// runs EXPLAIN QUERY PLAN for every statement and returns a warning for
+    /// each table it scans without an index, or with an automatic index
+    std::vector<std::string> check_plans(const std::vector<const SQLite::Statement*>& statements) const;
+
+private:
+    SQLite::Database& m_sql;
+    std::map<std::string, Statement> m_statements;
+    std::map<std::string, Cache> m_operations;
+};
+
+}
+
+#endif /* sqliteprofile_hpp */
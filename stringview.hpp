@@ -0,0 +1,109 @@
+//
+//  stringview.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef stringview_hpp_GHDSKJVBSDLKJCBHSDKJVBSLKDJVCSLKDJHV
+#define stringview_hpp_GHDSKJVBSDLKJCBHSDKJVBSLKDJVCSLKDJHV
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+
+namespace CDDB {
+
+/// A non-owning view on a range of chars, in the spirit of C++17's std::string_view,
+/// but usable with C++14. It is used to parse records in place in the tar buffer
+/// without copying every key and value into a std::string first.
+
+class StringView {
+public:
+    typedef char value_type;
+    typedef const char* iterator;
+    typedef const char* const_iterator;
+    typedef std::size_t size_type;
+    static const size_type npos = static_cast<size_type>(-1);
+
+    StringView() : m_data(nullptr), m_size(0) {}
+    StringView(const char* data, size_type size) : m_data(data), m_size(size) {}
+    StringView(const char* begin, const char* end) : m_data(begin), m_size(end - begin) {}
+    StringView(const char* str) : m_data(str), m_size(std::strlen(str)) {}
+    StringView(const std::string& str) : m_data(str.data()), m_size(str.size()) {}
+
+    const char* data() const { return m_data; }
+    size_type size() const { return m_size; }
+    size_type length() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+    char operator[](size_type pos) const { return m_data[pos]; }
+    char front() const { return m_data[0]; }
+    char back() const { return m_data[m_size - 1]; }
+
+    void remove_prefix(size_type n) { m_data += n; m_size -= n; }
+    void remove_suffix(size_type n) { m_size -= n; }
+
+    StringView substr(size_type pos, size_type len = npos) const
+    {
+        if (pos > m_size) pos = m_size;
+        return StringView(m_data + pos, std::min(len, m_size - pos));
+    }
+
+    size_type find(char ch, size_type pos = 0) const
+    {
+        if (pos >= m_size) return npos;
+        const void* p = std::memchr(m_data + pos, ch, m_size - pos);
+        return p ? static_cast<const char*>(p) - m_data : npos;
+    }
+
+    size_type find(const StringView& str, size_type pos = 0) const
+    {
+        if (str.empty()) return pos <= m_size ? pos : npos;
+        while ((pos = find(str.front(), pos)) != npos) {
+            if (m_size - pos < str.size()) return npos;
+            if (std::memcmp(m_data + pos, str.data(), str.size()) == 0) return pos;
+            ++pos;
+        }
+        return npos;
+    }
+
+    std::string to_string() const { return std::string(m_data, m_size); }
+
+    bool operator==(const StringView& other) const
+    {
+        return m_size == other.m_size && std::memcmp(m_data, other.m_data, m_size) == 0;
+    }
+
+    bool operator!=(const StringView& other) const { return !(*this == other); }
+
+private:
+    const char* m_data;
+    size_type m_size;
+};
+
+}
+
+#endif /* stringview_hpp */
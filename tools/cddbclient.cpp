@@ -0,0 +1,171 @@
+//
+//  cddbclient.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <cstring>
+#include <cstdlib>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "cddbclient.hpp"
+#include "../helper.hpp"
+#include "../format.hpp"
+#include "../cddbexception.hpp"
+
+
+using namespace CDDB;
+
+
+static int reply_code(const std::string& line)
+{
+    if (line.size() < 3) throw CDDBException("invalid reply: " + line);
+    return std::atoi(line.substr(0, 3).c_str());
+}
+
+CDDBClient::CDDBClient(const std::string& host, uint16_t port, uint32_t timeout_seconds)
+: m_host(host)
+{
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0 || !result) {
+        throw CDDBException(host + ": cannot resolve");
+    }
+    for (auto ai = result; ai; ai = ai->ai_next) {
+        m_socket = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (m_socket < 0) continue;
+        if (::connect(m_socket, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        ::close(m_socket);
+        m_socket = -1;
+    }
+    ::freeaddrinfo(result);
+    if (m_socket < 0) throw CDDBException(fmt::format("{0}:{1}: cannot connect: {2}", host, port, std::strerror(errno)));
+
+    int one = 1;
+    ::setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval timeout = { static_cast<time_t>(timeout_seconds), 0 };
+    ::setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+CDDBClient::~CDDBClient()
+{
+    ::close(m_socket);
+}
+
+void CDDBClient::handshake()
+{
+    send("cddb hello cppcddb localhost cppcddb-tools 1.0\n");
+    int code;
+    // the welcome message is only sent by servers started with -c
+    while ((code = reply_code(read_line())) == 201) {}
+    if (code != 200) throw CDDBException(fmt::format("handshake failed with {0}", code));
+    send("proto 6\n");
+    read_line();
+}
+
+int CDDBClient::request(const std::string& command)
+{
+    send(command + "\n");
+    return read_reply();
+}
+
+int CDDBClient::http_request(const std::string& command)
+{
+    std::string get = "GET /~cddb/cddb.cgi?cmd=";
+    for (auto ch : command) get += ch == ' ' ? '+' : ch;
+    get += "&hello=cppcddb+localhost+cppcddb-tools+1.0&proto=6 HTTP/1.1\r\nHost: ";
+    get += m_host;
+    get += "\r\n\r\n";
+    send(get);
+    return read_http_reply();
+}
+
+void CDDBClient::send(const std::string& data)
+{
+    for (std::size_t sent = 0; sent < data.size();) {
+        auto ret = ::send(m_socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (ret <= 0) throw CDDBException(std::string("cannot send: ") + std::strerror(errno));
+        sent += ret;
+    }
+}
+
+void CDDBClient::fill(std::size_t size)
+{
+    // reads until at least size bytes are buffered past the read position
+    if (m_pos > 65536) {
+        m_buffer.erase(0, m_pos);
+        m_pos = 0;
+    }
+    char buf[16384];
+    while (m_buffer.size() - m_pos < size) {
+        auto ret = ::recv(m_socket, buf, sizeof(buf), 0);
+        if (ret <= 0) throw CDDBException(ret ? std::string("cannot receive: ") + std::strerror(errno) : "connection closed");
+        m_buffer.append(buf, ret);
+    }
+}
+
+std::string CDDBClient::read_line()
+{
+    std::size_t eol;
+    while ((eol = m_buffer.find('\n', m_pos)) == std::string::npos) fill(m_buffer.size() - m_pos + 1);
+    std::size_t end = eol > m_pos && m_buffer[eol - 1] == '\r' ? eol - 1 : eol;
+    std::string line = m_buffer.substr(m_pos, end - m_pos);
+    m_pos = eol + 1;
+    return line;
+}
+
+int CDDBClient::read_reply(bool list_on_200)
+{
+    m_reply = read_line();
+    int code = reply_code(m_reply);
+    m_reply += '\n';
+    if (code == 210 || code == 211 || (code == 200 && list_on_200)) {
+        std::string line;
+        while ((line = read_line()) != ".") m_reply += line + '\n';
+        m_reply += ".\n";
+    }
+    return code;
+}
+
+int CDDBClient::read_http_reply()
+{
+    // skip a welcome message of a server that does not expect HTTP
+    std::string line;
+    while (!begins_with(line = read_line(), "HTTP/")) {}
+    if (line.size() < 12 || line.compare(9, 3, "200") != 0) throw CDDBException("HTTP error: " + line);
+    std::size_t length = 0;
+    while (!(line = read_line()).empty()) {
+        tolower(line);
+        if (begins_with(line, "content-length:")) length = std::stoul(line.substr(15));
+    }
+    fill(length);
+    m_reply = m_buffer.substr(m_pos, length);
+    m_pos += length;
+    return reply_code(m_reply);
+}
@@ -0,0 +1,77 @@
+//
+//  cddbclient.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef cddbclient_hpp_MZNXBCVLAKSJDHFGQPWOEIRUTYZMXNCBVA
+#define cddbclient_hpp_MZNXBCVLAKSJDHFGQPWOEIRUTYZMXNCBVA
+
+#include <cinttypes>
+#include <string>
+
+
+namespace CDDB {
+
+/// A blocking client connection to a CDDB server, for the CDDB line protocol
+/// or CDDB over HTTP with keep-alive. Errors throw a CDDBException.
+
+class CDDBClient {
+public:
+    CDDBClient(const std::string& host, uint16_t port, uint32_t timeout_seconds = 10);
+    ~CDDBClient();
+
+    /// cddb hello and proto 6, skipping the welcome message of servers that send it
+    void handshake();
+    /// sends a command and reads the complete reply, returns the CDDB reply code
+    int request(const std::string& command);
+    /// sends a command as HTTP GET and reads the response, returns the CDDB reply code
+    int http_request(const std::string& command);
+
+    void send(const std::string& data);
+    /// a line without its line end
+    std::string read_line();
+    /// reads a CDDB reply with the list that follows 210 and 211 (and 200 if
+    /// list_on_200, as for lscat) until the terminating ., returns the code
+    int read_reply(bool list_on_200 = false);
+    /// reads a HTTP response, returns the CDDB reply code of its body
+    int read_http_reply();
+    /// the last reply that was read, with a line end after every line
+    const std::string& reply() const { return m_reply; }
+
+private:
+    std::string m_host;
+    int m_socket = -1;
+    std::string m_buffer;
+    std::size_t m_pos = 0;
+    std::string m_reply;
+
+    CDDBClient(const CDDBClient&) = delete;
+    CDDBClient& operator=(const CDDBClient&) = delete;
+
+    void fill(std::size_t size);
+};
+
+}
+
+#endif /* cddbclient_hpp */
@@ -0,0 +1,116 @@
+#!/bin/sh
+#
+#  compare-imports.sh
+#
+#  Copyright © 2016 Joachim Schurig. All rights reserved.
+#
+#  Redistribution and use in source and binary forms, with or without
+#  modification, are permitted provided that the following conditions are met:
+#
+#  1. Redistributions of source code must retain the above copyright notice, this
+#  list of conditions and the following disclaimer.
+#  2. Redistributions in binary form must reproduce the above copyright notice,
+#  this list of conditions and the following disclaimer in the documentation
+#  and/or other materials provided with the distribution.
+#
+#  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+#  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+#  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+#  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+#  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+#  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+#  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+#  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+#  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+#  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+# Imports a synthetic archive with duplicates and discid collisions once
+# sequentially and once per given mode, and compares ordered dumps of all
+# tables. The other modes must give the same database. The parallel import
+# numbers the CDs differently, so the rows are compared keyed by the name
+# hash of their CD instead of the cd id, and the ids are only reported.
+#
+# usage: compare-imports.sh [-n records] [-s seed] [-w dir] [-- mode ...]
+#
+# A mode is a quoted set of cppcddbd options, the default modes are
+# "--staged" and "-j 4". Needs cppcddbd and cppcddb-gen (make all tools)
+# and the sqlite3 shell. Exits with 1 if any mode differs.
+
+set -e
+
+records=20000
+seed=1
+work=./compare-imports
+bin=$(dirname "$0")/..
+
+while getopts "n:s:w:" opt; do
+    case $opt in
+        n) records=$OPTARG ;;
+        s) seed=$OPTARG ;;
+        w) work=$OPTARG ;;
+        *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] || set -- "--staged" "-j 4"
+
+mkdir -p "$work"
+archive=$work/archive.tar
+
+"$bin/cppcddb-gen" -n "$records" -s "$seed" -o "$archive" --duplicates 0.2 --collisions 0.05 >/dev/null
+
+# all columns, in an order that does not depend on the insertion order
+dump() {
+    for table in "CD ORDER BY cd" "TRACKS ORDER BY cd, track" "DISCID ORDER BY discid, cd" \
+                 "FUZZYID ORDER BY fuzzyid, cd" "NAMEHASH ORDER BY hash" "GENRE ORDER BY id" \
+                 "ERRORS ORDER BY file, reason, extended"; do
+        echo "== $table"
+        sqlite3 "$1" "SELECT * FROM $table"
+    done
+}
+
+# the same, with every cd id and genre id replaced by the name hash and genre name
+keyed_dump() {
+    for query in \
+        "h.hash, c.artist, c.title, g.name, c.year, c.seconds, c.revision, c.tracks FROM CD c JOIN NAMEHASH h ON h.cd = c.cd LEFT JOIN GENRE g ON g.id = c.genre ORDER BY h.hash" \
+        "h.hash, t.track, t.song, t.frames FROM TRACKS t LEFT JOIN NAMEHASH h ON h.cd = t.cd ORDER BY h.hash, t.track" \
+        "d.discid, h.hash FROM DISCID d LEFT JOIN NAMEHASH h ON h.cd = d.cd ORDER BY d.discid, h.hash" \
+        "f.fuzzyid, h.hash FROM FUZZYID f LEFT JOIN NAMEHASH h ON h.cd = f.cd ORDER BY f.fuzzyid, h.hash" \
+        "name FROM GENRE ORDER BY name" \
+        "* FROM ERRORS ORDER BY file, reason, extended"; do
+        echo "== $query"
+        sqlite3 "$1" "SELECT $query"
+    done
+}
+
+# import into a new database, and dump it both ways
+import() {
+    name=$1
+    shift
+    rm -f "${work:?}/${name:?}.sqlite"
+    "$bin/cppcddbd" -d "$work/$name.sqlite" -i "$archive" --no-server "$@" >"$work/$name.log"
+    dump "$work/$name.sqlite" >"$work/$name.dump"
+    keyed_dump "$work/$name.sqlite" >"$work/$name.keyed"
+}
+
+import sequential
+echo "sequential: $(grep -c '' "$work/sequential.keyed") lines"
+
+status=0
+count=0
+for mode in "$@"; do
+    count=$((count + 1))
+    # the options of a mode are split on purpose
+    import mode$count $mode
+    if ! diff "$work/sequential.keyed" "$work/mode$count.keyed" >"$work/mode$count.diff"; then
+        echo "$mode: $(grep -c '^[<>]' "$work/mode$count.diff") lines differ, see $work/mode$count.diff"
+        status=1
+    elif cmp -s "$work/sequential.dump" "$work/mode$count.dump"; then
+        echo "$mode: identical"
+    else
+        echo "$mode: identical except for the ids"
+    fi
+done
+
+exit $status
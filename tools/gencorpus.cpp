@@ -0,0 +1,226 @@
+//
+//  gencorpus.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <getopt.h>
+#include <bzlib.h>
+#include "../bench/corpus.hpp"
+#include "../untar.hpp"
+#include "../helper.hpp"
+#include "../format.hpp"
+#include "../cddbexception.hpp"
+
+
+using namespace CDDB::Bench;
+
+
+namespace {
+
+/// writes to a plain file, or bzip2 compressed if the name ends in .bz2
+class Output {
+public:
+    Output(const std::string& filename)
+    : m_filename(filename)
+    {
+        m_file = std::fopen(filename.c_str(), "wb");
+        if (!m_file) throw CDDB::CDDBException(filename + ": cannot create: " + std::strerror(errno));
+        if (CDDB::ends_with(filename, ".bz2")) {
+            int error;
+            m_bzfile = BZ2_bzWriteOpen(&error, m_file, 9, 0, 0);
+            if (error != BZ_OK) throw CDDB::CDDBException(filename + ": cannot start bzip2 compression");
+        }
+    }
+
+    ~Output()
+    {
+        if (m_bzfile) {
+            int error;
+            BZ2_bzWriteClose(&error, m_bzfile, 1, nullptr, nullptr);
+        }
+        if (m_file) std::fclose(m_file);
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        m_bytes += size;
+        if (m_bzfile) {
+            int error;
+            BZ2_bzWrite(&error, m_bzfile, const_cast<char*>(data), static_cast<int>(size));
+            if (error != BZ_OK) throw CDDB::CDDBException(m_filename + ": cannot write compressed data");
+        } else if (std::fwrite(data, 1, size, m_file) != size) {
+            throw CDDB::CDDBException(m_filename + ": cannot write: " + std::strerror(errno));
+        }
+    }
+
+    void write(const std::string& data) { write(data.data(), data.size()); }
+
+    void close()
+    {
+        if (m_bzfile) {
+            int error;
+            BZ2_bzWriteClose(&error, m_bzfile, 0, nullptr, nullptr);
+            m_bzfile = nullptr;
+            if (error != BZ_OK) throw CDDB::CDDBException(m_filename + ": cannot finish compression");
+        }
+        if (std::fclose(m_file) != 0) throw CDDB::CDDBException(m_filename + ": cannot write: " + std::strerror(errno));
+        m_file = nullptr;
+    }
+
+    /// uncompressed bytes written
+    uint64_t bytes() const { return m_bytes; }
+
+private:
+    std::string m_filename;
+    FILE* m_file = nullptr;
+    BZFILE* m_bzfile = nullptr;
+    uint64_t m_bytes = 0;
+};
+
+}
+
+
+int main(int argc, char *argv[]) {
+
+    CDDB::set_unicode_locale("", true);
+
+    try {
+
+        Corpus::Options options;
+        std::string filename = "freedb-synthetic.tar.bz2";
+
+        {
+            static const struct option long_options[] = {
+                { "latin1", required_argument, nullptr, 'l' },
+                { "uppercase", required_argument, nullptr, 'u' },
+                { "crlf", required_argument, nullptr, 'r' },
+                { "max-tracks", required_argument, nullptr, 't' },
+                { "duplicates", required_argument, nullptr, 'd' },
+                { "collisions", required_argument, nullptr, 'c' },
+                { "bad-encoding", required_argument, nullptr, 'b' },
+                { nullptr, 0, nullptr, 0 }
+            };
+
+            int opt;
+
+            while ((opt = ::getopt_long(argc, argv, "hn:o:s:", long_options, nullptr)) != -1) {
+                switch (opt) {
+                    case 'b':
+                        options.bad_encoding = ::strtod(optarg, nullptr);
+                        break;
+                    case 'c':
+                        options.collisions = ::strtod(optarg, nullptr);
+                        break;
+                    case 'd':
+                        options.duplicates = ::strtod(optarg, nullptr);
+                        break;
+                    default:
+                    case 'h':
+                        std::cout << argv[0] << " - help:" << std::endl;
+                        std::cout << std::endl;
+                        std::cout << "Writes a synthetic archive of xmcd files in the layout of the freedb dumps." << std::endl;
+                        std::cout << std::endl;
+                        std::cout << " -n count             : number of records (default 10000)" << std::endl;
+                        std::cout << " -o file              : output file, bzip2 compressed if it ends in .bz2 (default 'freedb-synthetic.tar.bz2')" << std::endl;
+                        std::cout << " -s seed              : seed, the same seed and options give the same archive (default 1)" << std::endl;
+                        std::cout << " --latin1 fraction    : records in ISO-8859-1 instead of UTF-8 (default 0.25)" << std::endl;
+                        std::cout << " --uppercase fraction : records with all uppercase titles (default 0.1)" << std::endl;
+                        std::cout << " --crlf fraction      : records with CRLF line endings (default 0.02)" << std::endl;
+                        std::cout << " --max-tracks count   : track counts spread from 1 to count, peaking in the middle (default 24)" << std::endl;
+                        std::cout << " --duplicates fraction: resubmissions of earlier discs (default 0)" << std::endl;
+                        std::cout << " --collisions fraction: records with the frames of an earlier, different disc (default 0)" << std::endl;
+                        std::cout << " --bad-encoding fraction: records with mis-encoded titles (default 0)" << std::endl;
+                        std::cout << std::endl;
+                        exit(0);
+                    case 'l':
+                        options.latin1 = ::strtod(optarg, nullptr);
+                        break;
+                    case 'n':
+                        options.records = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 'o':
+                        filename = optarg;
+                        break;
+                    case 'r':
+                        options.crlf = ::strtod(optarg, nullptr);
+                        break;
+                    case 's':
+                        options.seed = ::strtoull(optarg, nullptr, 10);
+                        break;
+                    case 't':
+                        options.max_tracks = ::strtoul(optarg, nullptr, 10);
+                        if (!options.max_tracks) throw CDDB::CDDBException("--max-tracks needs at least 1");
+                        break;
+                    case 'u':
+                        options.uppercase = ::strtod(optarg, nullptr);
+                        break;
+                }
+            }
+        }
+
+        CDDB::Duration duration;
+
+        Output output(filename);
+        Corpus::Generator generator(options);
+        std::set<std::string> categories;
+        const std::string padding(TarHeader::HeaderLen, 0);
+
+        for (uint32_t ct = 0; ct < options.records; ++ct) {
+            Corpus::Disc disc = generator.next();
+            std::string category = Corpus::category(disc);
+            // the freedb dumps have a directory entry per category
+            if (categories.insert(category).second) output.write(Corpus::tar_header(category + "/", 0, '5'));
+            Corpus::file_t file = Corpus::xmcd_file(disc);
+            output.write(Corpus::tar_header(fmt::format("{0}/{1:08x}", category, Corpus::legacy_discid(disc)), file.size()));
+            output.write(file.data(), file.size());
+            output.write(padding.data(), (TarHeader::HeaderLen - file.size() % TarHeader::HeaderLen) % TarHeader::HeaderLen);
+        }
+
+        // the end of archive marker
+        output.write(padding);
+        output.write(padding);
+
+        uint64_t bytes = output.bytes();
+        output.close();
+
+        duration.lap();
+        std::cout << fmt::format("wrote {0} records, {1} bytes uncompressed, to {2} in {3}",
+                                 options.records, bytes, filename, duration.to_string(CDDB::Duration::Precision::Milliseconds))
+            << std::endl;
+
+        return 0;
+
+    } catch (std::exception& e) {
+
+        std::cerr << "Exception: " << e.what() << std::endl;
+
+    }
+
+    return 1;
+}
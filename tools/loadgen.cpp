@@ -0,0 +1,470 @@
+//
+//  loadgen.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <getopt.h>
+#include "../sqlitecpp/SQLiteCpp.h"
+#include "cddbclient.hpp"
+#include "../bench/corpus.hpp"
+#include "../histogram.hpp"
+#include "../diskrecord.hpp"
+#include "../cddbdefines.hpp"
+#include "../helper.hpp"
+#include "../format.hpp"
+#include "../cddbexception.hpp"
+
+
+using namespace CDDB::Bench;
+using CDDB::Histogram;
+
+typedef std::chrono::steady_clock clock_type;
+
+
+namespace {
+
+enum Op { Hit = 0, Fuzzy, Miss, Read, Ops };
+const char* op_names[Ops] = { "hit", "fuzzy", "miss", "read" };
+
+// what the server answered, from the CDDB reply code
+enum Outcome { Exact = 0, Close, None, Failed, Outcomes };
+
+/// the commands of one TOC, as a CDDB client would send them
+struct Toc {
+    std::string command[Ops];
+};
+
+std::string query_command(std::vector<uint32_t> starts, uint32_t seconds)
+{
+    Corpus::Disc disc;
+    disc.frames = std::move(starts);
+    disc.seconds = seconds;
+    std::string command = fmt::format("cddb query {0:08x} {1}", Corpus::legacy_discid(disc), disc.frames.size());
+    for (auto frame : disc.frames) command += fmt::format(" {0}", frame);
+    command += fmt::format(" {0}", seconds);
+    return command;
+}
+
+/// builds the commands from a TOC in the form of the database: the length of
+/// every track in frames, and the start frame of the first one
+Toc make_toc(const std::vector<uint32_t>& lengths, uint32_t startframe)
+{
+    // the server computes the last length as seconds * 75 - last start - start frame
+    std::vector<uint32_t> starts;
+    uint32_t start = startframe;
+    for (auto length : lengths) {
+        starts.push_back(start);
+        start += length;
+    }
+    uint32_t seconds = (starts.back() + lengths.back() + startframe) / 75;
+
+    Toc toc;
+    toc.command[Hit] = query_command(starts, seconds);
+
+    // moving the disc by one second keeps all track lengths, so that only the
+    // fuzzy discid matches
+    std::vector<uint32_t> moved(starts);
+    for (auto& frame : moved) frame += 75;
+    toc.command[Fuzzy] = query_command(moved, seconds + 2);
+
+    // and a first track that is 40 seconds longer matches nothing
+    std::vector<uint32_t> longer(starts);
+    for (auto it = longer.begin() + 1; it != longer.end(); ++it) *it += 3000;
+    toc.command[Miss] = query_command(longer, seconds + 40);
+
+    toc.command[Read] = fmt::format("cddb read generic {0:08x}", private_discid(startframe, lengths));
+
+    return toc;
+}
+
+std::vector<Toc> load_tocs(const std::string& dbname, uint32_t max)
+{
+    SQLite::Database db(dbname, SQLITE_OPEN_READONLY);
+    SQLite::Statement query(db, "SELECT CD.cd, CD.seconds, TRACKS.frames FROM CD, TRACKS"
+                                " WHERE CD.cd IN (SELECT cd FROM CD ORDER BY cd LIMIT ?1) AND TRACKS.cd=CD.cd"
+                                " ORDER BY CD.cd, TRACKS.track");
+    query.bind(1, int64_t(max));
+
+    std::vector<Toc> tocs;
+    std::vector<uint32_t> lengths;
+    int64_t cd = -1;
+    uint32_t startframe = 0;
+
+    while (query.executeStep()) {
+        if (query.getColumn(0).getInt64() != cd) {
+            if (!lengths.empty()) tocs.push_back(make_toc(lengths, startframe));
+            lengths.clear();
+            cd = query.getColumn(0).getInt64();
+            startframe = static_cast<uint32_t>(query.getColumn(1).getInt64());
+        }
+        lengths.push_back(static_cast<uint32_t>(query.getColumn(2).getInt64()));
+    }
+    if (!lengths.empty()) tocs.push_back(make_toc(lengths, startframe));
+
+    return tocs;
+}
+
+/// the TOCs of an archive written by cppcddb-gen with the same seed, skipping
+/// the records that an import would reject
+std::vector<Toc> generate_tocs(const Corpus::Options& options)
+{
+    std::vector<Toc> tocs;
+    Corpus::Generator generator(options);
+
+    for (uint32_t ct = 0; ct < options.records; ++ct) {
+        CDDB::DiskRecord rec(Corpus::xmcd_file(generator.next()));
+        if (!rec.valid() || rec.frames().empty() || rec.bad_encoding()) continue;
+        tocs.push_back(make_toc(rec.frames(), rec.seconds()));
+    }
+
+    return tocs;
+}
+
+/// a client connection in the CDDB protocol or in HTTP
+class Connection {
+public:
+    Connection(const std::string& host, uint16_t port, bool http)
+    : m_client(host, port)
+    , m_http(http)
+    {
+        if (!m_http) m_client.handshake();
+    }
+
+    int request(const std::string& command)
+    {
+        return m_http ? m_client.http_request(command) : m_client.request(command);
+    }
+
+    const std::string& reply() const { return m_client.reply(); }
+
+private:
+    CDDB::CDDBClient m_client;
+    bool m_http;
+};
+
+struct Options {
+    std::string host = "localhost";
+    uint16_t port = 8880;
+    bool http = false;
+    // read the CD after an exact hit, like a client does
+    bool follow = false;
+    uint32_t connections = 16;
+    double seconds = 10;
+    // requests per second for an open loop, 0 for a closed loop
+    double rate = 0;
+    uint32_t mix[Ops] = { 70, 10, 10, 10 };
+    uint64_t seed = 1;
+};
+
+struct Result {
+    Histogram latency[Ops];
+    uint64_t outcomes[Ops][Outcomes] = {};
+};
+
+/// the read of the first CD in the reply of a query, as a client would send it
+std::string read_command(const std::string& reply)
+{
+    std::vector<std::string> words;
+    // 200 categ discid dtitle, or 210 and the list of categ discid dtitle
+    std::size_t line = reply.compare(0, 3, "210") == 0 ? reply.find('\n') + 1 : 0;
+    CDDB::StringTokenizer<std::string>(reply.substr(line, reply.find('\n', line) - line), " ").split(words);
+    std::size_t first = line ? 0 : 1;
+    if (words.size() < first + 2) throw CDDB::CDDBException("invalid query reply: " + reply);
+    return fmt::format("cddb read {0} {1}", words[first], words[first + 1]);
+}
+
+Outcome outcome(Op op, int code)
+{
+    switch (code) {
+        case 200:
+        case 210:
+            return Exact;
+        case 211:
+            return op == Read ? Failed : Close;
+        case 202:
+        case 401:
+            return None;
+        default:
+            return Failed;
+    }
+}
+
+/// Runs one connection. In the open loop the requests are scheduled at a
+/// constant rate for all connections together, and the latency is measured
+/// from the scheduled time, so that a server that falls behind shows the
+/// queueing delay instead of hiding it by slowing down the load.
+void worker(const Options& options, const std::vector<Toc>& tocs, uint32_t id,
+            clock_type::time_point start, std::atomic<uint64_t>& next, Result& result)
+{
+    Random random(options.seed + id);
+    uint32_t mix_total = 0;
+    for (auto weight : options.mix) mix_total += weight;
+
+    auto end = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(options.seconds));
+    std::unique_ptr<Connection> connection;
+
+    for (;;) {
+        clock_type::time_point scheduled;
+        if (options.rate > 0) {
+            uint64_t seq = next.fetch_add(1, std::memory_order_relaxed);
+            scheduled = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(seq / options.rate));
+            if (scheduled >= end) break;
+            std::this_thread::sleep_until(scheduled);
+        } else {
+            scheduled = clock_type::now();
+            if (scheduled >= end) break;
+        }
+        // a request that is already due at the end is not sent
+        if (clock_type::now() >= end) break;
+
+        uint32_t pick = random.uniform(mix_total);
+        int op = Hit;
+        while (pick >= options.mix[op]) pick -= options.mix[op++];
+        const Toc& toc = tocs[random.uniform(static_cast<uint32_t>(tocs.size()))];
+
+        Outcome out;
+        try {
+            if (!connection) connection = std::make_unique<Connection>(options.host, options.port, options.http);
+            out = outcome(static_cast<Op>(op), connection->request(toc.command[op]));
+        } catch (std::exception& e) {
+            if (!result.outcomes[op][Failed]) std::cerr << "error: " << e.what() << std::endl;
+            connection.reset();
+            out = Failed;
+        }
+
+        result.latency[op].record(std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - scheduled).count());
+        ++result.outcomes[op][out];
+
+        if (options.follow && op == Hit && out == Exact) {
+            auto sent = clock_type::now();
+            try {
+                out = outcome(Read, connection->request(read_command(connection->reply())));
+            } catch (std::exception& e) {
+                if (!result.outcomes[Read][Failed]) std::cerr << "error: " << e.what() << std::endl;
+                connection.reset();
+                out = Failed;
+            }
+            result.latency[Read].record(std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - sent).count());
+            ++result.outcomes[Read][out];
+        }
+    }
+}
+
+std::string ms(uint64_t microseconds)
+{
+    return fmt::format("{0:.3f}", microseconds / 1000.0);
+}
+
+void parse_mix(const std::string& spec, uint32_t mix[Ops])
+{
+    std::fill(mix, mix + Ops, 0);
+    std::vector<std::string> parts;
+    CDDB::StringTokenizer<std::string>(spec, ",").split(parts);
+    for (const auto& part : parts) {
+        auto eq = part.find('=');
+        auto name = part.substr(0, eq);
+        auto it = std::find_if(std::begin(op_names), std::end(op_names), [&name](const char* op) { return name == op; });
+        if (eq == std::string::npos || it == std::end(op_names)) throw CDDB::CDDBException("invalid mix: " + part);
+        mix[it - std::begin(op_names)] = static_cast<uint32_t>(std::stoul(part.substr(eq + 1)));
+    }
+    if (std::all_of(mix, mix + Ops, [](uint32_t weight) { return weight == 0; })) throw CDDB::CDDBException("empty mix");
+}
+
+}
+
+
+int main(int argc, char *argv[]) {
+
+    CDDB::set_unicode_locale("", true);
+
+    try {
+
+        Options options;
+        std::string database;
+        Corpus::Options corpus;
+        uint32_t max_tocs = 10000;
+        bool full_histogram = false;
+
+        {
+            static const struct option long_options[] = {
+                { "http", no_argument, nullptr, 'w' },
+                { "histogram", no_argument, nullptr, 'g' },
+                { "follow", no_argument, nullptr, 'f' },
+                { nullptr, 0, nullptr, 0 }
+            };
+
+            int opt;
+
+            while ((opt = ::getopt_long(argc, argv, "c:d:hH:m:n:p:r:s:t:", long_options, nullptr)) != -1) {
+                switch (opt) {
+                    case 'c':
+                        options.connections = std::max(1UL, ::strtoul(optarg, nullptr, 10));
+                        break;
+                    case 'd':
+                        database = optarg;
+                        break;
+                    case 'f':
+                        options.follow = true;
+                        break;
+                    case 'g':
+                        full_histogram = true;
+                        break;
+                    default:
+                    case 'h':
+                        std::cout << argv[0] << " - help:" << std::endl;
+                        std::cout << std::endl;
+                        std::cout << "Sends a mix of CDDB queries and reads over many connections to a running cppcddbd," << std::endl;
+                        std::cout << "and reports the throughput and the latency percentiles." << std::endl;
+                        std::cout << std::endl;
+                        std::cout << " -H host       : server (default 'localhost')" << std::endl;
+                        std::cout << " -p port       : server port (default 8880)" << std::endl;
+                        std::cout << " -c count      : concurrent connections (default 16)" << std::endl;
+                        std::cout << " -t seconds    : duration of the run (default 10)" << std::endl;
+                        std::cout << " -r rate       : requests per second for all connections together (open loop),"<< std::endl;
+                        std::cout << "                 latencies count from the scheduled time (default 0 = closed loop)" << std::endl;
+                        std::cout << " -m mix        : weights of the requests (default 'hit=70,fuzzy=10,miss=10,read=10')" << std::endl;
+                        std::cout << " -d file       : replay the TOCs of this database, as the server would find them" << std::endl;
+                        std::cout << " -n count      : replay at most count TOCs, or generate the TOCs of a 'cppcddb-gen -n count'" << std::endl;
+                        std::cout << "                 archive if there is no -d (default 10000)" << std::endl;
+                        std::cout << " -s seed       : seed of the generated TOCs and of the request order (default 1)" << std::endl;
+                        std::cout << " --http        : send the requests as HTTP GET instead of the CDDB protocol" << std::endl;
+                        std::cout << " --follow      : read the CD after every exact hit on the same connection, like a client" << std::endl;
+                        std::cout << " --histogram   : print the full latency distribution" << std::endl;
+                        std::cout << std::endl;
+                        exit(0);
+                    case 'H':
+                        options.host = optarg;
+                        break;
+                    case 'm':
+                        parse_mix(optarg, options.mix);
+                        break;
+                    case 'n':
+                        max_tocs = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 'p':
+                        options.port = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 'r':
+                        options.rate = ::strtod(optarg, nullptr);
+                        break;
+                    case 's':
+                        options.seed = ::strtoull(optarg, nullptr, 10);
+                        break;
+                    case 't':
+                        options.seconds = ::strtod(optarg, nullptr);
+                        break;
+                    case 'w':
+                        options.http = true;
+                        break;
+                }
+            }
+        }
+
+        std::vector<Toc> tocs;
+        if (!database.empty()) {
+            tocs = load_tocs(database, max_tocs);
+        } else {
+            corpus.records = max_tocs;
+            corpus.seed = options.seed;
+            tocs = generate_tocs(corpus);
+        }
+        if (tocs.empty()) throw CDDB::CDDBException("no TOCs to replay");
+
+        std::cout << fmt::format("{0} TOCs, {1} connections, {2}, ", tocs.size(), options.connections, options.http ? "HTTP" : "CDDB protocol");
+        if (options.rate > 0) std::cout << fmt::format("open loop at {0} requests/s", options.rate);
+        else std::cout << "closed loop";
+        std::cout << fmt::format(" for {0}s", options.seconds) << std::endl;
+
+        std::vector<Result> results(options.connections);
+        std::vector<std::thread> threads;
+        std::atomic<uint64_t> next(0);
+        CDDB::Duration duration;
+        auto start = clock_type::now();
+
+        for (uint32_t id = 0; id < options.connections; ++id) {
+            threads.emplace_back(worker, std::cref(options), std::cref(tocs), id, start, std::ref(next), std::ref(results[id]));
+        }
+        for (auto& thread : threads) thread.join();
+
+        duration.lap();
+        double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        Result total;
+        for (const auto& result : results) {
+            for (int op = 0; op < Ops; ++op) {
+                total.latency[op].merge(result.latency[op]);
+                for (int out = 0; out < Outcomes; ++out) total.outcomes[op][out] += result.outcomes[op][out];
+            }
+        }
+
+        Histogram all;
+        uint64_t failed = 0;
+        std::cout << std::endl << fmt::format("{0:<6} {1:>9} {2:>8} {3:>8} {4:>8} {5:>7} {6:>9} {7:>9} {8:>9} {9:>9} {10:>9}",
+                                              "", "requests", "exact", "fuzzy", "none", "errors", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms") << std::endl;
+        for (int op = 0; op < Ops; ++op) {
+            const Histogram& latency = total.latency[op];
+            all.merge(latency);
+            failed += total.outcomes[op][Failed];
+            if (!latency.count()) continue;
+            std::cout << fmt::format("{0:<6} {1:>9} {2:>8} {3:>8} {4:>8} {5:>7} {6:>9} {7:>9} {8:>9} {9:>9} {10:>9}",
+                                     op_names[op], latency.count(), total.outcomes[op][Exact], total.outcomes[op][Close],
+                                     total.outcomes[op][None], total.outcomes[op][Failed],
+                                     ms(latency.percentile(50)), ms(latency.percentile(90)), ms(latency.percentile(99)),
+                                     ms(latency.percentile(99.9)), ms(latency.max())) << std::endl;
+        }
+        std::cout << fmt::format("{0:<6} {1:>9} {2:>8} {3:>8} {4:>8} {5:>7} {6:>9} {7:>9} {8:>9} {9:>9} {10:>9}",
+                                 "all", all.count(), "", "", "", failed,
+                                 ms(all.percentile(50)), ms(all.percentile(90)), ms(all.percentile(99)),
+                                 ms(all.percentile(99.9)), ms(all.max())) << std::endl;
+
+        std::cout << std::endl << fmt::format("{0} requests in {1}, {2:.1f} requests/s", all.count(),
+                                              duration.to_string(CDDB::Duration::Precision::Milliseconds), all.count() / seconds);
+        // an open loop that cannot keep the rate has found the saturation point
+        if (options.rate > 0) {
+            auto scheduled = static_cast<uint64_t>(std::ceil(options.rate * options.seconds));
+            std::cout << fmt::format(", {0} were scheduled at {1}/s", scheduled, options.rate);
+            if (scheduled > all.count()) std::cout << fmt::format(", {0} not sent in time", scheduled - all.count());
+        }
+        std::cout << std::endl;
+
+        if (full_histogram) {
+            std::cout << std::endl << all.distribution();
+        }
+
+        return failed ? 1 : 0;
+
+    } catch (std::exception& e) {
+
+        std::cerr << "Exception: " << e.what() << std::endl;
+
+    }
+
+    return 1;
+}
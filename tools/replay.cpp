@@ -0,0 +1,327 @@
+//
+//  replay.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <memory>
+#include <list>
+#include <getopt.h>
+#include "cddbclient.hpp"
+#include "../capture.hpp"
+#include "../cddbserver.hpp"
+#include "../histogram.hpp"
+#include "../helper.hpp"
+#include "../format.hpp"
+#include "../cddbexception.hpp"
+
+
+using CDDB::Histogram;
+using CDDB::ProtocolCapture;
+
+typedef std::chrono::steady_clock clock_type;
+
+
+namespace {
+
+enum Kind { Query = 0, Read, Other, Kinds };
+const char* kind_names[Kinds] = { "query", "read", "other" };
+
+/// the requests of one captured connection
+struct Session {
+    uint64_t opened = 0;
+    uint64_t closed = 0;
+    std::vector<ProtocolCapture::Event> requests;
+};
+
+struct Result {
+    Histogram latency[Kinds];
+    uint64_t errors[Kinds] = {};
+    std::map<int, uint64_t> codes;
+};
+
+std::vector<Session> load_capture(const std::string& filename)
+{
+    std::ifstream input(filename);
+    if (!input) throw CDDB::CDDBException(filename + ": cannot open");
+
+    std::map<uint64_t, Session> sessions;
+    ProtocolCapture::Event event;
+    std::string line;
+
+    while (std::getline(input, line)) {
+        if (!ProtocolCapture::parse(line, event)) continue;
+        auto it = sessions.find(event.connection);
+        if (it == sessions.end()) {
+            it = sessions.emplace(event.connection, Session()).first;
+            it->second.opened = event.time;
+        }
+        it->second.closed = event.time;
+        if (event.type == 'r') it->second.requests.push_back(event);
+    }
+
+    std::vector<Session> result;
+    for (auto& session : sessions) result.push_back(std::move(session.second));
+    std::stable_sort(result.begin(), result.end(), [](const Session& a, const Session& b) { return a.opened < b.opened; });
+    return result;
+}
+
+/// the first two words of the cddb command of a request line, also from a HTTP GET
+std::string command(const std::string& request)
+{
+    std::vector<std::string> words;
+    if (CDDB::begins_with(request, "GET ")) {
+        std::vector<std::string> cmds;
+        try {
+            if (split_http_cddb(request, cmds) > 0) CDDB::StringTokenizer<std::string>(cmds[0], " \t\r").split(words);
+        } catch (std::exception&) {}
+    } else {
+        CDDB::StringTokenizer<std::string>(request, " \t\r").split(words);
+    }
+    words.resize(std::min<std::size_t>(words.size(), 2));
+    std::string cmd;
+    for (auto& word : words) {
+        CDDB::tolower(word);
+        if (!cmd.empty()) cmd += ' ';
+        cmd += word;
+    }
+    return cmd;
+}
+
+Kind kind(const std::string& cmd)
+{
+    if (CDDB::begins_with(cmd, "cddb query")) return Query;
+    if (CDDB::begins_with(cmd, "cddb read")) return Read;
+    return Other;
+}
+
+/// Replays one connection. Requests are sent at their captured times divided
+/// by speed, and the latency counts from that time, so that a server that falls
+/// behind shows the delay. With speed 0 they are sent as fast as the replies come.
+void replay(const Session& session, const std::string& host, uint16_t port, double speed,
+            clock_type::time_point start, Result& result, std::mutex& mutex)
+{
+    auto at = [start, speed](uint64_t time) {
+        return start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::micro>(time / speed));
+    };
+
+    Result local;
+    bool http = false;
+    bool welcomed = false;
+    // the kind of the request that failed
+    Kind type = Other;
+
+    try {
+
+        CDDB::CDDBClient client(host, port);
+
+        for (const auto& request : session.requests) {
+            auto scheduled = speed > 0 ? at(request.time) : clock_type::now();
+            if (speed > 0) std::this_thread::sleep_until(scheduled);
+
+            std::string cmd = command(request.request);
+            type = kind(cmd);
+            if (CDDB::begins_with(request.request, "GET ")) http = true;
+
+            client.send(request.request + "\n");
+
+            // the server does not answer the header lines of a HTTP request
+            if (http && !CDDB::begins_with(request.request, "GET ")) continue;
+
+            int code = http ? client.read_http_reply() : client.read_reply(cmd == "cddb lscat");
+            // skip the welcome message of a server started with -c
+            if (code == 201 && !welcomed && !cmd.empty()) code = client.read_reply(cmd == "cddb lscat");
+            welcomed = true;
+
+            local.latency[type].record(std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - scheduled).count());
+            ++local.codes[code];
+
+            // after these the server closes the connection
+            if (code == 230 || code == 530) break;
+        }
+
+        // keep the connection open as long as in the capture
+        if (speed > 0) std::this_thread::sleep_until(at(session.closed));
+
+    } catch (std::exception& e) {
+        ++local.errors[type];
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!result.errors[Query] && !result.errors[Read] && !result.errors[Other]) std::cerr << "error: " << e.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int type = 0; type < Kinds; ++type) {
+        result.latency[type].merge(local.latency[type]);
+        result.errors[type] += local.errors[type];
+    }
+    for (const auto& code : local.codes) result.codes[code.first] += code.second;
+}
+
+std::string ms(uint64_t microseconds)
+{
+    return fmt::format("{0:.3f}", microseconds / 1000.0);
+}
+
+}
+
+
+int main(int argc, char *argv[]) {
+
+    CDDB::set_unicode_locale("", true);
+
+    try {
+
+        std::string host = "localhost";
+        uint16_t port = 8880;
+        double speed = 1;
+        bool full_histogram = false;
+
+        {
+            static const struct option long_options[] = {
+                { "histogram", no_argument, nullptr, 'g' },
+                { nullptr, 0, nullptr, 0 }
+            };
+
+            int opt;
+
+            while ((opt = ::getopt_long(argc, argv, "hH:p:x:", long_options, nullptr)) != -1) {
+                switch (opt) {
+                    case 'g':
+                        full_histogram = true;
+                        break;
+                    default:
+                    case 'h':
+                        std::cout << argv[0] << " - help:" << std::endl;
+                        std::cout << std::endl;
+                        std::cout << argv[0] << " [options] capturefile" << std::endl;
+                        std::cout << std::endl;
+                        std::cout << "Replays the connections and requests of a capture written by 'cppcddbd --capture'" << std::endl;
+                        std::cout << "against a running server, and reports the latency percentiles and reply codes." << std::endl;
+                        std::cout << std::endl;
+                        std::cout << " -H host     : server (default 'localhost')" << std::endl;
+                        std::cout << " -p port     : server port (default 8880)" << std::endl;
+                        std::cout << " -x speed    : replay speed, 2 is twice as fast as captured, 0 as fast as possible (default 1)" << std::endl;
+                        std::cout << " --histogram : print the full latency distribution" << std::endl;
+                        std::cout << std::endl;
+                        exit(0);
+                    case 'H':
+                        host = optarg;
+                        break;
+                    case 'p':
+                        port = ::strtoul(optarg, nullptr, 10);
+                        break;
+                    case 'x':
+                        speed = ::strtod(optarg, nullptr);
+                        break;
+                }
+            }
+        }
+
+        if (optind != argc - 1) throw CDDB::CDDBException("need one capture file, see -h");
+
+        std::vector<Session> sessions = load_capture(argv[optind]);
+        if (sessions.empty()) throw CDDB::CDDBException("no connections in the capture");
+
+        uint64_t requests = 0;
+        uint64_t captured = 0;
+        for (const auto& session : sessions) {
+            requests += session.requests.size();
+            captured = std::max(captured, session.closed);
+        }
+        std::cout << fmt::format("{0} connections with {1} requests over {2}s, replayed ", sessions.size(), requests, captured / 1000000.0);
+        if (speed > 0) std::cout << fmt::format("at {0}x speed", speed) << std::endl;
+        else std::cout << "as fast as possible" << std::endl;
+
+        Result result;
+        std::mutex mutex;
+        CDDB::Duration duration;
+        auto start = clock_type::now();
+
+        // a thread per connection, started when the connection was opened
+        std::list<std::pair<std::thread, std::shared_ptr<std::atomic<bool>>>> threads;
+        for (const auto& session : sessions) {
+            if (speed > 0) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::micro>(session.opened / speed)));
+            }
+            for (auto it = threads.begin(); it != threads.end();) {
+                if (*it->second) {
+                    it->first.join();
+                    it = threads.erase(it);
+                } else ++it;
+            }
+            auto done = std::make_shared<std::atomic<bool>>(false);
+            threads.emplace_back(std::thread([&, done](const Session* session) {
+                replay(*session, host, port, speed, start, result, mutex);
+                *done = true;
+            }, &session), done);
+        }
+        for (auto& thread : threads) thread.first.join();
+
+        duration.lap();
+        double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+
+        Histogram all;
+        uint64_t errors = 0;
+        std::cout << std::endl << fmt::format("{0:<6} {1:>9} {2:>7} {3:>9} {4:>9} {5:>9} {6:>9} {7:>9}",
+                                              "", "replies", "errors", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms") << std::endl;
+        for (int type = 0; type < Kinds; ++type) {
+            const Histogram& latency = result.latency[type];
+            all.merge(latency);
+            errors += result.errors[type];
+            if (!latency.count() && !result.errors[type]) continue;
+            std::cout << fmt::format("{0:<6} {1:>9} {2:>7} {3:>9} {4:>9} {5:>9} {6:>9} {7:>9}",
+                                     kind_names[type], latency.count(), result.errors[type],
+                                     ms(latency.percentile(50)), ms(latency.percentile(90)), ms(latency.percentile(99)),
+                                     ms(latency.percentile(99.9)), ms(latency.max())) << std::endl;
+        }
+        std::cout << fmt::format("{0:<6} {1:>9} {2:>7} {3:>9} {4:>9} {5:>9} {6:>9} {7:>9}",
+                                 "all", all.count(), errors,
+                                 ms(all.percentile(50)), ms(all.percentile(90)), ms(all.percentile(99)),
+                                 ms(all.percentile(99.9)), ms(all.max())) << std::endl;
+
+        // the reply codes show whether a candidate build answers like the captured one
+        std::cout << std::endl << "reply codes:";
+        for (const auto& code : result.codes) std::cout << fmt::format(" {0}={1}", code.first, code.second);
+        std::cout << std::endl;
+
+        std::cout << std::endl << fmt::format("{0} replies in {1}, {2:.1f} replies/s", all.count(),
+                                              duration.to_string(CDDB::Duration::Precision::Milliseconds), all.count() / seconds) << std::endl;
+
+        if (full_histogram) std::cout << std::endl << all.distribution();
+
+        return errors ? 1 : 0;
+
+    } catch (std::exception& e) {
+
+        std::cerr << "Exception: " << e.what() << std::endl;
+
+    }
+
+    return 1;
+}
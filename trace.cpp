@@ -0,0 +1,148 @@
+//
+//  trace.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unistd.h>
+#include "trace.hpp"
+#include "cddbexception.hpp"
+#include "format.hpp"
+
+
+using namespace CDDB;
+
+
+struct Trace::Ring {
+    struct Event {
+        std::atomic<const char*> name { nullptr };
+        std::atomic<uint64_t> begin { 0 };
+        std::atomic<uint64_t> end { 0 };
+    };
+
+    explicit Ring(uint32_t id) : id(id) {}
+
+    Event events[RingSize];
+    // count of all events ever recorded, only written by the owning thread
+    std::atomic<uint64_t> next { 0 };
+    uint32_t id;
+};
+
+struct Trace::Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Ring*> unused;
+
+    static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+};
+
+/// returns the ring of a thread to the registry when the thread ends
+struct Trace::RingHolder {
+    Ring* ring = nullptr;
+
+    ~RingHolder()
+    {
+        if (!ring) return;
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.unused.push_back(ring);
+    }
+};
+
+std::chrono::steady_clock::time_point Trace::epoch()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return start;
+}
+
+void Trace::record(const char* name, uint64_t begin, uint64_t end)
+{
+    static thread_local RingHolder holder;
+
+    if (!holder.ring) {
+        Registry& registry = Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (!registry.unused.empty()) {
+            holder.ring = registry.unused.back();
+            registry.unused.pop_back();
+        } else {
+            registry.rings.push_back(std::make_unique<Ring>(static_cast<uint32_t>(registry.rings.size() + 1)));
+            holder.ring = registry.rings.back().get();
+        }
+    }
+
+    Ring& ring = *holder.ring;
+    uint64_t next = ring.next.load(std::memory_order_relaxed);
+    Ring::Event& event = ring.events[next % RingSize];
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+    ring.next.store(next + 1, std::memory_order_release);
+}
+
+std::string Trace::chrome_json()
+{
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    auto pid = ::getpid();
+
+    Registry& registry = Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for (const auto& ring : registry.rings) {
+        uint64_t next = ring->next.load(std::memory_order_acquire);
+        for (uint64_t ct = next > RingSize ? next - RingSize : 0; ct < next; ++ct) {
+            const Ring::Event& event = ring->events[ct % RingSize];
+            const char* name = event.name.load(std::memory_order_relaxed);
+            uint64_t begin = event.begin.load(std::memory_order_relaxed);
+            uint64_t end = event.end.load(std::memory_order_relaxed);
+            if (!name || end < begin) continue;
+            if (!first) json += ",\n";
+            first = false;
+            // timestamps are in microseconds
+            json += fmt::format("{{\"name\":\"{0}\",\"ph\":\"X\",\"ts\":{1}.{2:03},\"dur\":{3}.{4:03},\"pid\":{5},\"tid\":{6}}}",
+                                name, begin / 1000, begin % 1000, (end - begin) / 1000, (end - begin) % 1000, pid, ring->id);
+        }
+    }
+
+    json += "],\"displayTimeUnit\":\"ns\"}\n";
+
+    return json;
+}
+
+void Trace::write(const std::string& filename)
+{
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file) throw CDDBException(filename + ": cannot create");
+    file << chrome_json();
+    if (!file) throw CDDBException(filename + ": cannot write");
+}
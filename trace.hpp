@@ -0,0 +1,111 @@
+//
+//  trace.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef trace_hpp_POIUYTREWQLKJHGFDSAMNBVCXZPOIUYTREW
+#define trace_hpp_POIUYTREWQLKJHGFDSAMNBVCXZPOIUYTREW
+
+#include <cinttypes>
+#include <string>
+#include <chrono>
+
+
+// Scoped trace spans, compiled in with -DCDDB_TRACE (make TRACE=1), and
+// expanding to nothing otherwise. Names have to be string literals.
+//
+//   CDDB_TRACE_SCOPE("parse");           // until the end of the scope
+//   CDDB_TRACE_BEGIN(lookup, "lookup");  // until CDDB_TRACE_END(lookup)
+
+#ifdef CDDB_TRACE
+#define CDDB_TRACE_CONCAT_(a, b) a##b
+#define CDDB_TRACE_CONCAT(a, b) CDDB_TRACE_CONCAT_(a, b)
+#define CDDB_TRACE_SCOPE(name) CDDB::Trace::Span CDDB_TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define CDDB_TRACE_BEGIN(id, name) CDDB::Trace::Span trace_span_##id(name)
+#define CDDB_TRACE_END(id) trace_span_##id.end()
+#else
+#define CDDB_TRACE_SCOPE(name)
+#define CDDB_TRACE_BEGIN(id, name)
+#define CDDB_TRACE_END(id)
+#endif
+
+
+namespace CDDB {
+
+/// The spans are kept in a ring buffer per thread, so only the latest
+/// RingSize spans of each thread survive, and recording takes no lock. The
+/// rings of ended threads are handed to the next thread, as the server runs a
+/// thread per connection. chrome_json() renders all rings in the trace event
+/// format of chrome://tracing and Perfetto.
+
+class Trace {
+public:
+    enum : uint32_t { RingSize = 16384 };
+
+#ifdef CDDB_TRACE
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    class Span {
+    public:
+        Span(const char* name) : m_name(name), m_begin(now()) {}
+        ~Span() { end(); }
+
+        void end()
+        {
+            if (!m_name) return;
+            record(m_name, m_begin, now());
+            m_name = nullptr;
+        }
+
+    private:
+        const char* m_name;
+        uint64_t m_begin;
+    };
+
+    /// nanoseconds since the start of the process
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch()).count();
+    }
+
+    static void record(const char* name, uint64_t begin, uint64_t end);
+
+    /// a span that is recorded while the rings are read may show up torn
+    static std::string chrome_json();
+    static void write(const std::string& filename);
+
+private:
+    struct Ring;
+    struct Registry;
+    struct RingHolder;
+
+    static std::chrono::steady_clock::time_point epoch();
+};
+
+}
+
+#endif /* trace_hpp */
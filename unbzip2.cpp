@@ -26,9 +26,7 @@
 
 
 #include "unbzip2.hpp"
-#include <stdio.h>
 #include <stdexcept>
-#include <errno.h>
 #include <cstring>
 
 
@@ -37,33 +35,74 @@ class BZip2Exception : public std::runtime_error {
 };
 
 
-UnBZip2::UnBZip2(const std::string& file)
-: m_fp(nullptr)
-, m_bzfp(nullptr)
+UnBZip2::UnBZip2(std::unique_ptr<InputFile> file)
+: Decompressor(std::move(file))
+, m_in_stream(false)
+, m_input_end(false)
+, m_streams(0)
 {
-    if (!file.empty() && file != "-") m_fp = ::fopen(file.c_str(), "r");
-    else m_fp = ::stdin;
-    if (!m_fp) throw BZip2Exception(file + ": cannot open: " + strerror(errno));
-
-    int bzerror;
-    m_bzfp = BZ2_bzReadOpen(&bzerror, m_fp, 0, 0, nullptr, 0);
-    if (bzerror != BZ_OK) throw BZip2Exception(file + ": cannot open: " + bzstrerror(bzerror));
+    std::memset(&m_stream, 0, sizeof(m_stream));
 }
 
 UnBZip2::~UnBZip2()
 {
-    int bzerror;
-    if (m_bzfp) BZ2_bzReadClose(&bzerror, m_bzfp);
-    if (m_fp && m_fp != ::stdin) fclose(m_fp);
+    if (m_in_stream) BZ2_bzDecompressEnd(&m_stream);
+}
+
+void UnBZip2::init()
+{
+    // keep the pending input and output buffers over the reinitialization
+    bz_stream buffers = m_stream;
+    std::memset(&m_stream, 0, sizeof(m_stream));
+    int bzerror = BZ2_bzDecompressInit(&m_stream, 0, 0);
+    if (bzerror != BZ_OK) throw BZip2Exception(m_file->name() + ": cannot open: " + bzstrerror(bzerror));
+    m_stream.next_in = buffers.next_in;
+    m_stream.avail_in = buffers.avail_in;
+    m_stream.next_out = buffers.next_out;
+    m_stream.avail_out = buffers.avail_out;
+    m_in_stream = true;
+    ++m_streams;
 }
 
 ssize_t UnBZip2::read(void* buf, size_t len)
 {
-    int bzerror;
-    ssize_t rb = BZ2_bzRead(&bzerror, m_bzfp, buf, static_cast<int>(len));
-    if (bzerror == BZ_STREAM_END) return rb;
-    if (bzerror != BZ_OK) throw BZip2Exception(std::string("read error: ") + bzstrerror(bzerror));
-    return rb;
+    m_stream.next_out = static_cast<char*>(buf);
+    m_stream.avail_out = static_cast<unsigned int>(len);
+
+    while (m_stream.avail_out) {
+
+        if (!m_stream.avail_in && !m_input_end) {
+            m_stream.next_in = &m_buffer[0];
+            m_stream.avail_in = static_cast<unsigned int>(fill());
+            if (!m_stream.avail_in) m_input_end = true;
+        }
+
+        if (!m_in_stream) {
+            // parallel compressors write a sequence of streams
+            if (!m_stream.avail_in) break;
+            init();
+        }
+
+        unsigned int avail_out = m_stream.avail_out;
+        int bzerror = BZ2_bzDecompress(&m_stream);
+
+        if (bzerror == BZ_STREAM_END) {
+            BZ2_bzDecompressEnd(&m_stream);
+            m_in_stream = false;
+        } else if (bzerror == BZ_DATA_ERROR_MAGIC && m_streams > 1) {
+            // like bzip2 itself, ignore trailing garbage after the first stream
+            BZ2_bzDecompressEnd(&m_stream);
+            m_in_stream = false;
+            m_stream.avail_in = 0;
+            m_input_end = true;
+        } else if (bzerror != BZ_OK) {
+            throw BZip2Exception(std::string("read error: ") + bzstrerror(bzerror));
+        } else if (m_input_end && m_stream.avail_out == avail_out) {
+            throw BZip2Exception(std::string("read error: ") + bzstrerror(BZ_UNEXPECTED_EOF));
+        }
+    }
+
+    return len - m_stream.avail_out;
 }
 
 const char* UnBZip2::bzstrerror(int errcode)
@@ -93,8 +132,3 @@ const char* UnBZip2::bzstrerror(int errcode)
             return "configuration error";
     }
 }
-
-
-
-
-
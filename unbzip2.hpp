@@ -29,20 +29,24 @@
 
 #include <string>
 #include <bzlib.h>
+#include "decompressor.hpp"
 
 
 
-class UnBZip2 {
+class UnBZip2 : public Decompressor {
 public:
-    UnBZip2(const std::string& file);
+    UnBZip2(std::unique_ptr<InputFile> file);
     virtual ~UnBZip2();
 
-    ssize_t read(void* buf, size_t len);
+    virtual ssize_t read(void* buf, size_t len);
 
 private:
-    FILE* m_fp;
-    BZFILE* m_bzfp;
+    bz_stream m_stream;
+    bool m_in_stream;
+    bool m_input_end;
+    uint32_t m_streams;
 
+    void init();
     static const char* bzstrerror(int errcode);
 };
 
@@ -0,0 +1,101 @@
+//
+//  ungzip.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifdef HAVE_ZLIB
+
+#include "ungzip.hpp"
+#include <stdexcept>
+#include <cstring>
+
+
+class GZipException : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+
+UnGZip::UnGZip(std::unique_ptr<InputFile> file)
+: Decompressor(std::move(file))
+, m_in_stream(false)
+, m_input_end(false)
+, m_members(0)
+{
+    std::memset(&m_stream, 0, sizeof(m_stream));
+    // 16 + max window size: expect a gzip header
+    if (inflateInit2(&m_stream, 16 + MAX_WBITS) != Z_OK) {
+        throw GZipException(m_file->name() + ": cannot open: " + (m_stream.msg ? m_stream.msg : "init failed"));
+    }
+}
+
+UnGZip::~UnGZip()
+{
+    inflateEnd(&m_stream);
+}
+
+ssize_t UnGZip::read(void* buf, size_t len)
+{
+    m_stream.next_out = static_cast<Bytef*>(buf);
+    m_stream.avail_out = static_cast<uInt>(len);
+
+    while (m_stream.avail_out) {
+
+        if (!m_stream.avail_in && !m_input_end) {
+            m_stream.next_in = reinterpret_cast<Bytef*>(&m_buffer[0]);
+            m_stream.avail_in = static_cast<uInt>(fill());
+            if (!m_stream.avail_in) m_input_end = true;
+        }
+
+        if (!m_in_stream) {
+            // pigz and concatenated files have more than one member
+            if (!m_stream.avail_in) break;
+            if (m_members) {
+                // like gzip itself, ignore trailing garbage (mostly zero padding) after a member
+                if (m_stream.next_in[0] != 0x1f) {
+                    m_stream.avail_in = 0;
+                    m_input_end = true;
+                    break;
+                }
+                inflateReset(&m_stream);
+            }
+            m_in_stream = true;
+            ++m_members;
+        }
+
+        uInt avail_out = m_stream.avail_out;
+        int ret = inflate(&m_stream, Z_NO_FLUSH);
+
+        if (ret == Z_STREAM_END) {
+            m_in_stream = false;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw GZipException(std::string("read error: ") + (m_stream.msg ? m_stream.msg : zError(ret)));
+        } else if (m_input_end && m_stream.avail_out == avail_out) {
+            throw GZipException("read error: unexpected EOF");
+        }
+    }
+
+    return len - m_stream.avail_out;
+}
+
+#endif
@@ -41,8 +41,6 @@
 //  So please do not blame those for any errors this code may cause or have.
 
 
-#include <unistd.h>
-#include <fcntl.h>
 #include <cstdlib>
 #include <cstring>
 #include "untar.hpp"
@@ -188,59 +186,71 @@ void TarHeader::analyze()
 }
 
 
-UnTar::UnTar(const std::string& filename, bool use_bunzip)
-: m_fd(-1)
+UnTar::UnTar(const std::string& filename)
+: m_input(Decompressor::open(filename))
+, m_offset(0)
+, m_entries(0)
 {
-    if (use_bunzip) m_bunzip = std::make_unique<UnBZip2>(filename);
-    else {
-        if (!filename.empty() && filename != "-") m_fd = ::open(filename.c_str(), O_RDONLY);
-        else m_fd = STDIN_FILENO;
-    }
 }
 
 UnTar::~UnTar()
 {
-    if (m_fd >= 0 && m_fd != STDIN_FILENO) ::close(m_fd);
 }
 
 void UnTar::read(void* buf, size_t len)
 {
-    ssize_t rb;
-    if (m_bunzip) rb = m_bunzip->read(buf, len);
-    else rb = ::read(m_fd, buf, len);
-    if (rb != static_cast<ssize_t>(len)) throw TarException("unexpected end of file");
+    size_t done = 0;
+    while (done < len) {
+        // pipes may return less than requested
+        ssize_t rb = m_input->read(static_cast<char*>(buf) + done, len - done);
+        if (rb <= 0) throw TarException("unexpected end of file");
+        done += rb;
+    }
+    m_offset += len;
 }
 
-TarHeader::EntryType UnTar::entry(buf_t& buf, int accepted_types, bool skip_apple_resource_forks)
+void UnTar::skip(uint64_t offset, uint64_t entries)
+{
+    if (offset < m_offset) throw TarException("cannot skip backwards");
+
+    m_input->skip(offset - m_offset);
+
+    m_offset = offset;
+    m_entries = entries;
+    m_header.clear();
+}
+
+void UnTar::discard(size_t len)
+{
+    if (m_input->mapped()) {
+        m_input->skip(len);
+        m_offset += len;
+    }
+    // this invalidates the (raw) header, but it is a handy buffer to read up to 512 bytes into here
+    else read(*m_header, len);
+}
+
+template <class Reader>
+TarHeader::EntryType UnTar::next_entry(int accepted_types, bool skip_apple_resource_forks, Reader read_data)
 {
     do {
 
         m_header.reset();
         read(*m_header, TarHeader::HeaderLen);
         m_header.analyze();
+        ++m_entries;
 
         // this is the only valid exit condition from reading a tar archive - end header reached
         if (m_header.is_end()) return TarHeader::Unknown;
 
         if (m_header.type() == TarHeader::File) {
 
-            // make sure we reserve space for at least one more character than the file size
-            // (to cheaply add a 0 byte if the user wants to)
-            buf.reserve(m_header.filesize() + 1);
-
-            // resize the buffer to be able to read the file size
-            buf.resize(m_header.filesize());
-
-            // read the file into the buffer
-            read(&buf[0], m_header.filesize());
+            read_data(m_header.filesize());
 
             // check if we have to skip some padding bytes (tar files have a block size of 512)
             size_t padding = (TarHeader::HeaderLen - (m_header.filesize() % TarHeader::HeaderLen)) % TarHeader::HeaderLen;
 
-            if (padding) {
-                // this invalidates the (raw) header, but it is a handy buffer to read up to 512 bytes into here
-                read(*m_header, padding);
-            }
+            if (padding) discard(padding);
 
         }
 
@@ -249,6 +259,37 @@ TarHeader::EntryType UnTar::entry(buf_t& buf, int accepted_types, bool skip_appl
     return m_header.type();
 }
 
+TarHeader::EntryType UnTar::entry(buf_t& buf, int accepted_types, bool skip_apple_resource_forks)
+{
+    return next_entry(accepted_types, skip_apple_resource_forks, [&](size_t size) {
+        // make sure we reserve space for at least one more character than the file size
+        // (to cheaply add a 0 byte if the user wants to)
+        buf.reserve(size + 1);
+
+        // resize the buffer to be able to read the file size
+        buf.resize(size);
+
+        // read the file into the buffer
+        read(buf.data(), size);
+    });
+}
+
+TarHeader::EntryType UnTar::entry(CDDB::StringView& data, int accepted_types, bool skip_apple_resource_forks)
+{
+    return next_entry(accepted_types, skip_apple_resource_forks, [&](size_t size) {
+        if (m_input->mapped()) {
+            const char* mapped;
+            if (m_input->map(mapped, size) != size) throw TarException("unexpected end of file");
+            m_offset += size;
+            data = CDDB::StringView(mapped, size);
+        } else {
+            m_buffer.resize(size);
+            read(m_buffer.data(), size);
+            data = CDDB::StringView(m_buffer.data(), size);
+        }
+    });
+}
+
 bool UnTar::file(std::string& name, buf_t& buf, bool skip_apple_resource_forks)
 {
     if (entry(buf, TarHeader::File, skip_apple_resource_forks) == TarHeader::Unknown) return false;
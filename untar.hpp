@@ -30,7 +30,8 @@
 #include <cinttypes>
 #include <vector>
 #include <memory>
-#include "unbzip2.hpp"
+#include "decompressor.hpp"
+#include "stringview.hpp"
 
 
 class TarHeader {
@@ -113,7 +114,8 @@ class UnTar {
 public:
     typedef std::vector<char> buf_t;
 
-    UnTar(const std::string& filename, bool use_bunzip = false);
+    /// filename may be '-' for stdin. Compressed archives are detected by their content.
+    UnTar(const std::string& filename);
     ~UnTar();
 
     /// simple interface: call for subsequent real files, with buf getting filled with the file's data
@@ -124,6 +126,11 @@ public:
     /// returns type of the entry
     TarHeader::EntryType entry(buf_t& buf, int accepted_types = TarHeader::File, bool skip_apple_resource_forks = false);
 
+    /// zero copy variant of the extended interface: for uncompressed archives in regular files data
+    /// points directly into the memory mapped archive, otherwise into an internal buffer. It is valid
+    /// until the next call.
+    TarHeader::EntryType entry(CDDB::StringView& data, int accepted_types = TarHeader::File, bool skip_apple_resource_forks = false);
+
     /// for the extended interface: get the current file type (after a call to entry() )
     TarHeader::EntryType type() const { return m_header.type(); }
 
@@ -133,12 +140,28 @@ public:
     /// for the extended interface: get the current link name (after a call to entry(), and if the type is Link or Symlink)
     const std::string& linkname() const { return m_header.linkname(); }
 
+    /// offset in the (uncompressed) tar stream after the last entry that was read
+    uint64_t offset() const { return m_offset; }
+
+    /// count of tar headers read so far
+    uint64_t entries() const { return m_entries; }
+
+    /// continue reading at a position previously returned by offset() and entries().
+    /// Uncompressed files are seeked, compressed files or pipes are fast-skipped by
+    /// decompressing and discarding the data up to the position.
+    void skip(uint64_t offset, uint64_t entries);
+
 private:
     TarHeader m_header;
-    std::unique_ptr<UnBZip2> m_bunzip;
-    int m_fd;
+    std::unique_ptr<Decompressor> m_input;
+    uint64_t m_offset;
+    uint64_t m_entries;
+    buf_t m_buffer;
 
     void read(void* buf, size_t len);
+    void discard(size_t len);
+    template <class Reader>
+    TarHeader::EntryType next_entry(int accepted_types, bool skip_apple_resource_forks, Reader read_data);
 };
 
 
@@ -0,0 +1,102 @@
+//
+//  unxz.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifdef HAVE_LZMA
+
+#include "unxz.hpp"
+#include <stdexcept>
+#include <cstring>
+
+
+class XZException : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+
+UnXZ::UnXZ(std::unique_ptr<InputFile> file)
+: Decompressor(std::move(file))
+, m_stream(LZMA_STREAM_INIT)
+, m_input_end(false)
+, m_end(false)
+{
+    // LZMA_CONCATENATED decodes a sequence of streams, as written by parallel compressors
+    lzma_ret ret = lzma_stream_decoder(&m_stream, UINT64_MAX, LZMA_CONCATENATED);
+    if (ret != LZMA_OK) throw XZException(m_file->name() + ": cannot open: " + xzstrerror(ret));
+}
+
+UnXZ::~UnXZ()
+{
+    lzma_end(&m_stream);
+}
+
+ssize_t UnXZ::read(void* buf, size_t len)
+{
+    m_stream.next_out = static_cast<uint8_t*>(buf);
+    m_stream.avail_out = len;
+
+    while (m_stream.avail_out && !m_end) {
+
+        if (!m_stream.avail_in && !m_input_end) {
+            m_stream.next_in = reinterpret_cast<const uint8_t*>(&m_buffer[0]);
+            m_stream.avail_in = fill();
+            if (!m_stream.avail_in) m_input_end = true;
+        }
+
+        // with LZMA_FINISH, a truncated stream ends in LZMA_BUF_ERROR
+        lzma_ret ret = lzma_code(&m_stream, m_input_end ? LZMA_FINISH : LZMA_RUN);
+
+        if (ret == LZMA_STREAM_END) m_end = true;
+        else if (ret != LZMA_OK) throw XZException(std::string("read error: ") + xzstrerror(ret));
+    }
+
+    return len - m_stream.avail_out;
+}
+
+const char* UnXZ::xzstrerror(lzma_ret errcode)
+{
+    switch (errcode) {
+        default:
+            return "unknown error code";
+        case LZMA_OK:
+            return "success";
+        case LZMA_MEM_ERROR:
+            return "memory error";
+        case LZMA_MEMLIMIT_ERROR:
+            return "memory limit reached";
+        case LZMA_FORMAT_ERROR:
+            return "format error";
+        case LZMA_OPTIONS_ERROR:
+            return "unsupported options";
+        case LZMA_DATA_ERROR:
+            return "data error";
+        case LZMA_BUF_ERROR:
+            return "unexpected EOF";
+        case LZMA_PROG_ERROR:
+            return "programming error";
+    }
+}
+
+#endif
@@ -0,0 +1,54 @@
+//
+//  unxz.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef unxz_hpp_DLKSJVBHSDLKJVBHSDLKJVBSDLKJVBSDLKJVB
+#define unxz_hpp_DLKSJVBHSDLKJVBHSDLKJVBSDLKJVBSDLKJVB
+
+#ifdef HAVE_LZMA
+
+#include <lzma.h>
+#include "decompressor.hpp"
+
+
+
+class UnXZ : public Decompressor {
+public:
+    UnXZ(std::unique_ptr<InputFile> file);
+    virtual ~UnXZ();
+
+    virtual ssize_t read(void* buf, size_t len);
+
+private:
+    lzma_stream m_stream;
+    bool m_input_end;
+    bool m_end;
+
+    static const char* xzstrerror(lzma_ret errcode);
+};
+
+#endif
+
+#endif /* unxz_hpp */
@@ -0,0 +1,87 @@
+//
+//  unzstd.cpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifdef HAVE_ZSTD
+
+#include "unzstd.hpp"
+#include <stdexcept>
+
+
+class ZstdException : public std::runtime_error {
+    using runtime_error::runtime_error;
+};
+
+
+UnZstd::UnZstd(std::unique_ptr<InputFile> file)
+: Decompressor(std::move(file), ZSTD_DStreamInSize())
+, m_stream(ZSTD_createDStream())
+, m_input{ nullptr, 0, 0 }
+, m_input_end(false)
+, m_frame_complete(true)
+{
+    if (!m_stream) throw ZstdException(m_file->name() + ": cannot open: out of memory");
+    size_t ret = ZSTD_initDStream(m_stream);
+    if (ZSTD_isError(ret)) throw ZstdException(m_file->name() + ": cannot open: " + ZSTD_getErrorName(ret));
+}
+
+UnZstd::~UnZstd()
+{
+    ZSTD_freeDStream(m_stream);
+}
+
+ssize_t UnZstd::read(void* buf, size_t len)
+{
+    // frames simply follow each other, the decoder handles that by itself
+    ZSTD_outBuffer output = { buf, len, 0 };
+
+    while (output.pos < output.size) {
+
+        if (m_input.pos == m_input.size && !m_input_end) {
+            m_input.src = &m_buffer[0];
+            m_input.size = fill();
+            m_input.pos = 0;
+            if (!m_input.size) m_input_end = true;
+        }
+
+        size_t consumed = m_input.pos;
+        size_t produced = output.pos;
+        size_t ret = ZSTD_decompressStream(m_stream, &output, &m_input);
+        if (ZSTD_isError(ret)) throw ZstdException(std::string("read error: ") + ZSTD_getErrorName(ret));
+
+        if (m_input.pos != consumed || output.pos != produced) {
+            // returns 0 when a frame is completely decoded and flushed
+            m_frame_complete = (ret == 0);
+        } else if (m_input_end) {
+            // no more input and no more output - this is either the end, or a truncated frame
+            if (!m_frame_complete) throw ZstdException("read error: unexpected EOF");
+            break;
+        }
+    }
+
+    return output.pos;
+}
+
+#endif
@@ -0,0 +1,53 @@
+//
+//  unzstd.hpp
+//
+//  Copyright © 2016 Joachim Schurig. All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions are met:
+//
+//  1. Redistributions of source code must retain the above copyright notice, this
+//  list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright notice,
+//  this list of conditions and the following disclaimer in the documentation
+//  and/or other materials provided with the distribution.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+//  ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+//  WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+//  DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+//  ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+//  (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+//  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+//  ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+//  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef unzstd_hpp_SLKDJVBSLKDJVBHSLKDJVBSLKDJVBSDLKJVBS
+#define unzstd_hpp_SLKDJVBSLKDJVBHSLKDJVBSLKDJVBSDLKJVBS
+
+#ifdef HAVE_ZSTD
+
+#include <zstd.h>
+#include "decompressor.hpp"
+
+
+
+class UnZstd : public Decompressor {
+public:
+    UnZstd(std::unique_ptr<InputFile> file);
+    virtual ~UnZstd();
+
+    virtual ssize_t read(void* buf, size_t len);
+
+private:
+    ZSTD_DStream* m_stream;
+    ZSTD_inBuffer m_input;
+    bool m_input_end;
+    bool m_frame_complete;
+};
+
+#endif
+
+#endif /* unzstd_hpp */
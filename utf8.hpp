@@ -28,8 +28,29 @@
 #define utf8_hpp_EUIHDSIUSDZGALKHSBDLFUZDHSBKJDSLIVZSDJHBSKDVSDKVS
 
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
 #include <string>
 
+// Define CDDB_NO_SIMD to build the portable code paths only (e.g. to compare
+// performance). AVX2 is only used if the compiler targets it (-mavx2 or
+// -march=native), SSE2 is always available on x86_64.
+
+#if !defined(CDDB_NO_SIMD)
+ #if defined(__AVX2__)
+  #include <immintrin.h>
+  #define CDDB_UTF8_AVX2 1
+  #define CDDB_UTF8_SSE2 1
+ #elif defined(__SSE2__)
+  #include <emmintrin.h>
+  #define CDDB_UTF8_SSE2 1
+ #elif defined(__aarch64__) && defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define CDDB_UTF8_NEON 1
+ #endif
+#endif
+
 
 namespace CDDB {
 namespace Unicode {
@@ -53,8 +74,190 @@ namespace Unicode {
         }
     }
 
-    template<typename Ch, typename N>
-    void to_utf8(Ch sch, std::basic_string<N>& narrow)
+    /// returns the count of leading ASCII chars (< 0x80) in data
+    inline std::size_t ascii_length(const char* data, std::size_t size)
+    {
+        std::size_t pos = 0;
+
+#if defined(CDDB_UTF8_AVX2)
+        for (; pos + 32 <= size; pos += 32) {
+            uint32_t mask = _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos)));
+            if (mask) return pos + __builtin_ctz(mask);
+        }
+#endif
+#if defined(CDDB_UTF8_SSE2)
+        for (; pos + 16 <= size; pos += 16) {
+            uint32_t mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos)));
+            if (mask) return pos + __builtin_ctz(mask);
+        }
+#elif defined(CDDB_UTF8_NEON)
+        for (; pos + 16 <= size; pos += 16) {
+            if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos))) & 0x80) break;
+        }
+#endif
+        // eight bytes at a time for the remainder, or if there is no SIMD
+        for (; pos + 8 <= size; pos += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + pos, sizeof(word));
+            if (word & 0x8080808080808080ULL) break;
+        }
+
+        while (pos < size && !(data[pos] & 0x80)) ++pos;
+
+        return pos;
+    }
+
+    /// widens size ASCII chars from data into out
+    template<typename W>
+    inline void widen_ascii(const char* data, std::size_t size, W* out)
+    {
+        std::size_t pos = 0;
+
+#if defined(CDDB_UTF8_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        if (sizeof(W) == 4) {
+            for (; pos + 16 <= size; pos += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+                __m128i lo = _mm_unpacklo_epi8(v, zero);
+                __m128i hi = _mm_unpackhi_epi8(v, zero);
+                __m128i* o = reinterpret_cast<__m128i*>(out + pos);
+                _mm_storeu_si128(o,     _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128(o + 1, _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128(o + 2, _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128(o + 3, _mm_unpackhi_epi16(hi, zero));
+            }
+        } else if (sizeof(W) == 2) {
+            for (; pos + 16 <= size; pos += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+                __m128i* o = reinterpret_cast<__m128i*>(out + pos);
+                _mm_storeu_si128(o,     _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128(o + 1, _mm_unpackhi_epi8(v, zero));
+            }
+        }
+#elif defined(CDDB_UTF8_NEON)
+        if (sizeof(W) == 4) {
+            for (; pos + 16 <= size; pos += 16) {
+                uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+                uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+                uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+                uint32_t* o = reinterpret_cast<uint32_t*>(out + pos);
+                vst1q_u32(o,      vmovl_u16(vget_low_u16(lo)));
+                vst1q_u32(o + 4,  vmovl_u16(vget_high_u16(lo)));
+                vst1q_u32(o + 8,  vmovl_u16(vget_low_u16(hi)));
+                vst1q_u32(o + 12, vmovl_u16(vget_high_u16(hi)));
+            }
+        } else if (sizeof(W) == 2) {
+            for (; pos + 16 <= size; pos += 16) {
+                uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+                uint16_t* o = reinterpret_cast<uint16_t*>(out + pos);
+                vst1q_u16(o,     vmovl_u8(vget_low_u8(v)));
+                vst1q_u16(o + 8, vmovl_u8(vget_high_u8(v)));
+            }
+        }
+#endif
+        for (; pos < size; ++pos) out[pos] = W(static_cast<uint8_t>(data[pos]));
+    }
+
+    /// returns the count of leading wide chars < 0x80 in data
+    template<typename W>
+    inline std::size_t wide_ascii_length(const W* data, std::size_t size)
+    {
+        std::size_t pos = 0;
+
+#if defined(CDDB_UTF8_SSE2)
+        if (sizeof(W) == 4) {
+            const __m128i high = _mm_set1_epi32(~0x7f);
+            const __m128i zero = _mm_setzero_si128();
+            for (; pos + 8 <= size; pos += 8) {
+                const __m128i* i = reinterpret_cast<const __m128i*>(data + pos);
+                __m128i v = _mm_or_si128(_mm_loadu_si128(i), _mm_loadu_si128(i + 1));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, high), zero)) != 0xffff) break;
+            }
+        }
+#endif
+        while (pos < size && codepoint_cast(data[pos]) < 0x80) ++pos;
+
+        return pos;
+    }
+
+    /// narrows size wide chars < 0x80 from data into out
+    template<typename W, typename N>
+    inline void narrow_ascii(const W* data, std::size_t size, N* out)
+    {
+        std::size_t pos = 0;
+
+#if defined(CDDB_UTF8_SSE2)
+        if (sizeof(W) == 4 && sizeof(N) == 1) {
+            for (; pos + 16 <= size; pos += 16) {
+                const __m128i* i = reinterpret_cast<const __m128i*>(data + pos);
+                // all values are < 0x80, so signed saturation does not alter them
+                __m128i lo = _mm_packs_epi32(_mm_loadu_si128(i),     _mm_loadu_si128(i + 1));
+                __m128i hi = _mm_packs_epi32(_mm_loadu_si128(i + 2), _mm_loadu_si128(i + 3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + pos), _mm_packus_epi16(lo, hi));
+            }
+        }
+#endif
+        for (; pos < size; ++pos) out[pos] = N(data[pos]);
+    }
+
+    /// appends the ISO-8859-1 encoded data to narrow as UTF-8
+    template<typename N, typename Traits, typename Alloc>
+    void latin1_to_utf8(const char* data, std::size_t size, std::basic_string<N, Traits, Alloc>& narrow)
+    {
+        // convert in chunks on the stack, as every char >= 0x80 takes two bytes in UTF-8
+        const std::size_t chunk = 64;
+        N buf[2 * chunk];
+
+        while (size) {
+
+            std::size_t len = std::min(size, chunk);
+            std::size_t pos = 0;
+            N* out = buf;
+
+            while (pos < len) {
+#if defined(CDDB_UTF8_SSE2)
+                if (len - pos >= 16) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+                    if (!_mm_movemask_epi8(v)) {
+                        if (sizeof(N) == 1) _mm_storeu_si128(reinterpret_cast<__m128i*>(out), v);
+                        else widen_ascii(data + pos, 16, out);
+                        out += 16;
+                        pos += 16;
+                        continue;
+                    }
+                }
+#elif defined(CDDB_UTF8_NEON)
+                if (len - pos >= 16) {
+                    uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + pos));
+                    if (vmaxvq_u8(v) < 0x80) {
+                        if (sizeof(N) == 1) vst1q_u8(reinterpret_cast<uint8_t*>(out), v);
+                        else widen_ascii(data + pos, 16, out);
+                        out += 16;
+                        pos += 16;
+                        continue;
+                    }
+                }
+#endif
+                // without branches - mixed text would mispredict most of them. This
+                // always writes two bytes, the second one is overwritten for ASCII.
+                for (std::size_t end = std::min(len, pos + 16); pos < end; ++pos) {
+                    uint32_t ch = static_cast<uint8_t>(data[pos]);
+                    uint32_t two = ch >> 7;
+                    uint32_t mask = 0 - two;
+                    out[0] = N((ch & ~mask) | ((0xc0 | (ch >> 6)) & mask));
+                    out[1] = N(0x80 | (ch & 0x3f));
+                    out += 1 + two;
+                }
+            }
+
+            narrow.append(buf, out - buf);
+            data += len;
+            size -= len;
+        }
+    }
+
+    template<typename Ch, typename N, typename Traits, typename Alloc>
+    void to_utf8(Ch sch, std::basic_string<N, Traits, Alloc>& narrow)
     {
         uint32_t ch = codepoint_cast(sch);
 
@@ -81,15 +284,239 @@ namespace Unicode {
         }
     }
 
+    template<typename W, typename N, typename Traits, typename Alloc>
+    void to_utf8(const W* data, std::size_t size, std::basic_string<N, Traits, Alloc>& narrow)
+    {
+        const W* end = data + size;
+
+        while (data != end) {
+            // copy runs of ASCII in one go
+            std::size_t run = wide_ascii_length(data, end - data);
+            if (run) {
+                std::size_t pos = narrow.size();
+                narrow.resize(pos + run);
+                narrow_ascii(data, run, &narrow[pos]);
+                data += run;
+                if (data == end) break;
+            }
+            to_utf8(*data++, narrow);
+        }
+    }
+
     template<typename W, typename N>
     void to_utf8(const std::basic_string<W>& wide, std::basic_string<N>& narrow)
     {
-        for (auto ch : wide) to_utf8(ch, narrow);
+        to_utf8(wide.data(), wide.size(), narrow);
+    }
+
+#if defined(CDDB_UTF8_SSE2) || defined(CDDB_UTF8_NEON)
+
+    // The block validators flag an error at the byte that breaks a sequence, or,
+    // for overlong encodings, at the byte that completes it. Flags beyond the end
+    // of the input can therefore be ignored, which gives the same result as the
+    // scalar code for sequences that are truncated by the end of the input (they
+    // are accepted). Like the scalar code, they accept lead bytes up to 0xf7 and
+    // do not check for surrogates.
+
+#if defined(CDDB_UTF8_SSE2)
+
+    typedef __m128i utf8_block_t;
+
+    inline utf8_block_t utf8_load_block(const char* data)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    }
+
+    inline bool utf8_is_ascii(utf8_block_t block)
+    {
+        return !_mm_movemask_epi8(block);
+    }
+
+    inline utf8_block_t utf8_block_errors(utf8_block_t cur, utf8_block_t prev)
+    {
+        // cur shifted by one, two and three bytes, continued from prev
+        __m128i prev1 = _mm_or_si128(_mm_slli_si128(cur, 1), _mm_srli_si128(prev, 15));
+        __m128i prev2 = _mm_or_si128(_mm_slli_si128(cur, 2), _mm_srli_si128(prev, 14));
+        __m128i prev3 = _mm_or_si128(_mm_slli_si128(cur, 3), _mm_srli_si128(prev, 13));
+
+        // SSE2 has only signed byte comparisons - biasing by 0x80 maps unsigned
+        // order onto signed order: ASCII < 0x00..0x3f (continuation) < 0x40.. (lead)
+        const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+        __m128i ucur = _mm_xor_si128(cur, bias);
+        __m128i u1 = _mm_xor_si128(prev1, bias);
+        __m128i u2 = _mm_xor_si128(prev2, bias);
+        __m128i u3 = _mm_xor_si128(prev3, bias);
+
+        __m128i cont = _mm_cmplt_epi8(cur, _mm_set1_epi8(-64));
+        __m128i expected = _mm_or_si128(_mm_or_si128(
+                _mm_cmpgt_epi8(u1, _mm_set1_epi8(0x3f)),    // 2 byte lead (>= 0xc0) before
+                _mm_cmpgt_epi8(u2, _mm_set1_epi8(0x5f))),   // 3 byte lead (>= 0xe0) two before
+                _mm_cmpgt_epi8(u3, _mm_set1_epi8(0x6f)));   // 4 byte lead (>= 0xf0) three before
+
+        __m128i errors = _mm_xor_si128(expected, cont);
+        // 0xf8..0xff
+        errors = _mm_or_si128(errors, _mm_cmpgt_epi8(ucur, _mm_set1_epi8(0x77)));
+        // 0xc0 or 0xc1 lead: always overlong
+        errors = _mm_or_si128(errors, _mm_cmpeq_epi8(_mm_and_si128(prev1, _mm_set1_epi8(static_cast<char>(0xfe))), _mm_set1_epi8(static_cast<char>(0xc0))));
+        // 0xe0 lead followed by < 0xa0: overlong
+        errors = _mm_or_si128(errors, _mm_and_si128(_mm_cmpeq_epi8(prev2, _mm_set1_epi8(static_cast<char>(0xe0))), _mm_cmplt_epi8(u1, _mm_set1_epi8(0x20))));
+        // 0xf0 lead followed by < 0x90: overlong
+        errors = _mm_or_si128(errors, _mm_and_si128(_mm_cmpeq_epi8(prev3, _mm_set1_epi8(static_cast<char>(0xf0))), _mm_cmplt_epi8(u2, _mm_set1_epi8(0x10))));
+
+        return errors;
+    }
+
+    /// keeps the flags of the first count bytes of errors
+    inline utf8_block_t utf8_mask_errors(utf8_block_t errors, std::size_t count)
+    {
+        const __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        return _mm_and_si128(errors, _mm_cmplt_epi8(index, _mm_set1_epi8(static_cast<char>(count))));
+    }
+
+    inline utf8_block_t utf8_or(utf8_block_t a, utf8_block_t b) { return _mm_or_si128(a, b); }
+    inline utf8_block_t utf8_zero() { return _mm_setzero_si128(); }
+    inline bool utf8_none(utf8_block_t flags) { return !_mm_movemask_epi8(flags); }
+
+#elif defined(CDDB_UTF8_NEON)
+
+    typedef uint8x16_t utf8_block_t;
+
+    inline utf8_block_t utf8_load_block(const char* data)
+    {
+        return vld1q_u8(reinterpret_cast<const uint8_t*>(data));
+    }
+
+    inline bool utf8_is_ascii(utf8_block_t block)
+    {
+        return vmaxvq_u8(block) < 0x80;
+    }
+
+    inline utf8_block_t utf8_block_errors(utf8_block_t cur, utf8_block_t prev)
+    {
+        uint8x16_t prev1 = vextq_u8(prev, cur, 15);
+        uint8x16_t prev2 = vextq_u8(prev, cur, 14);
+        uint8x16_t prev3 = vextq_u8(prev, cur, 13);
+
+        uint8x16_t cont = vceqq_u8(vandq_u8(cur, vdupq_n_u8(0xc0)), vdupq_n_u8(0x80));
+        uint8x16_t expected = vorrq_u8(vorrq_u8(
+                vcgeq_u8(prev1, vdupq_n_u8(0xc0)),
+                vcgeq_u8(prev2, vdupq_n_u8(0xe0))),
+                vcgeq_u8(prev3, vdupq_n_u8(0xf0)));
+
+        uint8x16_t errors = veorq_u8(expected, cont);
+        errors = vorrq_u8(errors, vcgeq_u8(cur, vdupq_n_u8(0xf8)));
+        errors = vorrq_u8(errors, vceqq_u8(vandq_u8(prev1, vdupq_n_u8(0xfe)), vdupq_n_u8(0xc0)));
+        errors = vorrq_u8(errors, vandq_u8(vceqq_u8(prev2, vdupq_n_u8(0xe0)), vcltq_u8(prev1, vdupq_n_u8(0xa0))));
+        errors = vorrq_u8(errors, vandq_u8(vceqq_u8(prev3, vdupq_n_u8(0xf0)), vcltq_u8(prev2, vdupq_n_u8(0x90))));
+
+        return errors;
+    }
+
+    inline utf8_block_t utf8_mask_errors(utf8_block_t errors, std::size_t count)
+    {
+        static const uint8_t index[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+        return vandq_u8(errors, vcltq_u8(vld1q_u8(index), vdupq_n_u8(static_cast<uint8_t>(count))));
+    }
+
+    inline utf8_block_t utf8_or(utf8_block_t a, utf8_block_t b) { return vorrq_u8(a, b); }
+    inline utf8_block_t utf8_zero() { return vdupq_n_u8(0); }
+    inline bool utf8_none(utf8_block_t flags) { return !vmaxvq_u8(flags); }
+
+#endif
+
+    /// checks if data is valid UTF-8, 16 bytes at a time
+    inline bool valid_utf8(const char* data, std::size_t size)
+    {
+        utf8_block_t prev = utf8_zero();
+        utf8_block_t errors = utf8_zero();
+        bool prev_ascii = true;
+        std::size_t pos = 0;
+
+        for (; pos + 16 <= size; pos += 16) {
+            utf8_block_t cur = utf8_load_block(data + pos);
+            bool ascii = utf8_is_ascii(cur);
+            // nothing to check if neither this block nor the end of the last one has non-ASCII
+            if (!ascii || !prev_ascii) errors = utf8_or(errors, utf8_block_errors(cur, prev));
+            prev = cur;
+            prev_ascii = ascii;
+        }
+
+        if (pos < size && (!prev_ascii || ascii_length(data + pos, size - pos) != size - pos)) {
+            // pad the last block with ASCII, and ignore what gets flagged for the padding
+            char buf[16] = { 0 };
+            std::memcpy(buf, data + pos, size - pos);
+            errors = utf8_or(errors, utf8_mask_errors(utf8_block_errors(utf8_load_block(buf), prev), size - pos));
+        }
+
+        return utf8_none(errors);
+    }
+
+#else
+
+    /// checks if data is valid UTF-8, skipping over ASCII runs
+    inline bool valid_utf8(const char* data, std::size_t size)
+    {
+        const char* end = data + size;
+        uint16_t remaining { 0 };
+        uint32_t codepoint { 0 };
+        uint32_t lower_limit { 0 };
+
+        while (data != end) {
+
+            uint32_t ch = static_cast<uint8_t>(*data);
+
+            if (!remaining) {
+                if (ch < 128) {
+                    data += ascii_length(data, end - data);
+                    continue;
+                }
+                ++data;
+                if ((ch & 0x0e0) == 0x0c0) {
+                    remaining = 1;
+                    lower_limit = 0x080;
+                    codepoint = ch & 0x01f;
+                }
+                else if ((ch & 0x0f0) == 0x0e0) {
+                    remaining = 2;
+                    lower_limit = 0x0800;
+                    codepoint = ch & 0x0f;
+                }
+                else if ((ch & 0x0f8) == 0x0f0) {
+                    remaining = 3;
+                    lower_limit = 0x010000;
+                    codepoint = ch & 0x07;
+                }
+                else {
+                    return false;
+                }
+            }
+            else {
+                ++data;
+                if ((ch & 0x0c0) != 0x080) {
+                    return false;
+                }
+                codepoint <<= 6;
+                codepoint |= (ch & 0x03f);
+                --remaining;
+                if (!remaining) {
+                    if (codepoint < lower_limit) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
     }
 
-    template<typename N>
-    bool valid_utf8(const std::basic_string<N>& narrow)
+#endif
+
+    template<typename String>
+    bool valid_utf8(const String& narrow)
     {
+        typedef typename String::value_type N;
+
+        if (sizeof(N) == 1) return valid_utf8(reinterpret_cast<const char*>(narrow.data()), narrow.size());
+
         uint16_t remaining { 0 };
         uint32_t codepoint { 0 };
         uint32_t lower_limit { 0 };
@@ -156,9 +583,96 @@ namespace Unicode {
         return true;
     }
     
+    /// decodes UTF-8 from data and appends it to wide. ASCII runs are converted
+    /// with SIMD, other chars a sequence at a time instead of a byte at a time.
+    template<typename W>
+    bool from_utf8(const char* data, std::size_t size, std::basic_string<W>& wide)
+    {
+        const char* end = data + size;
+
+        // there are never more codepoints than bytes - size the string once,
+        // and cut it down to what was decoded when leaving
+        std::size_t base = wide.size();
+        wide.resize(base + size);
+        W* const first = &wide[0];
+        W* out = first + base;
+        bool valid = true;
+
+        while (data != end) {
+
+            uint32_t ch = static_cast<uint8_t>(*data);
+
+            if (ch < 0x080) {
+                std::size_t run = ascii_length(data, end - data);
+                widen_ascii(data, run, out);
+                out += run;
+                data += run;
+                continue;
+            }
+
+            std::size_t len;
+            uint32_t lower_limit;
+            if ((ch & 0x0e0) == 0x0c0) {
+                len = 2;
+                lower_limit = 0x080;
+                ch &= 0x01f;
+            }
+            else if ((ch & 0x0f0) == 0x0e0) {
+                len = 3;
+                lower_limit = 0x0800;
+                ch &= 0x0f;
+            }
+            else if ((ch & 0x0f8) == 0x0f0) {
+                len = 4;
+                lower_limit = 0x010000;
+                ch &= 0x07;
+            }
+            else {
+                valid = false;
+                break;
+            }
+
+            if (static_cast<std::size_t>(end - data) < len) {
+                // a sequence truncated by the end of the input is silently dropped,
+                // as long as what is there of it is well formed
+                while (++data != end) {
+                    if ((static_cast<uint8_t>(*data) & 0x0c0) != 0x080) {
+                        valid = false;
+                        break;
+                    }
+                }
+                break;
+            }
+
+            // continuation bytes are 10xxxxxx - collect the top bits to check them with one branch
+            uint32_t all = 0x0ff;
+            uint32_t any = 0;
+            for (std::size_t ct = 1; ct < len; ++ct) {
+                uint32_t cch = static_cast<uint8_t>(data[ct]);
+                all &= cch;
+                any |= cch;
+                ch = (ch << 6) | (cch & 0x03f);
+            }
+
+            if (!(all & 0x080) || (any & 0x040) || ch < lower_limit) {
+                valid = false;
+                break;
+            }
+
+            // see the note on 16 bit wide chars below
+            *out++ = W(ch);
+            data += len;
+        }
+
+        wide.resize(out - first);
+        return valid;
+    }
+
     template<typename N, typename W>
     bool from_utf8(const std::basic_string<N>& narrow, std::basic_string<W>& wide)
     {
+        if (sizeof(N) == 1) return from_utf8(reinterpret_cast<const char*>(narrow.data()), narrow.size(), wide);
+
         uint16_t remaining { 0 };
         uint32_t codepoint { 0 };
         uint32_t lower_limit { 0 };